@@ -0,0 +1,196 @@
+#include "backupengine.h"
+#include "chunkstore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <sqlite3.h>
+
+static const char BackupTimeFormat[] = "yyyyMMdd-HHmmss";
+static const char BackupSuffix[] = ".manifest";
+
+// Readers wait this long for a lock instead of failing at once; in WAL mode
+// only a concurrent checkpoint truncating the log can hold one
+static const int BusyTimeoutMs = 5000;
+
+bool BackupEngine::backup(const QString &vaultPath, const QString &directory, int keep,
+                          Snapshot *result, QString *error, const CancelCheck &isCancelled) {
+    QElapsedTimer timer;
+    timer.start();
+    
+    QDateTime created = QDateTime::currentDateTime();
+    QDir dir(directory);
+    QString manifestPath = dir.filePath(backupFileName(vaultPath, created));
+    // Staged as a plain copy so chunking reads a file no one is writing
+    QString stagingPath = manifestPath + ".db";
+    
+    Snapshot copy;
+    if (!snapshot(vaultPath, stagingPath, &copy, error, isCancelled)) {
+        return false;
+    }
+    
+    ChunkStore store(directory);
+    ChunkStore::Stats stats;
+    bool stored = store.store(stagingPath, manifestPath, &stats, error);
+    QFile::remove(stagingPath);
+    if (!stored) {
+        qWarning() << "Backup of" << vaultPath << "failed:" << (error ? *error : QString());
+        return false;
+    }
+    
+    rotate(vaultPath, directory, keep);
+    
+    if (result) {
+        result->path = manifestPath;
+        result->created = created;
+        result->bytes = stats.bytes;
+        result->storedBytes = stats.newBytes;
+        result->pages = copy.pages;
+        result->newChunks = stats.newChunks;
+        result->elapsedMs = timer.elapsed();
+    }
+    return true;
+}
+
+bool BackupEngine::restore(const QString &manifestPath, const QString &targetPath,
+                           QString *error) {
+    return ChunkStore(QFileInfo(manifestPath).absolutePath()).restore(manifestPath, targetPath,
+                                                                      error);
+}
+
+bool BackupEngine::snapshot(const QString &vaultPath, const QString &targetPath,
+                            Snapshot *result, QString *error, 
+                            const CancelCheck &isCancelled) {
+    QElapsedTimer timer;
+    timer.start();
+    
+    sqlite3 *source = nullptr;
+    sqlite3 *destination = nullptr;
+    QString tempPath = targetPath + ".part";
+    QString message;
+    int pages = 0;
+    
+    auto sqliteError = [](sqlite3 *db) {
+        return QString::fromUtf8(db ? sqlite3_errmsg(db) : "out of memory");
+    };
+    
+    QFile::remove(tempPath);
+    if (sqlite3_open_v2(vaultPath.toUtf8().constData(), &source, 
+                        SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        message = "Cannot open vault: " + sqliteError(source);
+    } else if (sqlite3_open_v2(tempPath.toUtf8().constData(), &destination,
+                               SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+        message = "Cannot create backup: " + sqliteError(destination);
+    } else {
+        sqlite3_busy_timeout(source, BusyTimeoutMs);
+        
+        // Pinning a read transaction fixes the snapshot for every step, so
+        // commits made meanwhile neither show up half-way nor restart the copy
+        if (sqlite3_exec(source, "BEGIN; SELECT COUNT(*) FROM sqlite_master;", 
+                         nullptr, nullptr, nullptr) != SQLITE_OK) {
+            message = "Cannot read vault: " + sqliteError(source);
+        } else {
+            sqlite3_backup *backup = sqlite3_backup_init(destination, "main", source, "main");
+            if (!backup) {
+                message = "Cannot start backup: " + sqliteError(destination);
+            } else {
+                int rc;
+                do {
+                    rc = sqlite3_backup_step(backup, PagesPerStep);
+                    if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+                        sqlite3_sleep(10);
+                    }
+                } while ((rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) &&
+                         !(isCancelled && isCancelled()));
+                pages = sqlite3_backup_pagecount(backup);
+                
+                if (rc != SQLITE_DONE) {
+                    message = rc == SQLITE_OK ? QString("Backup cancelled.")
+                                              : "Backup failed: " + QString::fromUtf8(sqlite3_errstr(rc));
+                }
+                sqlite3_backup_finish(backup);
+            }
+            sqlite3_exec(source, "COMMIT", nullptr, nullptr, nullptr);
+        }
+        
+        // The copy inherits WAL mode; a rollback journal keeps the backup a
+        // single self-contained file
+        if (message.isEmpty() &&
+            sqlite3_exec(destination, "PRAGMA journal_mode=DELETE", 
+                         nullptr, nullptr, nullptr) != SQLITE_OK) {
+            message = "Cannot finalize backup: " + sqliteError(destination);
+        }
+    }
+    
+    sqlite3_close(destination);
+    sqlite3_close(source);
+    
+    if (message.isEmpty()) {
+        QFile::remove(targetPath);
+        if (!QFile::rename(tempPath, targetPath)) {
+            message = "Cannot move backup into place: " + targetPath;
+        }
+    }
+    if (!message.isEmpty()) {
+        QFile::remove(tempPath);
+        qWarning() << "Backup of" << vaultPath << "failed:" << message;
+        if (error) *error = message;
+        return false;
+    }
+    
+    if (result) {
+        result->path = targetPath;
+        result->created = QDateTime::currentDateTime();
+        result->bytes = QFileInfo(targetPath).size();
+        result->pages = pages;
+        result->elapsedMs = timer.elapsed();
+    }
+    return true;
+}
+
+QStringList BackupEngine::backupsOf(const QString &vaultPath, const QString &directory) {
+    QString prefix = QFileInfo(vaultPath).completeBaseName() + "-";
+    QDir dir(directory);
+    // The timestamp in the name sorts chronologically
+    QStringList names = dir.entryList({prefix + "*" + BackupSuffix}, QDir::Files, 
+                                      QDir::Name | QDir::Reversed);
+    
+    // Skip the backups of other vaults whose names share the prefix
+    const int nameLength = prefix.size() + int(sizeof(BackupTimeFormat)) - 1 + 
+                           int(sizeof(BackupSuffix)) - 1;
+    QStringList paths;
+    for (const QString &name : names) {
+        if (name.size() == nameLength) {
+            paths.append(dir.filePath(name));
+        }
+    }
+    return paths;
+}
+
+QStringList BackupEngine::rotate(const QString &vaultPath, const QString &directory, int keep) {
+    QStringList removed;
+    QStringList backups = backupsOf(vaultPath, directory);
+    for (int i = qMax(keep, 0); i < backups.size(); ++i) {
+        if (QFile::remove(backups[i])) {
+            removed.append(backups[i]);
+        } else {
+            qWarning() << "Failed to remove old backup" << backups[i];
+        }
+    }
+    
+    // Other vaults may share the directory and the chunks, so every manifest
+    // in it counts, not just this vault's
+    QDir dir(directory);
+    QStringList manifests;
+    for (const QString &name : dir.entryList({QString("*") + BackupSuffix}, QDir::Files)) {
+        manifests.append(dir.filePath(name));
+    }
+    ChunkStore(directory).collectGarbage(manifests);
+    return removed;
+}
+
+QString BackupEngine::backupFileName(const QString &vaultPath, const QDateTime &time) {
+    return QFileInfo(vaultPath).completeBaseName() + "-" + 
+           time.toString(BackupTimeFormat) + BackupSuffix;
+}
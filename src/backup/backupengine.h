@@ -0,0 +1,56 @@
+#ifndef BACKUPENGINE_H
+#define BACKUPENGINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <functional>
+
+// Consistent snapshots of a vault file through the SQLite online backup API.
+// The copy runs on its own read-only connection inside one read transaction,
+// so in WAL mode it sees a single point in time and never blocks (or is
+// restarted by) writers on the application's connection. Backups are kept
+// deduplicated in a ChunkStore, one manifest per snapshot. Everything here
+// is safe to call from a worker thread.
+class BackupEngine {
+public:
+    struct Snapshot {
+        QString path;               // The manifest
+        QDateTime created;
+        qint64 bytes = 0;           // Size of the vault file
+        qint64 storedBytes = 0;     // Written to the chunk store
+        int pages = 0;
+        int newChunks = 0;
+        qint64 elapsedMs = 0;
+    };
+
+    // Pages copied per backup step; between steps the copy can be cancelled
+    static constexpr int PagesPerStep = 256;
+
+    using CancelCheck = std::function<bool()>;
+
+    // Snapshots vaultPath into the chunk store in directory, then rotates
+    // down to keep backups and drops the chunks nothing refers to anymore
+    static bool backup(const QString &vaultPath, const QString &directory, int keep,
+                       Snapshot *result, QString *error = nullptr,
+                       const CancelCheck &isCancelled = CancelCheck());
+    // Writes a restorable copy of the vault a manifest describes
+    static bool restore(const QString &manifestPath, const QString &targetPath,
+                        QString *error = nullptr);
+
+    // Plain copy of the vault. Written next to targetPath first and renamed
+    // into place once complete, so a crash never leaves a truncated file
+    static bool snapshot(const QString &vaultPath, const QString &targetPath, 
+                         Snapshot *result, QString *error = nullptr,
+                         const CancelCheck &isCancelled = CancelCheck());
+
+    // Manifests of the backups of vaultPath in directory, newest first
+    static QStringList backupsOf(const QString &vaultPath, const QString &directory);
+    // Deletes the oldest backups of vaultPath beyond keep, along with chunks
+    // no remaining backup in directory uses; returns the removed manifests
+    static QStringList rotate(const QString &vaultPath, const QString &directory, int keep);
+
+    static QString backupFileName(const QString &vaultPath, const QDateTime &time);
+};
+
+#endif
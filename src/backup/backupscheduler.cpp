@@ -0,0 +1,126 @@
+#include "backupscheduler.h"
+#include <QtConcurrent>
+#include <QPromise>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+static const char LastBackupTimeKey[] = "backup.lastBackupTime";
+
+BackupScheduler::BackupScheduler(Database *database, VaultSettings *settings, QObject *parent)
+    : QObject(parent),
+      m_database(database),
+      m_settings(settings),
+      m_watcher(new QFutureWatcher<Result>(this)) {
+    m_checkTimer.setInterval(CheckInterval);
+    connect(&m_checkTimer, &QTimer::timeout, this, &BackupScheduler::checkDue);
+    connect(m_watcher, &QFutureWatcher<Result>::finished, 
+            this, &BackupScheduler::onBackupFinished);
+    
+    reschedule();
+}
+
+BackupScheduler::~BackupScheduler() {
+    // The snapshot has its own connection, but the vault may be closed and
+    // moved right after this, so stop the copy at the next step
+    m_watcher->cancel();
+    m_watcher->waitForFinished();
+}
+
+void BackupScheduler::reschedule() {
+    if (m_settings->autoBackupEnabled() && m_settings->backupFrequency() != VaultSettings::Never) {
+        m_checkTimer.start();
+        checkDue();
+    } else {
+        m_checkTimer.stop();
+    }
+}
+
+bool BackupScheduler::backupNow() {
+    if (isRunning() || !m_database || !m_database->isOpen()) {
+        return false;
+    }
+    
+    QString directory = backupDirectory();
+    if (!QDir().mkpath(directory)) {
+        emit backupFailed("Cannot create backup directory " + directory);
+        return false;
+    }
+    
+    m_watcher->setFuture(QtConcurrent::run(
+        [](QPromise<Result> &promise, const QString &vaultPath, const QString &directory, 
+           int keep) {
+            Result result;
+            result.ok = BackupEngine::backup(vaultPath, directory, keep, &result.snapshot,
+                                             &result.error,
+                                             [&promise]() { return promise.isCanceled(); });
+            promise.addResult(result);
+        }, m_database->path(), directory, m_settings->maxBackupCount()));
+    return true;
+}
+
+bool BackupScheduler::isRunning() const {
+    return m_watcher->isRunning();
+}
+
+QString BackupScheduler::backupDirectory() const {
+    QString location = m_settings->backupLocation();
+    if (QDir::isAbsolutePath(location)) {
+        return QDir::cleanPath(location);
+    }
+    return QDir::cleanPath(QFileInfo(m_database->path()).absoluteDir().filePath(location));
+}
+
+QDateTime BackupScheduler::lastBackupTime() const {
+    return m_database->getSetting(LastBackupTimeKey).toDateTime();
+}
+
+QDateTime BackupScheduler::nextBackupTime() const {
+    if (!m_settings->autoBackupEnabled()) {
+        return QDateTime();
+    }
+    
+    QDateTime last = lastBackupTime();
+    if (!last.isValid()) {
+        return QDateTime::currentDateTime();
+    }
+    
+    switch (m_settings->backupFrequency()) {
+    case VaultSettings::Daily:
+        return last.addDays(1);
+    case VaultSettings::Weekly:
+        return last.addDays(7);
+    case VaultSettings::Monthly:
+        return last.addMonths(1);
+    case VaultSettings::Never:
+        break;
+    }
+    return QDateTime();
+}
+
+void BackupScheduler::checkDue() {
+    QDateTime next = nextBackupTime();
+    if (next.isValid() && next <= QDateTime::currentDateTime()) {
+        backupNow();
+    }
+}
+
+void BackupScheduler::onBackupFinished() {
+    if (m_watcher->isCanceled() || m_watcher->future().resultCount() == 0) {
+        return;
+    }
+    
+    Result result = m_watcher->result();
+    if (!result.ok) {
+        emit backupFailed(result.error);
+        return;
+    }
+    
+    const BackupEngine::Snapshot &snapshot = result.snapshot;
+    m_database->setSetting(LastBackupTimeKey, snapshot.created);
+    m_history.append(snapshot);
+    qDebug() << "Backed up vault to" << snapshot.path << ":" << snapshot.bytes << "bytes,"
+             << snapshot.storedBytes << "new in" << snapshot.newChunks << "chunks,"
+             << snapshot.elapsedMs << "ms";
+    emit backupFinished(snapshot);
+}
@@ -0,0 +1,63 @@
+#ifndef BACKUPSCHEDULER_H
+#define BACKUPSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QTimer>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include "backupengine.h"
+#include "../storage/database.h"
+#include "../models/settings.h"
+
+// Implements the backup options of VaultSettings: while a vault is open it
+// checks periodically whether a backup is due, snapshots the vault on a
+// worker thread, and rotates the backup directory down to maxBackupCount.
+// The time of the last backup is kept in the vault's settings.
+class BackupScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int CheckInterval = 15 * 60 * 1000;    // ms
+
+    BackupScheduler(Database *database, VaultSettings *settings, QObject *parent = nullptr);
+    ~BackupScheduler();
+
+    // Call after the backup settings changed
+    void reschedule();
+    // Starts a backup regardless of the schedule; false if one is running
+    bool backupNow();
+    bool isRunning() const;
+
+    // A relative backupLocation is relative to the vault's directory
+    QString backupDirectory() const;
+    QDateTime lastBackupTime() const;
+    // Invalid when automatic backups are off
+    QDateTime nextBackupTime() const;
+    // Snapshots taken since the vault was opened, oldest first
+    const QList<BackupEngine::Snapshot> &history() const { return m_history; }
+
+signals:
+    void backupFinished(const BackupEngine::Snapshot &snapshot);
+    void backupFailed(const QString &message);
+
+private slots:
+    void checkDue();
+    void onBackupFinished();
+
+private:
+    struct Result {
+        bool ok = false;
+        BackupEngine::Snapshot snapshot;
+        QString error;
+    };
+
+    Database *m_database;
+    VaultSettings *m_settings;
+    QTimer m_checkTimer;
+    QFutureWatcher<Result> *m_watcher;
+    QList<BackupEngine::Snapshot> m_history;
+};
+
+#endif
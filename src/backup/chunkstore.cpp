@@ -0,0 +1,227 @@
+#include "chunkstore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QTextStream>
+#include <QCryptographicHash>
+#include <QDirIterator>
+#include <QtEndian>
+#include <QDebug>
+
+static const char ManifestMagic[] = "PMBACKUP 1";
+static const char ChunkDirectory[] = "chunks";
+// Offset and size of the page size field in the SQLite file header
+static const int SqlitePageSizeOffset = 16;
+static const int SqliteHeaderSize = 100;
+
+ChunkStore::ChunkStore(const QString &directory)
+    : m_directory(directory) {}
+
+bool ChunkStore::store(const QString &filePath, const QString &manifestPath, Stats *stats,
+                       QString *error) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    
+    int chunkSize = pageSizeOf(file.peek(SqliteHeaderSize));
+    QCryptographicHash fileHash(QCryptographicHash::Sha256);
+    QStringList chunkHashes;
+    Stats result;
+    
+    while (!file.atEnd()) {
+        QByteArray chunk = file.read(chunkSize);
+        if (chunk.isEmpty()) {
+            if (error) *error = file.errorString();
+            return false;
+        }
+        fileHash.addData(chunk);
+        
+        QByteArray hexHash = QCryptographicHash::hash(chunk, QCryptographicHash::Sha256).toHex();
+        chunkHashes.append(QString::fromLatin1(hexHash));
+        ++result.chunks;
+        result.bytes += chunk.size();
+        
+        if (!QFile::exists(chunkPath(hexHash))) {
+            if (!writeChunk(hexHash, chunk, error)) {
+                return false;
+            }
+            ++result.newChunks;
+            result.newBytes += chunk.size();
+        }
+    }
+    
+    // Chunks go first, so a manifest only ever refers to chunks on disk
+    QSaveFile manifest(manifestPath);
+    if (!manifest.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (error) *error = manifest.errorString();
+        return false;
+    }
+    QTextStream out(&manifest);
+    out << ManifestMagic << "\n"
+        << "size " << result.bytes << "\n"
+        << "sha256 " << fileHash.result().toHex() << "\n";
+    for (const QString &hash : chunkHashes) {
+        out << hash << "\n";
+    }
+    out.flush();
+    if (!manifest.commit()) {
+        if (error) *error = manifest.errorString();
+        return false;
+    }
+    
+    if (stats) *stats = result;
+    return true;
+}
+
+bool ChunkStore::restore(const QString &manifestPath, const QString &targetPath, 
+                         QString *error) {
+    Manifest manifest;
+    if (!readManifest(manifestPath, &manifest, error)) {
+        return false;
+    }
+    
+    QSaveFile target(targetPath);
+    if (!target.open(QIODevice::WriteOnly)) {
+        if (error) *error = target.errorString();
+        return false;
+    }
+    
+    QCryptographicHash fileHash(QCryptographicHash::Sha256);
+    qint64 written = 0;
+    for (const QByteArray &hexHash : manifest.chunks) {
+        QFile chunkFile(chunkPath(hexHash));
+        if (!chunkFile.open(QIODevice::ReadOnly)) {
+            if (error) *error = "Missing backup chunk " + QString::fromLatin1(hexHash);
+            return false;
+        }
+        QByteArray chunk = chunkFile.readAll();
+        if (QCryptographicHash::hash(chunk, QCryptographicHash::Sha256).toHex() != hexHash) {
+            if (error) *error = "Corrupt backup chunk " + QString::fromLatin1(hexHash);
+            return false;
+        }
+        
+        fileHash.addData(chunk);
+        if (target.write(chunk) != chunk.size()) {
+            if (error) *error = target.errorString();
+            return false;
+        }
+        written += chunk.size();
+    }
+    
+    if (written != manifest.size || fileHash.result().toHex() != manifest.hash) {
+        if (error) *error = "The restored file does not match the backup manifest.";
+        return false;
+    }
+    if (!target.commit()) {
+        if (error) *error = target.errorString();
+        return false;
+    }
+    return true;
+}
+
+int ChunkStore::collectGarbage(const QStringList &manifestPaths) {
+    QSet<QString> referenced;
+    for (const QString &path : manifestPaths) {
+        Manifest manifest;
+        QString error;
+        if (!readManifest(path, &manifest, &error)) {
+            // Deleting on a partial view could destroy chunks a backup needs
+            qWarning() << "Skipping chunk cleanup:" << path << error;
+            return 0;
+        }
+        for (const QByteArray &hash : manifest.chunks) {
+            referenced.insert(QString::fromLatin1(hash));
+        }
+    }
+    
+    int removed = 0;
+    QDirIterator it(QDir(m_directory).filePath(ChunkDirectory), QDir::Files,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        // Temporary files left by an interrupted write go too
+        if (!referenced.contains(it.fileName()) && QFile::remove(path)) {
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+QString ChunkStore::chunkPath(const QByteArray &hexHash) const {
+    // Sharding by the first byte keeps directories small
+    return QString("%1/%2/%3/%4").arg(m_directory, ChunkDirectory, 
+                                      QString::fromLatin1(hexHash.left(2)),
+                                      QString::fromLatin1(hexHash));
+}
+
+bool ChunkStore::writeChunk(const QByteArray &hexHash, const QByteArray &data, 
+                            QString *error) {
+    QString path = chunkPath(hexHash);
+    if (!QDir().mkpath(QFileInfo(path).path())) {
+        if (error) *error = "Cannot create " + QFileInfo(path).path();
+        return false;
+    }
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+int ChunkStore::pageSizeOf(const QByteArray &header) {
+    if (header.size() < SqliteHeaderSize || !header.startsWith("SQLite format 3")) {
+        return DefaultChunkSize;
+    }
+    
+    int pageSize = qFromBigEndian<quint16>(header.constData() + SqlitePageSizeOffset);
+    if (pageSize == 1) {
+        return 65536;
+    }
+    // Powers of two from 512 to 32768 are the only valid values
+    if (pageSize < 512 || (pageSize & (pageSize - 1)) != 0) {
+        return DefaultChunkSize;
+    }
+    return pageSize;
+}
+
+bool ChunkStore::readManifest(const QString &path, Manifest *manifest, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    
+    if (file.readLine().trimmed() != ManifestMagic) {
+        if (error) *error = "Not a backup manifest.";
+        return false;
+    }
+    
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        if (line.startsWith("size ")) {
+            manifest->size = line.mid(5).toLongLong();
+        } else if (line.startsWith("sha256 ")) {
+            manifest->hash = line.mid(7);
+        } else if (line.size() == 64) {
+            manifest->chunks.append(line);
+        } else {
+            if (error) *error = "Malformed backup manifest.";
+            return false;
+        }
+    }
+    
+    if (manifest->hash.size() != 64) {
+        if (error) *error = "Malformed backup manifest.";
+        return false;
+    }
+    return true;
+}
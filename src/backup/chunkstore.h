@@ -0,0 +1,62 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+
+// Content-addressed store for vault snapshots. A snapshot is split into
+// chunks that are each saved once under chunks/<xx>/<sha256>, plus a small
+// text manifest listing the chunk hashes in order:
+//
+//   PMBACKUP 1
+//   size <bytes>
+//   sha256 <hash of the whole file>
+//   <chunk hash>
+//   ...
+//
+// Chunks are cut at the database's page boundaries. SQLite rewrites pages in
+// place and never shifts the bytes after an edit, so the unchanged pages of
+// the next snapshot hash identically and are not written again.
+class ChunkStore {
+public:
+    struct Stats {
+        int chunks = 0;
+        int newChunks = 0;
+        qint64 bytes = 0;
+        qint64 newBytes = 0;
+    };
+
+    static constexpr int DefaultChunkSize = 4096;
+
+    explicit ChunkStore(const QString &directory);
+
+    // Chunks filePath into the store and writes its manifest
+    bool store(const QString &filePath, const QString &manifestPath, Stats *stats = nullptr,
+               QString *error = nullptr);
+    // Reassembles a snapshot, verifying every chunk and the whole file
+    bool restore(const QString &manifestPath, const QString &targetPath, 
+                 QString *error = nullptr);
+    // Deletes chunks that none of the given manifests refer to; returns the
+    // number of chunks removed
+    int collectGarbage(const QStringList &manifestPaths);
+
+    QString directory() const { return m_directory; }
+
+private:
+    struct Manifest {
+        qint64 size = 0;
+        QByteArray hash;
+        QList<QByteArray> chunks;
+    };
+
+    QString chunkPath(const QByteArray &hexHash) const;
+    bool writeChunk(const QByteArray &hexHash, const QByteArray &data, QString *error);
+    static int pageSizeOf(const QByteArray &header);
+    static bool readManifest(const QString &path, Manifest *manifest, QString *error);
+
+    QString m_directory;
+};
+
+#endif
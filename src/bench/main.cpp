@@ -0,0 +1,171 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTextStream>
+#include <QFile>
+#include <vector>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+#include "../storage/database.h"
+#include "../crypto/encryption.h"
+#include "../crypto/securearena.h"
+#include "../export/vaultexporter.h"
+
+// Times the bulk paths of the core on a generated vault: decryption at 1..N
+// threads, the secure allocations a load and a copy make, and how far the
+// resident set grows during an export. Only the numbers are printed, so runs
+// on different machines can be compared.
+
+// Resident set size in KiB, or -1 where /proc is not available
+static qint64 residentKiB() {
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) {
+        return -1;
+    }
+    return fields[1].toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+static QList<PasswordEntry> generateEntries(int count) {
+    QList<PasswordEntry> entries;
+    entries.reserve(count);
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < count; ++i) {
+        // A few hundred hosts and usernames, as in a real vault
+        entries.append(PasswordEntry(0,
+            QString("Account %1").arg(i),
+            QString("user%1@example.com").arg(i % 300),
+            SecureString(QString("pw-%1-%2").arg(i).arg(i * 7919)),
+            QString("https://login.site%1.example.com/signin?ref=%2").arg(i % 500).arg(i),
+            SecureString(i % 4 == 0 ? QString("Recovery codes for account %1").arg(i) : QString()),
+            now, now));
+    }
+    return entries;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("Password Manager Bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the vault core on a generated vault.");
+    parser.addHelpOption();
+    QCommandLineOption entriesOption("entries", "Entries in the generated vault.", "count", "100000");
+    QCommandLineOption threadsOption("threads", "Most decryption threads to measure.", "count",
+                                     QString::number(QThread::idealThreadCount()));
+    parser.addOption(entriesOption);
+    parser.addOption(threadsOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    const int entryCount = qMax(1, parser.value(entriesOption).toInt());
+    const int maxThreads = qMax(1, parser.value(threadsOption).toInt());
+
+    QTemporaryDir dir;
+    Database database;
+    if (!dir.isValid() || !database.open(dir.filePath("bench.db"))) {
+        out << "Cannot create a vault in a temporary directory.\n";
+        return 1;
+    }
+    const QByteArray masterKey = Encryption::generateKey();
+    SecureArena &arena = SecureArena::instance();
+
+    QElapsedTimer timer;
+    {
+        QList<PasswordEntry> entries = generateEntries(entryCount);
+        timer.start();
+        if (!database.addEntries(entries, masterKey)) {
+            out << "Failed to fill the vault.\n";
+            return 1;
+        }
+        out << "Inserted " << entryCount << " entries in " << timer.elapsed() << " ms\n\n";
+    }
+
+    // Decryption scaling; the rows are read once so only decryption is timed
+    const QList<Database::EncryptedRow> rows = database.getEncryptedRows();
+    out << "threads  summary ms  speedup  all ms  speedup  allocations/entry\n";
+    double summaryBase = 0;
+    double allBase = 0;
+    for (int threads = 1; ; threads = qMin(threads * 2, maxThreads)) {
+        Database::setDecryptionThreadCount(threads);
+
+        timer.start();
+        QList<PasswordEntry> summaries = Database::decryptRows(rows, masterKey, EntryRecord::Summary);
+        const double summaryMs = timer.nsecsElapsed() / 1e6;
+        summaries.clear();
+
+        const size_t allocationsBefore = arena.allocationCount();
+        timer.start();
+        QList<PasswordEntry> entries = Database::decryptRows(rows, masterKey, EntryRecord::All);
+        const double allMs = timer.nsecsElapsed() / 1e6;
+        const size_t allocations = arena.allocationCount() - allocationsBefore;
+        entries.clear();
+
+        if (threads == 1) {
+            summaryBase = summaryMs;
+            allBase = allMs;
+        }
+        out << qSetFieldWidth(7) << threads << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(10) << QString::number(summaryMs, 'f', 1) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(7) << QString::number(summaryBase / summaryMs, 'f', 2)
+            << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(6) << QString::number(allMs, 'f', 1) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(7) << QString::number(allBase / allMs, 'f', 2)
+            << qSetFieldWidth(0) << "  "
+            << QString::number(double(allocations) / rows.size(), 'f', 2) << "\n";
+        if (threads == maxThreads) break;
+    }
+    Database::setDecryptionThreadCount(QThread::idealThreadCount());
+
+    // A copy of a decrypted entry duplicates its secrets; moves must not
+    {
+        QList<PasswordEntry> entries = Database::decryptRows(rows, masterKey, EntryRecord::All);
+        size_t before = arena.allocationCount();
+        std::vector<PasswordEntry> copies(entries.cbegin(), entries.cend());
+        const size_t copied = arena.allocationCount() - before;
+
+        before = arena.allocationCount();
+        std::vector<PasswordEntry> moved;
+        moved.reserve(copies.size());
+        for (PasswordEntry &entry : copies) {
+            moved.push_back(std::move(entry));
+        }
+        const size_t moves = arena.allocationCount() - before;
+
+        out << "\nSecure allocations per entry: copy " << double(copied) / entries.size()
+            << ", move " << double(moves) / entries.size() << "\n";
+    }
+
+    // Export memory: the resident set is sampled after every flushed chunk
+    const qint64 baseline = residentKiB();
+    qint64 peak = baseline;
+    VaultExporter exporter(&database, masterKey);
+    timer.start();
+    bool exported = exporter.exportTo(dir.filePath("export.csv"), VaultExporter::CsvFormat,
+                                      QString(), [&peak](int, int) {
+        peak = qMax(peak, residentKiB());
+        return true;
+    });
+    if (!exported) {
+        out << "\nExport failed: " << exporter.errorString() << "\n";
+        return 1;
+    }
+    out << "\nExported " << exporter.exportedCount() << " entries in " << timer.elapsed() << " ms";
+    if (baseline >= 0) {
+        out << ", resident set grew by at most " << (peak - baseline) << " KiB";
+    }
+    out << "\n";
+
+    database.close();
+    return 0;
+}
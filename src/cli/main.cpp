@@ -0,0 +1,14 @@
+#include <QCoreApplication>
+#include "vaultcli.h"
+
+int main(int argc, char *argv[]) {
+    // No QApplication: nothing here may pull in widgets, styles or a display
+    QCoreApplication app(argc, argv);
+    // Same names as the GUI, so both share the device id and vault list
+    app.setApplicationName("Password Manager");
+    app.setOrganizationName("LocalFirst");
+    app.setOrganizationDomain("localfirst.pm");
+
+    VaultCli cli;
+    return cli.run(app.arguments());
+}
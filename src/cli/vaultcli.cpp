@@ -0,0 +1,529 @@
+#include "vaultcli.h"
+#include "../crypto/encryption.h"
+#include "../crypto/securememory.h"
+#include "../search/fuzzymatcher.h"
+#include "../import/importservice.h"
+#include "../export/vaultexporter.h"
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QHash>
+#include <QtGlobal>
+#include <cstdio>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+static const char MasterPasswordVariable[] = "PM_MASTER_PASSWORD";
+
+static const char UsageText[] =
+    "Usage: password-manager-cli <command> <vault> [options]\n"
+    "\n"
+    "Commands:\n"
+    "  unlock <vault>                 Check the master password\n"
+    "  get <vault> <id|title>         Print an entry's password, or --field\n"
+    "  search <vault> <query>         List matching entries, best first\n"
+    "  add <vault> --title <title>    Add an entry; its password, and its notes\n"
+    "                                 with --with-notes, are read like the\n"
+    "                                 master password\n"
+    "  import <vault> <file>          Import a CSV, Bitwarden or KeePass export\n"
+    "  export <vault> <file>          Export to an encrypted, CSV or JSON file\n"
+    "  retune <vault>                 Benchmark this machine and re-key the vault\n"
+    "                                 so unlocking takes about --target ms\n"
+    "\n"
+    "The master password is taken from PM_MASTER_PASSWORD, or prompted for.\n";
+
+// arguments starts with the command, standing in for the program name
+static bool parseOptions(QCommandLineParser &parser, const QStringList &arguments,
+                         int positionalCount, QString *error) {
+    parser.setSingleDashWordOptionMode(QCommandLineParser::ParseAsLongOptions);
+    if (!parser.parse(arguments)) {
+        *error = parser.errorText();
+        return false;
+    }
+    if (parser.positionalArguments().size() != positionalCount) {
+        *error = "Wrong number of arguments.";
+        return false;
+    }
+    return true;
+}
+
+VaultCli::VaultCli()
+    : m_database(new Database()),
+      m_out(stdout),
+      m_err(stderr) {
+}
+
+VaultCli::~VaultCli() {
+    // Not fill(), which would detach from a shared buffer and wipe a copy
+    SecureMemory::wipe(const_cast<char*>(m_masterKey.constData()), m_masterKey.size());
+    delete m_database;
+}
+
+int VaultCli::run(const QStringList &arguments) {
+    if (arguments.size() < 2) {
+        return usage();
+    }
+
+    // The parsers expect the program name first; the command takes its place
+    const QString command = arguments.at(1);
+    QStringList commandArguments = arguments.mid(1);
+
+    if (command == "unlock") return unlockCommand(commandArguments);
+    if (command == "get") return getCommand(commandArguments);
+    if (command == "search") return searchCommand(commandArguments);
+    if (command == "add") return addCommand(commandArguments);
+    if (command == "import") return importCommand(commandArguments);
+    if (command == "export") return exportCommand(commandArguments);
+    if (command == "retune") return retuneCommand(commandArguments);
+    if (command == "help" || command == "--help" || command == "-h") {
+        m_out << UsageText;
+        return Success;
+    }
+
+    return usage(QString("Unknown command '%1'.").arg(command));
+}
+
+int VaultCli::unlockCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QString error;
+    if (!parseOptions(parser, arguments, 1, &error)) {
+        return usage(error);
+    }
+
+    if (!unlock(parser.positionalArguments().at(0))) {
+        return Failure;
+    }
+
+    m_out << "Unlocked, " << m_database->entryCount() << " entries.\n";
+    return Success;
+}
+
+int VaultCli::getCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QCommandLineOption fieldOption("field", "password, username, url, notes or all.",
+                                   "field", "password");
+    parser.addOption(fieldOption);
+    QString error;
+    if (!parseOptions(parser, arguments, 2, &error)) {
+        return usage(error);
+    }
+
+    const QString field = parser.value(fieldOption);
+    static const QStringList fields = { "password", "username", "url", "notes", "all" };
+    if (!fields.contains(field)) {
+        return usage(QString("Unknown field '%1'.").arg(field));
+    }
+
+    PasswordEntry entry;
+    if (!unlock(parser.positionalArguments().at(0)) ||
+        !findEntry(parser.positionalArguments().at(1), entry)) {
+        return Failure;
+    }
+
+    if (field == "all") {
+        m_out << "Id: " << entry.id() << "\n"
+              << "Title: " << entry.title() << "\n"
+              << "Username: " << entry.username() << "\n"
+              << "Password: " << entry.password().view() << "\n"
+              << "Url: " << entry.url() << "\n"
+              << "Notes: " << entry.notes().view() << "\n"
+              << "Modified: " << entry.modified().toString(Qt::ISODate) << "\n";
+    } else if (field == "password") {
+        m_out << entry.password().view() << "\n";
+    } else if (field == "username") {
+        m_out << entry.username() << "\n";
+    } else if (field == "url") {
+        m_out << entry.url() << "\n";
+    } else {
+        m_out << entry.notes().view() << "\n";
+    }
+    return Success;
+}
+
+int VaultCli::searchCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QString error;
+    if (!parseOptions(parser, arguments, 2, &error)) {
+        return usage(error);
+    }
+
+    if (!unlock(parser.positionalArguments().at(0))) {
+        return Failure;
+    }
+
+    // Summaries carry every field the matcher looks at
+    EntryStore store;
+    QHash<int, int> rowOfEntry;
+    {
+        const QList<PasswordEntry> entries = m_database->getEntrySummaries(m_masterKey);
+        store.reserve(entries.size());
+        rowOfEntry.reserve(entries.size());
+        for (const PasswordEntry &entry : entries) {
+            rowOfEntry.insert(entry.id(), store.size());
+            store.append(entry);
+        }
+    }
+
+    FuzzyMatcher matcher;
+    matcher.setEntries(store);
+
+    // One tab-separated line per match: id, title, username, url
+    for (const FuzzyMatcher::Match &match : matcher.match(parser.positionalArguments().at(1))) {
+        const int row = rowOfEntry.value(match.entryId);
+        m_out << store.id(row) << '\t' << store.title(row) << '\t'
+              << store.username(row) << '\t' << store.url(row) << '\n';
+    }
+    return Success;
+}
+
+int VaultCli::addCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QCommandLineOption titleOption("title", "Entry title.", "title");
+    QCommandLineOption usernameOption("username", "Entry username.", "username");
+    QCommandLineOption urlOption("url", "Entry url.", "url");
+    // Notes are sealed like the password, so they are read like it too
+    QCommandLineOption notesOption("with-notes", "Also read one line of entry notes.");
+    parser.addOptions({ titleOption, usernameOption, urlOption, notesOption });
+    QString error;
+    if (!parseOptions(parser, arguments, 1, &error)) {
+        return usage(error);
+    }
+    if (parser.value(titleOption).isEmpty()) {
+        return usage("add needs a --title.");
+    }
+
+    if (!unlock(parser.positionalArguments().at(0))) {
+        return Failure;
+    }
+
+    QString password = readSecret("Entry password: ");
+    if (password.isEmpty()) {
+        printError("No entry password given.");
+        return Failure;
+    }
+    QString notes = parser.isSet(notesOption) ? readSecret("Entry notes: ") : QString();
+
+    QDateTime now = QDateTime::currentDateTime();
+    PasswordEntry entry(0, parser.value(titleOption), parser.value(usernameOption),
+                        password, parser.value(urlOption), notes, now, now);
+    password.fill(QChar(0));
+    notes.fill(QChar(0));
+
+    if (!m_database->addEntry(entry, m_masterKey)) {
+        printError("Failed to add the entry.");
+        return Failure;
+    }
+
+    m_out << entry.id() << "\n";
+    return Success;
+}
+
+int VaultCli::importCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QCommandLineOption formatOption("format", "csv, bitwarden or keepass; "
+                                    "by default taken from the file name.", "format");
+    parser.addOption(formatOption);
+    QString error;
+    if (!parseOptions(parser, arguments, 2, &error)) {
+        return usage(error);
+    }
+
+    const QString path = parser.positionalArguments().at(1);
+    EntryReader::Format format = EntryReader::formatForFile(path);
+    if (parser.isSet(formatOption)) {
+        const QString name = parser.value(formatOption);
+        if (name == "csv") {
+            format = EntryReader::CsvFormat;
+        } else if (name == "bitwarden") {
+            format = EntryReader::BitwardenJsonFormat;
+        } else if (name == "keepass") {
+            format = EntryReader::KeePassXmlFormat;
+        } else {
+            return usage(QString("Unknown import format '%1'.").arg(name));
+        }
+    }
+
+    if (!unlock(parser.positionalArguments().at(0))) {
+        return Failure;
+    }
+
+    // The same chunked pipeline as the GUI, driven by a local event loop
+    ImportService service;
+    QEventLoop loop;
+    int result = Failure;
+    QObject::connect(&service, &ImportService::finished, &loop,
+        [&](int imported, const QList<EntryReader::RowError> &errors) {
+            for (const EntryReader::RowError &rowError : errors) {
+                m_err << "Skipped row " << rowError.row << ": " << rowError.message << "\n";
+            }
+            m_out << "Imported " << imported << " entries.\n";
+            result = Success;
+            loop.quit();
+        });
+    QObject::connect(&service, &ImportService::failed, &loop,
+        [&](const QString &message, int imported) {
+            printError(QString("%1 (%2 entries were imported)").arg(message).arg(imported));
+            loop.quit();
+        });
+
+    service.start(m_database, m_masterKey, path, format);
+    if (service.isRunning()) {
+        loop.exec();
+    }
+    return result;
+}
+
+int VaultCli::exportCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QCommandLineOption formatOption("format", "encrypted, csv or json; "
+                                    "by default taken from the file name.", "format");
+    parser.addOption(formatOption);
+    QString error;
+    if (!parseOptions(parser, arguments, 2, &error)) {
+        return usage(error);
+    }
+
+    const QString path = parser.positionalArguments().at(1);
+    VaultExporter::Format format = VaultExporter::formatForFile(path);
+    if (parser.isSet(formatOption)) {
+        const QString name = parser.value(formatOption);
+        if (name == "encrypted") {
+            format = VaultExporter::EncryptedFormat;
+        } else if (name == "csv") {
+            format = VaultExporter::CsvFormat;
+        } else if (name == "json") {
+            format = VaultExporter::JsonFormat;
+        } else {
+            return usage(QString("Unknown export format '%1'.").arg(name));
+        }
+    }
+
+    if (!unlock(parser.positionalArguments().at(0))) {
+        return Failure;
+    }
+
+    QString exportPassword;
+    if (format == VaultExporter::EncryptedFormat) {
+        exportPassword = readSecret("Export password: ");
+        if (exportPassword.isEmpty()) {
+            printError("The encrypted format needs an export password.");
+            return Failure;
+        }
+    }
+
+    VaultExporter exporter(m_database, m_masterKey);
+    bool ok = exporter.exportTo(path, format, exportPassword);
+    exportPassword.fill(QChar(0));
+
+    if (!ok) {
+        printError(exporter.errorString());
+        return Failure;
+    }
+
+    m_out << "Exported " << exporter.exportedCount() << " entries.\n";
+    return Success;
+}
+
+int VaultCli::retuneCommand(const QStringList &arguments) {
+    QCommandLineParser parser;
+    QCommandLineOption targetOption("target", "Unlock time to aim for, in ms.", "ms",
+                                    QString::number(KdfHeader::DefaultTargetMilliseconds));
+    parser.addOption(targetOption);
+    QString error;
+    if (!parseOptions(parser, arguments, 1, &error)) {
+        return usage(error);
+    }
+
+    bool ok = false;
+    const int target = parser.value(targetOption).toInt(&ok);
+    if (!ok || target <= 0) {
+        return usage("--target needs a positive number of milliseconds.");
+    }
+
+    QString masterPassword;
+    if (!unlock(parser.positionalArguments().at(0), &masterPassword)) {
+        return Failure;
+    }
+
+    // Rewraps the master key; the entries themselves are not touched
+    KdfHeader header = KdfHeader::forMasterKey(masterPassword, m_masterKey, target);
+    masterPassword.fill(QChar(0));
+    if (!header.isValid() || !m_database->setKdfHeader(header)) {
+        printError("Failed to update the key derivation settings.");
+        return Failure;
+    }
+
+    if (header.algorithm() == KdfHeader::Argon2id) {
+        m_out << "Argon2id, " << header.iterations() << " passes over "
+              << header.memoryCost() / 1024 << " MiB.\n";
+    } else {
+        m_out << "PBKDF2-HMAC-SHA256, " << header.iterations() << " iterations.\n";
+    }
+    return Success;
+}
+
+int VaultCli::usage(const QString &message) {
+    if (!message.isEmpty()) {
+        m_err << message << "\n\n";
+    }
+    m_err << UsageText;
+    m_err.flush();
+    return UsageError;
+}
+
+bool VaultCli::unlock(const QString &vaultPath, QString *masterPasswordOut) {
+    // Opening a missing file would create an empty vault
+    if (!QFileInfo(vaultPath).isFile()) {
+        printError(QString("No vault at %1.").arg(vaultPath));
+        return false;
+    }
+    if (!m_database->open(vaultPath)) {
+        printError(QString("Failed to open vault at %1.").arg(vaultPath));
+        return false;
+    }
+    KdfHeader header = m_database->getKdfHeader();
+    if (!header.isValid()) {
+        printError("The vault has not been initialized with a master password.");
+        return false;
+    }
+
+    QString masterPassword = qEnvironmentVariable(MasterPasswordVariable);
+    if (masterPassword.isEmpty()) {
+        masterPassword = readSecret("Master password: ");
+    }
+
+    // Vaults from before KDF headers are checked against their old hash
+    // first, then get a key check like any other
+    const bool legacy = !header.hasKeyCheck();
+    bool verified = !legacy || m_database->verifyUser(Encryption::hashPassword(masterPassword));
+    if (verified) {
+        bool rejected = false;
+        m_masterKey = header.unlock(masterPassword, &rejected);
+        verified = !rejected;
+    }
+    if (masterPasswordOut && verified && !m_masterKey.isEmpty()) {
+        *masterPasswordOut = masterPassword;
+    }
+    masterPassword.fill(QChar(0));
+
+    if (!verified) {
+        printError("Incorrect master password.");
+        return false;
+    }
+    if (m_masterKey.isEmpty()) {
+        printError("Failed to derive the master key.");
+        return false;
+    }
+    if (legacy && !(header.setKey(m_masterKey) && m_database->setKdfHeader(header))) {
+        printError("Warning: failed to store the vault's key check.");
+    }
+
+    QString error;
+    if (m_database->hasLegacyEntries() && !m_database->migrateLegacyEntries(m_masterKey, &error)) {
+        printError(error);
+        return false;
+    }
+    return true;
+}
+
+bool VaultCli::findEntry(const QString &key, PasswordEntry &entry) {
+    bool isId = false;
+    int id = key.toInt(&isId);
+
+    if (!isId) {
+        // A title has to name exactly one entry
+        QList<int> ids;
+        for (const PasswordEntry &summary : m_database->getEntrySummaries(m_masterKey)) {
+            if (summary.title().compare(key, Qt::CaseInsensitive) == 0) {
+                ids.append(summary.id());
+            }
+        }
+        if (ids.size() > 1) {
+            QStringList idList;
+            for (int match : ids) {
+                idList.append(QString::number(match));
+            }
+            printError(QString("Several entries are titled '%1' (ids %2); give an id.")
+                           .arg(key, idList.join(", ")));
+            return false;
+        }
+        id = ids.isEmpty() ? 0 : ids.first();
+    }
+
+    entry = id > 0 ? m_database->getEntry(id, m_masterKey) : PasswordEntry();
+    if (entry.id() <= 0) {
+        printError(QString("No entry '%1'.").arg(key));
+        return false;
+    }
+    return true;
+}
+
+QString VaultCli::readSecret(const QString &prompt) {
+    // Read through stdio: a QTextStream on stdin would buffer ahead and take
+    // in the next secret along with this one
+#ifdef Q_OS_WIN
+    const bool terminal = _isatty(_fileno(stdin));
+#else
+    const bool terminal = isatty(fileno(stdin));
+#endif
+
+    if (terminal) {
+        m_err << prompt;
+        m_err.flush();
+    }
+
+#ifdef Q_OS_WIN
+    HANDLE console = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD consoleMode = 0;
+    if (terminal) {
+        GetConsoleMode(console, &consoleMode);
+        SetConsoleMode(console, consoleMode & ~ENABLE_ECHO_INPUT);
+    }
+#else
+    struct termios terminalMode;
+    if (terminal) {
+        tcgetattr(fileno(stdin), &terminalMode);
+        struct termios silent = terminalMode;
+        silent.c_lflag &= ~ECHO;
+        tcsetattr(fileno(stdin), TCSAFLUSH, &silent);
+    }
+#endif
+
+    QByteArray line;
+    int c;
+    while ((c = std::fgetc(stdin)) != EOF && c != '\n') {
+        line.append(char(c));
+    }
+    if (line.endsWith('\r')) {
+        line.chop(1);
+    }
+
+#ifdef Q_OS_WIN
+    if (terminal) {
+        SetConsoleMode(console, consoleMode);
+    }
+#else
+    if (terminal) {
+        tcsetattr(fileno(stdin), TCSAFLUSH, &terminalMode);
+    }
+#endif
+    if (terminal) {
+        m_err << "\n";
+        m_err.flush();
+    }
+
+    QString secret = QString::fromUtf8(line);
+    line.fill(0);
+    return secret;
+}
+
+void VaultCli::printError(const QString &message) {
+    m_err << "Error: " << message << "\n";
+    m_err.flush();
+}
@@ -0,0 +1,58 @@
+#ifndef VAULTCLI_H
+#define VAULTCLI_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QTextStream>
+#include "../storage/database.h"
+#include "../models/passwordentry.h"
+
+// Subcommands of password-manager-cli. Each opens and unlocks the vault named
+// by its first argument, does one thing and returns the process exit code.
+//
+// Secrets never go on the command line, where other users can read them.
+// The master password comes from PM_MASTER_PASSWORD if that is set; other
+// secrets, and the master password otherwise, are prompted for without echo
+// on a terminal, or read one per line from stdin when it is not one.
+class VaultCli {
+public:
+    enum ExitCode {
+        Success = 0,
+        Failure = 1,
+        UsageError = 2
+    };
+
+    VaultCli();
+    ~VaultCli();
+
+    VaultCli(const VaultCli &) = delete;
+    VaultCli &operator=(const VaultCli &) = delete;
+
+    // arguments as given to the program, its name first
+    int run(const QStringList &arguments);
+
+private:
+    int unlockCommand(const QStringList &arguments);
+    int getCommand(const QStringList &arguments);
+    int searchCommand(const QStringList &arguments);
+    int addCommand(const QStringList &arguments);
+    int importCommand(const QStringList &arguments);
+    int exportCommand(const QStringList &arguments);
+    int retuneCommand(const QStringList &arguments);
+    int usage(const QString &message = QString());
+
+    // masterPasswordOut, if given, receives the verified master password;
+    // the caller wipes it
+    bool unlock(const QString &vaultPath, QString *masterPasswordOut = nullptr);
+    bool findEntry(const QString &key, PasswordEntry &entry);
+    QString readSecret(const QString &prompt);
+    void printError(const QString &message);
+
+    Database *m_database;
+    QByteArray m_masterKey;
+    QTextStream m_out;
+    QTextStream m_err;
+};
+
+#endif
@@ -2,8 +2,16 @@
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
+#include <openssl/hmac.h>
 #include <openssl/err.h>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+#include <openssl/kdf.h>
+#endif
 #include <QDebug>
+#include <cstring>
+#include <utility>
 
 bool Encryption::initialize() {
     return true;
@@ -15,17 +23,168 @@ QByteArray Encryption::generateSalt() {
     return salt;
 }
 
+QByteArray Encryption::generateKey() {
+    QByteArray key(32, 0);
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(key.data()), key.size()) != 1) {
+        return QByteArray();
+    }
+    return key;
+}
+
+QByteArray Encryption::deriveSubkey(const QByteArray &key, const QByteArray &label) {
+    QByteArray subkey(32, 0);
+    unsigned int length = 0;
+    
+    if (!HMAC(EVP_sha256(), key.constData(), key.size(),
+              reinterpret_cast<const unsigned char*>(label.constData()), label.size(),
+              reinterpret_cast<unsigned char*>(subkey.data()), &length) || length != 32) {
+        return QByteArray();
+    }
+    
+    return subkey;
+}
+
 QByteArray Encryption::deriveMasterKey(const QString &masterPassword, 
                                        const QByteArray &salt) {
-    QByteArray key(32, 0);
-    QByteArray passwordBytes = masterPassword.toUtf8();
+    return deriveMasterKey(masterPassword, salt, KeyDerivationIterations);
+}
+
+QByteArray Encryption::deriveMasterKey(const QString &masterPassword,
+                                       const QByteArray &salt, int iterations,
+                                       const ProgressCallback &progress) {
+    if (iterations < 1) {
+        return QByteArray();
+    }
     
-    PKCS5_PBKDF2_HMAC(passwordBytes.constData(), passwordBytes.size(),
-                      reinterpret_cast<const unsigned char*>(salt.constData()),
-                      salt.size(), 100000, EVP_sha256(),
-                      key.size(), reinterpret_cast<unsigned char*>(key.data()));
+    if (!progress) {
+        QByteArray key(32, 0);
+        QByteArray passwordBytes = masterPassword.toUtf8();
+        
+        bool ok = PKCS5_PBKDF2_HMAC(passwordBytes.constData(), passwordBytes.size(),
+                                    reinterpret_cast<const unsigned char*>(salt.constData()),
+                                    salt.size(), iterations, EVP_sha256(),
+                                    key.size(), reinterpret_cast<unsigned char*>(key.data())) == 1;
+        OPENSSL_cleanse(passwordBytes.data(), passwordBytes.size());
+        return ok ? key : QByteArray();
+    }
     
+    // PBKDF2-HMAC-SHA256 computed by hand so the work can be reported and
+    // interrupted. Produces exactly the same key as PKCS5_PBKDF2_HMAC.
+    const int reportInterval = 1000;
+
+    QByteArray passwordBytes = masterPassword.toUtf8();
+    QByteArray key(32, 0);
+
+    EVP_MAC *mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    EVP_MAC_CTX *ctx = mac ? EVP_MAC_CTX_new(mac) : nullptr;
+    if (!ctx) {
+        EVP_MAC_free(mac);
+        return QByteArray();
+    }
+
+    char digestName[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digestName, 0),
+        OSSL_PARAM_construct_end()
+    };
+
+    // The key is only 32 bytes, so a single PBKDF2 block (index 1) is needed
+    const unsigned char blockIndex[4] = {0, 0, 0, 1};
+    unsigned char u[32];
+    unsigned char *t = reinterpret_cast<unsigned char*>(key.data());
+    size_t outLen = 0;
+    bool ok = EVP_MAC_init(ctx, reinterpret_cast<const unsigned char*>(passwordBytes.constData()),
+                           passwordBytes.size(), params) == 1
+        && EVP_MAC_update(ctx, reinterpret_cast<const unsigned char*>(salt.constData()),
+                          salt.size()) == 1
+        && EVP_MAC_update(ctx, blockIndex, sizeof(blockIndex)) == 1
+        && EVP_MAC_final(ctx, u, &outLen, sizeof(u)) == 1;
+    memcpy(t, u, sizeof(u));
+
+    for (int i = 1; ok && i < iterations; ++i) {
+        // Re-initialising without a key reuses the precomputed HMAC pads
+        ok = EVP_MAC_init(ctx, nullptr, 0, nullptr) == 1
+            && EVP_MAC_update(ctx, u, sizeof(u)) == 1
+            && EVP_MAC_final(ctx, u, &outLen, sizeof(u)) == 1;
+        for (size_t j = 0; j < sizeof(u); ++j) {
+            t[j] ^= u[j];
+        }
+
+        if (progress && (i + 1) % reportInterval == 0 && !progress(i + 1, iterations)) {
+            ok = false;
+        }
+    }
+
+    OPENSSL_cleanse(u, sizeof(u));
+    OPENSSL_cleanse(passwordBytes.data(), passwordBytes.size());
+    EVP_MAC_CTX_free(ctx);
+    EVP_MAC_free(mac);
+
+    if (!ok) {
+        key.fill(0);
+        return QByteArray();
+    }
+
+    return key;
+}
+
+bool Encryption::hasArgon2id() {
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+    static const bool available = []() {
+        EVP_KDF *kdf = EVP_KDF_fetch(nullptr, "ARGON2ID", nullptr);
+        EVP_KDF_free(kdf);
+        return kdf != nullptr;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+QByteArray Encryption::deriveArgon2idKey(const QString &masterPassword, const QByteArray &salt,
+                                         quint32 iterations, quint32 memoryCost, quint32 lanes) {
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+    EVP_KDF *kdf = EVP_KDF_fetch(nullptr, "ARGON2ID", nullptr);
+    EVP_KDF_CTX *ctx = kdf ? EVP_KDF_CTX_new(kdf) : nullptr;
+    EVP_KDF_free(kdf);
+    if (!ctx) {
+        return QByteArray();
+    }
+
+    QByteArray passwordBytes = masterPassword.toUtf8();
+    QByteArray saltBytes = salt;
+    uint32_t threads = 1;
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_PASSWORD, passwordBytes.data(),
+                                          size_t(passwordBytes.size())),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, saltBytes.data(),
+                                          size_t(saltBytes.size())),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ITER, &iterations),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ARGON2_MEMCOST, &memoryCost),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ARGON2_LANES, &lanes),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_THREADS, &threads),
+        OSSL_PARAM_construct_end()
+    };
+
+    QByteArray key(32, 0);
+    bool ok = EVP_KDF_derive(ctx, reinterpret_cast<unsigned char*>(key.data()),
+                             size_t(key.size()), params) == 1;
+    OPENSSL_cleanse(passwordBytes.data(), passwordBytes.size());
+    EVP_KDF_CTX_free(ctx);
+
+    if (!ok) {
+        key.fill(0);
+        return QByteArray();
+    }
     return key;
+#else
+    Q_UNUSED(masterPassword);
+    Q_UNUSED(salt);
+    Q_UNUSED(iterations);
+    Q_UNUSED(memoryCost);
+    Q_UNUSED(lanes);
+    return QByteArray();
+#endif
 }
 
 QByteArray Encryption::encrypt(const QByteArray &data, const QByteArray &key) {
@@ -68,47 +227,251 @@ QByteArray Encryption::encrypt(const QByteArray &data, const QByteArray &key) {
     return iv + encrypted;
 }
 
-QByteArray Encryption::decrypt(const QByteArray &encryptedData, 
-                               const QByteArray &key) {
-    if (encryptedData.size() < 16) return QByteArray();
+bool Encryption::decrypt(const QByteArray &encryptedData, const QByteArray &key,
+                         SecureBuffer &plaintext) {
+    plaintext.clear();
+    if (encryptedData.size() < 16) return false;
 
-    QByteArray iv = encryptedData.left(16);
-    QByteArray ciphertext = encryptedData.mid(16);
+    const unsigned char *iv = reinterpret_cast<const unsigned char*>(encryptedData.constData());
+    const unsigned char *ciphertext = iv + 16;
+    const int ciphertextSize = encryptedData.size() - 16;
 
     EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) return QByteArray();
-
-    QByteArray decrypted;
-    decrypted.resize(ciphertext.size());
+    if (!ctx) return false;
 
+    // CBC padding only ever shrinks the output, so the ciphertext size is
+    // enough; a block of room is kept for DecryptUpdate's lookahead
+    SecureBuffer decrypted(ciphertextSize + 16);
+    unsigned char *out = reinterpret_cast<unsigned char*>(decrypted.data());
     int len = 0, plaintext_len = 0;
 
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr,
-                          reinterpret_cast<const unsigned char*>(key.constData()),
-                          reinterpret_cast<const unsigned char*>(iv.constData())) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        return QByteArray();
+    bool ok = EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr,
+                                 reinterpret_cast<const unsigned char*>(key.constData()), iv) == 1
+        && EVP_DecryptUpdate(ctx, out, &len, ciphertext, ciphertextSize) == 1;
+    plaintext_len = len;
+    ok = ok && EVP_DecryptFinal_ex(ctx, out + plaintext_len, &len) == 1;
+    plaintext_len += len;
+
+    EVP_CIPHER_CTX_free(ctx);
+    if (!ok) return false;
+
+    decrypted.truncate(plaintext_len);
+    plaintext = std::move(decrypted);
+    return true;
+}
+
+QByteArray Encryption::seal(const QByteArray &plaintext, const QByteArray &key,
+                            const QByteArray &associatedData) {
+    return Session(key).seal(plaintext, associatedData);
+}
+
+QByteArray Encryption::open(const QByteArray &sealedData, const QByteArray &key,
+                            const QByteArray &associatedData, bool *ok) {
+    return Session(key).open(sealedData, associatedData, ok);
+}
+
+// ========== Session Implementation ==========
+
+static const int GcmNonceSize = 12;
+static const int GcmTagSize = 16;
+
+Encryption::Session::Session(const QByteArray &key)
+    : m_key(key) {
+    // Detach so wiping our copy never touches the caller's buffer
+    m_key.detach();
+}
+
+Encryption::Session::~Session() {
+    for (Contexts *contexts : m_pool) {
+        // Freeing a context cleanses the expanded key schedule
+        EVP_CIPHER_CTX_free(contexts->encrypt);
+        EVP_CIPHER_CTX_free(contexts->decrypt);
+        delete contexts;
     }
+    m_pool.clear();
+    
+    OPENSSL_cleanse(m_key.data(), m_key.size());
+}
 
-    if (EVP_DecryptUpdate(ctx, reinterpret_cast<unsigned char*>(decrypted.data()),
-                         &len, reinterpret_cast<const unsigned char*>(ciphertext.constData()),
-                         ciphertext.size()) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        return QByteArray();
+bool Encryption::Session::hasKey(const QByteArray &key) const {
+    return key.size() == m_key.size()
+        && CRYPTO_memcmp(key.constData(), m_key.constData(), m_key.size()) == 0;
+}
+
+Encryption::Session::Contexts *Encryption::Session::acquire() const {
+    {
+        QMutexLocker locker(&m_poolMutex);
+        if (!m_pool.isEmpty()) {
+            return m_pool.takeLast();
+        }
     }
-    plaintext_len = len;
+    
+    if (!isValid()) return nullptr;
+    
+    const unsigned char *key = reinterpret_cast<const unsigned char*>(m_key.constData());
+    Contexts *contexts = new Contexts{EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_new()};
+    
+    // Expand the key schedule now; later calls only supply a nonce
+    if (!contexts->encrypt || !contexts->decrypt ||
+        EVP_EncryptInit_ex(contexts->encrypt, EVP_aes_256_gcm(), nullptr, key, nullptr) != 1 ||
+        EVP_DecryptInit_ex(contexts->decrypt, EVP_aes_256_gcm(), nullptr, key, nullptr) != 1) {
+        EVP_CIPHER_CTX_free(contexts->encrypt);
+        EVP_CIPHER_CTX_free(contexts->decrypt);
+        delete contexts;
+        return nullptr;
+    }
+    
+    return contexts;
+}
 
-    if (EVP_DecryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(decrypted.data()) + len,
-                           &len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
+void Encryption::Session::release(Contexts *contexts) const {
+    if (!contexts) return;
+    
+    QMutexLocker locker(&m_poolMutex);
+    m_pool.append(contexts);
+}
+
+QByteArray Encryption::Session::seal(const QByteArray &plaintext, 
+                                     const QByteArray &associatedData) const {
+    Contexts *contexts = acquire();
+    if (!contexts) return QByteArray();
+    
+    QByteArray sealed = sealWith(contexts, plaintext, associatedData);
+    release(contexts);
+    return sealed;
+}
+
+QByteArray Encryption::Session::open(const QByteArray &sealedData, 
+                                     const QByteArray &associatedData, bool *ok) const {
+    if (ok) *ok = false;
+    
+    const qsizetype size = openedSize(sealedData);
+    Contexts *contexts = size >= 0 ? acquire() : nullptr;
+    if (!contexts) return QByteArray();
+    
+    QByteArray plaintext(size, 0);
+    bool opened = openWith(contexts, sealedData, associatedData, plaintext.data());
+    release(contexts);
+    
+    if (!opened) {
+        OPENSSL_cleanse(plaintext.data(), plaintext.size());
         return QByteArray();
     }
-    plaintext_len += len;
+    if (ok) *ok = true;
+    return plaintext;
+}
 
-    EVP_CIPHER_CTX_free(ctx);
-    decrypted.resize(plaintext_len);
+bool Encryption::Session::open(const QByteArray &sealedData, const QByteArray &associatedData,
+                               SecureBuffer &plaintext) const {
+    plaintext.clear();
+    
+    const qsizetype size = openedSize(sealedData);
+    Contexts *contexts = size >= 0 ? acquire() : nullptr;
+    if (!contexts) return false;
+    
+    SecureBuffer opened(size);
+    bool ok = openWith(contexts, sealedData, associatedData, opened.data());
+    release(contexts);
+    
+    if (ok) {
+        plaintext = std::move(opened);
+    }
+    return ok;
+}
+
+QList<QByteArray> Encryption::Session::sealBatch(const QList<QByteArray> &plaintexts,
+                                                 const QList<QByteArray> &associatedData) const {
+    QList<QByteArray> sealed;
+    if (plaintexts.size() != associatedData.size()) return sealed;
+    
+    Contexts *contexts = acquire();
+    sealed.reserve(plaintexts.size());
+    for (qsizetype i = 0; i < plaintexts.size(); ++i) {
+        sealed.append(contexts ? sealWith(contexts, plaintexts[i], associatedData[i])
+                               : QByteArray());
+    }
+    release(contexts);
+    
+    return sealed;
+}
+
+QList<SecureBuffer> Encryption::Session::openBatch(const QList<QByteArray> &sealedData,
+                                                   const QList<QByteArray> &associatedData,
+                                                   QList<bool> *ok) const {
+    QList<SecureBuffer> plaintexts;
+    if (ok) ok->clear();
+    if (sealedData.size() != associatedData.size()) return plaintexts;
+    
+    Contexts *contexts = acquire();
+    plaintexts.resize(sealedData.size());
+    if (ok) ok->reserve(sealedData.size());
+    for (qsizetype i = 0; i < sealedData.size(); ++i) {
+        const qsizetype size = openedSize(sealedData[i]);
+        bool opened = false;
+        if (contexts && size >= 0) {
+            SecureBuffer plaintext(size);
+            opened = openWith(contexts, sealedData[i], associatedData[i], plaintext.data());
+            if (opened) {
+                plaintexts[i] = std::move(plaintext);
+            }
+        }
+        if (ok) ok->append(opened);
+    }
+    release(contexts);
+    
+    return plaintexts;
+}
 
-    return decrypted;
+QByteArray Encryption::Session::sealWith(Contexts *contexts, const QByteArray &plaintext,
+                                         const QByteArray &associatedData) {
+    EVP_CIPHER_CTX *ctx = contexts->encrypt;
+    
+    QByteArray sealed(GcmNonceSize + plaintext.size() + GcmTagSize, 0);
+    unsigned char *nonce = reinterpret_cast<unsigned char*>(sealed.data());
+    unsigned char *ciphertext = nonce + GcmNonceSize;
+    if (RAND_bytes(nonce, GcmNonceSize) != 1) return QByteArray();
+    
+    int len = 0;
+    bool ok = EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1
+        && EVP_EncryptUpdate(ctx, nullptr, &len,
+                             reinterpret_cast<const unsigned char*>(associatedData.constData()),
+                             associatedData.size()) == 1
+        && EVP_EncryptUpdate(ctx, ciphertext, &len,
+                             reinterpret_cast<const unsigned char*>(plaintext.constData()),
+                             plaintext.size()) == 1
+        && EVP_EncryptFinal_ex(ctx, ciphertext + len, &len) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, GcmTagSize,
+                               ciphertext + plaintext.size()) == 1;
+    
+    return ok ? sealed : QByteArray();
+}
+
+qsizetype Encryption::Session::openedSize(const QByteArray &sealedData) {
+    return sealedData.size() < GcmNonceSize + GcmTagSize 
+        ? -1 : sealedData.size() - GcmNonceSize - GcmTagSize;
+}
+
+bool Encryption::Session::openWith(Contexts *contexts, const QByteArray &sealedData,
+                                   const QByteArray &associatedData, char *plaintext) {
+    const qsizetype ciphertextSize = openedSize(sealedData);
+    if (ciphertextSize < 0) return false;
+    
+    EVP_CIPHER_CTX *ctx = contexts->decrypt;
+    const unsigned char *nonce = reinterpret_cast<const unsigned char*>(sealedData.constData());
+    const unsigned char *ciphertext = nonce + GcmNonceSize;
+    // A null output would make the update below count as associated data
+    unsigned char empty = 0;
+    unsigned char *out = plaintext ? reinterpret_cast<unsigned char*>(plaintext) : &empty;
+    
+    int len = 0;
+    return EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1
+        && EVP_DecryptUpdate(ctx, nullptr, &len,
+                             reinterpret_cast<const unsigned char*>(associatedData.constData()),
+                             associatedData.size()) == 1
+        && EVP_DecryptUpdate(ctx, out, &len, ciphertext, int(ciphertextSize)) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GcmTagSize,
+                               const_cast<unsigned char*>(ciphertext + ciphertextSize)) == 1
+        && EVP_DecryptFinal_ex(ctx, out + len, &len) == 1;
 }
 
 QString Encryption::hashPassword(const QString &password) {
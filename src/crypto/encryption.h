@@ -3,16 +3,110 @@
 
 #include <QString>
 #include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <functional>
+#include "securestring.h"
+
+struct evp_cipher_ctx_st;
 
 class Encryption {
 public:
+    // Keyed AES-256-GCM cipher. The key schedule is expanded once per cipher
+    // context and contexts are pooled, so sealing or opening many records with
+    // the same master key only pays for the nonce setup. Safe to share between
+    // threads: each concurrent caller borrows its own context.
+    class Session {
+    public:
+        explicit Session(const QByteArray &key);
+        ~Session();
+
+        Session(const Session &) = delete;
+        Session &operator=(const Session &) = delete;
+
+        bool isValid() const { return m_key.size() == 32; }
+        bool hasKey(const QByteArray &key) const;
+
+        QByteArray seal(const QByteArray &plaintext, const QByteArray &associatedData) const;
+        QByteArray open(const QByteArray &sealedData, const QByteArray &associatedData,
+                        bool *ok = nullptr) const;
+        // Decrypts straight into the secure arena, for plaintext that holds
+        // secrets. plaintext is left empty on failure.
+        bool open(const QByteArray &sealedData, const QByteArray &associatedData,
+                  SecureBuffer &plaintext) const;
+
+        // Batch variants borrow one context for the whole batch. The associated
+        // data list must match the input list in length; failed entries come
+        // back empty and are flagged in ok when provided. Opened plaintext
+        // goes into the secure arena.
+        QList<QByteArray> sealBatch(const QList<QByteArray> &plaintexts,
+                                    const QList<QByteArray> &associatedData) const;
+        QList<SecureBuffer> openBatch(const QList<QByteArray> &sealedData,
+                                      const QList<QByteArray> &associatedData,
+                                      QList<bool> *ok = nullptr) const;
+
+    private:
+        struct Contexts {
+            evp_cipher_ctx_st *encrypt;
+            evp_cipher_ctx_st *decrypt;
+        };
+
+        Contexts *acquire() const;
+        void release(Contexts *contexts) const;
+        static QByteArray sealWith(Contexts *contexts, const QByteArray &plaintext,
+                                   const QByteArray &associatedData);
+        // Size of the plaintext inside sealedData, -1 if it is too short
+        static qsizetype openedSize(const QByteArray &sealedData);
+        // plaintext must have room for openedSize(sealedData) bytes
+        static bool openWith(Contexts *contexts, const QByteArray &sealedData,
+                             const QByteArray &associatedData, char *plaintext);
+
+        QByteArray m_key;
+        mutable QMutex m_poolMutex;
+        mutable QList<Contexts*> m_pool;
+    };
+
+    static constexpr int KeyDerivationIterations = 100000;
+
+    // Called periodically during key derivation with the number of completed
+    // iterations. Returning false aborts the derivation.
+    using ProgressCallback = std::function<bool(int completed, int total)>;
+
     static bool initialize();
     static QByteArray deriveMasterKey(const QString &masterPassword, 
                                       const QByteArray &salt);
+    // PBKDF2-HMAC-SHA256 with a given iteration count, see KdfHeader
+    static QByteArray deriveMasterKey(const QString &masterPassword,
+                                      const QByteArray &salt, int iterations,
+                                      const ProgressCallback &progress = ProgressCallback());
+    // Argon2id, which OpenSSL provides from 3.2 on. memoryCost is in KiB.
+    // Always single-threaded, so the time it takes does not depend on how
+    // busy the machine is; lanes still fixes the result. Empty if OpenSSL
+    // has no Argon2id or the derivation failed.
+    static bool hasArgon2id();
+    static QByteArray deriveArgon2idKey(const QString &masterPassword, const QByteArray &salt,
+                                        quint32 iterations, quint32 memoryCost, quint32 lanes);
     static QByteArray generateSalt();
+    // 32 random bytes, or empty if the random generator failed
+    static QByteArray generateKey();
+    // HMAC-SHA256(key, label): an independent 32-byte key for one purpose,
+    // so that material derived from the master key never reuses it directly
+    static QByteArray deriveSubkey(const QByteArray &key, const QByteArray &label);
     static QByteArray encrypt(const QByteArray &data, const QByteArray &key);
-    static QByteArray decrypt(const QByteArray &encryptedData, 
-                             const QByteArray &key);
+    // Legacy AES-256-CBC fields; plaintext is left empty on failure
+    static bool decrypt(const QByteArray &encryptedData, const QByteArray &key,
+                        SecureBuffer &plaintext);
+
+    // AES-256-GCM authenticated encryption. The sealed form is
+    // nonce (12 bytes) || ciphertext || tag (16 bytes); opening fails if the
+    // data or the associated data were tampered with. For repeated use of the
+    // same key prefer a Session.
+    static QByteArray seal(const QByteArray &plaintext, const QByteArray &key,
+                           const QByteArray &associatedData);
+    static QByteArray open(const QByteArray &sealedData, const QByteArray &key,
+                           const QByteArray &associatedData, bool *ok = nullptr);
+    // Unsalted SHA-256 kept by vaults from before KdfHeader; only checked
+    // until their first unlock replaces it with a key check
     static QString hashPassword(const QString &password);
     static bool verifyPassword(const QString &password, const QString &hash);
 };
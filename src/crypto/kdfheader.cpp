@@ -0,0 +1,284 @@
+#include "kdfheader.h"
+#include "securememory.h"
+#include <QtEndian>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <openssl/crypto.h>
+#include <limits>
+
+// version, algorithm, three u32 cost fields and the salt length
+static const int FixedFieldsSize = 1 + 1 + 3 * 4 + 1;
+
+// Subkey label, and associated data, of the wrapped master key
+static const char WrappedKeyLabel[] = "password-manager vault key v1";
+
+// Calibration never goes below these, however slow the machine. The PBKDF2
+// floor is the fixed count vaults used before calibration.
+static const quint32 MinPbkdf2Iterations = Encryption::KeyDerivationIterations;
+static const quint32 MinArgon2Iterations = 2;
+static const quint32 MinArgon2MemoryCost = 19 * 1024;       // KiB
+static const quint32 MaxArgon2MemoryCost = 64 * 1024;       // KiB
+static const quint32 Argon2Lanes = 4;
+
+// A benchmark repeats with twice the work until a run takes this long, so
+// that timer resolution and start-up costs do not skew the rate
+static const qint64 MinBenchmarkNanoseconds = 100 * 1000 * 1000;
+
+static quint32 calibratePbkdf2(qint64 targetNanoseconds) {
+    const QByteArray salt = Encryption::generateSalt();
+    quint32 iterations = 10000;
+    qint64 elapsed = 0;
+    QElapsedTimer timer;
+    for (;;) {
+        timer.start();
+        Encryption::deriveMasterKey(QStringLiteral("calibration"), salt, int(iterations));
+        elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+        if (elapsed >= MinBenchmarkNanoseconds || iterations >= (1u << 30)) break;
+        iterations *= 2;
+    }
+
+    qint64 target = qint64(iterations) * targetNanoseconds / elapsed;
+    return quint32(qBound<qint64>(MinPbkdf2Iterations, target,
+                                  std::numeric_limits<int>::max()));
+}
+
+// Argon2id's memory cost is what makes it expensive to attack, so calibration
+// keeps as much of it as the target allows and spends the rest on passes
+static bool calibrateArgon2id(qint64 targetNanoseconds, quint32 *iterations,
+                              quint32 *memoryCost) {
+    const QByteArray salt = Encryption::generateSalt();
+    quint32 memory = MaxArgon2MemoryCost;
+    qint64 elapsed = 0;
+    QElapsedTimer timer;
+    for (;;) {
+        timer.start();
+        QByteArray key = Encryption::deriveArgon2idKey(QStringLiteral("calibration"), salt,
+                                                       1, memory, Argon2Lanes);
+        elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+        if (key.isEmpty()) {
+            return false;
+        }
+        if (elapsed * MinArgon2Iterations <= targetNanoseconds || memory == MinArgon2MemoryCost) {
+            break;
+        }
+        // The last step lands on the floor itself rather than stopping
+        // above it
+        memory = qMax(memory / 2, MinArgon2MemoryCost);
+    }
+
+    *iterations = quint32(qBound<qint64>(MinArgon2Iterations, targetNanoseconds / elapsed, 1024));
+    *memoryCost = memory;
+    return true;
+}
+
+KdfHeader KdfHeader::create(Algorithm algorithm, quint32 iterations,
+                            quint32 memoryCost, quint32 parallelism) {
+    KdfHeader header;
+    header.m_algorithm = quint8(algorithm);
+    header.m_iterations = iterations;
+    header.m_memoryCost = memoryCost;
+    header.m_parallelism = parallelism;
+    header.m_salt = Encryption::generateSalt();
+    return header;
+}
+
+KdfHeader KdfHeader::calibrate(int targetMilliseconds) {
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 target = qint64(qMax(targetMilliseconds, 1)) * 1000 * 1000;
+
+    KdfHeader header;
+    quint32 iterations = 0;
+    quint32 memoryCost = 0;
+    if (Encryption::hasArgon2id() && calibrateArgon2id(target, &iterations, &memoryCost)) {
+        header = create(Argon2id, iterations, memoryCost, Argon2Lanes);
+    } else {
+        header = create(Pbkdf2Sha256, calibratePbkdf2(target));
+    }
+
+    qDebug() << "Calibrated key derivation in" << timer.elapsed() << "ms: algorithm"
+             << header.m_algorithm << "iterations" << header.m_iterations
+             << "memory" << header.m_memoryCost << "KiB";
+    return header;
+}
+
+KdfHeader KdfHeader::forMasterKey(const QString &password, const QByteArray &masterKey,
+                                  int targetMilliseconds) {
+    KdfHeader header = calibrate(targetMilliseconds);
+    QByteArray derivedKey = header.deriveKey(password);
+    bool wrapped = header.wrapKey(derivedKey, masterKey);
+    SecureMemory::wipe(derivedKey.data(), derivedKey.size());
+    return wrapped ? header : KdfHeader();
+}
+
+KdfHeader KdfHeader::legacy(const QByteArray &salt) {
+    KdfHeader header;
+    header.m_algorithm = Pbkdf2Sha256;
+    header.m_iterations = Encryption::KeyDerivationIterations;
+    header.m_salt = salt;
+    return header;
+}
+
+KdfHeader KdfHeader::fromByteArray(const QByteArray &data) {
+    const quint8 version = data.isEmpty() ? 0 : quint8(data[0]);
+    if (data.size() < FixedFieldsSize || version < 1 || version > Version) {
+        return KdfHeader();
+    }
+
+    const char *fields = data.constData();
+    KdfHeader header;
+    header.m_algorithm = quint8(fields[1]);
+    header.m_iterations = qFromBigEndian<quint32>(fields + 2);
+    header.m_memoryCost = qFromBigEndian<quint32>(fields + 6);
+    header.m_parallelism = qFromBigEndian<quint32>(fields + 10);
+
+    const int saltSize = quint8(fields[14]);
+    int size = FixedFieldsSize + saltSize + KeyCheckSize;
+    if (data.size() < size || saltSize == 0) {
+        return KdfHeader();
+    }
+    header.m_salt = data.mid(FixedFieldsSize, saltSize);
+    header.m_keyCheck = data.mid(size - KeyCheckSize, KeyCheckSize);
+
+    if (version >= 2) {
+        const int wrappedSize = data.size() > size ? quint8(data[size]) : -1;
+        if (wrappedSize < 0 || data.size() < size + 1 + wrappedSize) {
+            return KdfHeader();
+        }
+        header.m_wrappedKey = data.mid(size + 1, wrappedSize);
+        size += 1 + wrappedSize;
+    }
+    if (data.size() != size) {
+        return KdfHeader();
+    }
+
+    bool supported = header.m_iterations > 0 &&
+        (header.m_algorithm == Pbkdf2Sha256 ||
+         (header.m_algorithm == Argon2id && header.m_parallelism > 0 &&
+          header.m_memoryCost >= 8 * header.m_parallelism));
+    if (!supported) {
+        qWarning() << "Unsupported key derivation settings, algorithm" << header.m_algorithm;
+        return KdfHeader();
+    }
+    return header;
+}
+
+QByteArray KdfHeader::toByteArray() const {
+    if (!isValid() || !hasKeyCheck() || m_salt.size() > 255 || m_wrappedKey.size() > 255) {
+        return QByteArray();
+    }
+
+    QByteArray data(FixedFieldsSize, 0);
+    char *fields = data.data();
+    fields[0] = char(Version);
+    fields[1] = char(m_algorithm);
+    qToBigEndian<quint32>(m_iterations, fields + 2);
+    qToBigEndian<quint32>(m_memoryCost, fields + 6);
+    qToBigEndian<quint32>(m_parallelism, fields + 10);
+    fields[14] = char(m_salt.size());
+    data.append(m_salt);
+    data.append(m_keyCheck);
+    data.append(char(m_wrappedKey.size()));
+    data.append(m_wrappedKey);
+    return data;
+}
+
+QByteArray KdfHeader::deriveKey(const QString &password,
+                                const Encryption::ProgressCallback &progress) const {
+    if (!isValid()) {
+        return QByteArray();
+    }
+
+    if (algorithm() == Pbkdf2Sha256) {
+        return Encryption::deriveMasterKey(password, m_salt, int(m_iterations), progress);
+    }
+
+    if (!Encryption::hasArgon2id()) {
+        qWarning() << "The vault uses Argon2id, which this build of OpenSSL does not provide";
+        return QByteArray();
+    }
+    QByteArray key = Encryption::deriveArgon2idKey(password, m_salt, m_iterations,
+                                                   m_memoryCost, m_parallelism);
+    if (progress && !key.isEmpty() && !progress(int(m_iterations), int(m_iterations))) {
+        SecureMemory::wipe(key.data(), key.size());
+        return QByteArray();
+    }
+    return key;
+}
+
+bool KdfHeader::checkKey(const QByteArray &derivedKey) const {
+    if (!hasKeyCheck()) {
+        return false;
+    }
+
+    QByteArray keyCheck = keyCheckOf(derivedKey);
+    return keyCheck.size() == KeyCheckSize
+        && CRYPTO_memcmp(keyCheck.constData(), m_keyCheck.constData(), KeyCheckSize) == 0;
+}
+
+QByteArray KdfHeader::masterKey(const QByteArray &derivedKey) const {
+    if (!wrapsKey()) {
+        return derivedKey;
+    }
+
+    bool ok = false;
+    QByteArray wrappingKey = Encryption::deriveSubkey(derivedKey, QByteArray(WrappedKeyLabel));
+    QByteArray key = Encryption::open(m_wrappedKey, wrappingKey,
+                                      QByteArray(WrappedKeyLabel), &ok);
+    SecureMemory::wipe(wrappingKey.data(), wrappingKey.size());
+    return ok && key.size() == 32 ? key : QByteArray();
+}
+
+QByteArray KdfHeader::unlock(const QString &password, bool *rejected) const {
+    if (rejected) *rejected = false;
+
+    QByteArray derivedKey = deriveKey(password);
+    if (derivedKey.isEmpty()) {
+        return QByteArray();
+    }
+    if (hasKeyCheck() && !checkKey(derivedKey)) {
+        SecureMemory::wipe(derivedKey.data(), derivedKey.size());
+        if (rejected) *rejected = true;
+        return QByteArray();
+    }
+
+    QByteArray key = masterKey(derivedKey);
+    if (wrapsKey()) {
+        SecureMemory::wipe(derivedKey.data(), derivedKey.size());
+    }
+    return key;
+}
+
+bool KdfHeader::setKey(const QByteArray &derivedKey) {
+    QByteArray keyCheck = keyCheckOf(derivedKey);
+    if (keyCheck.size() != KeyCheckSize) {
+        return false;
+    }
+    m_keyCheck = keyCheck;
+    m_wrappedKey.clear();
+    return true;
+}
+
+bool KdfHeader::wrapKey(const QByteArray &derivedKey, const QByteArray &masterKey) {
+    QByteArray keyCheck = keyCheckOf(derivedKey);
+    if (keyCheck.size() != KeyCheckSize || masterKey.size() != 32) {
+        return false;
+    }
+
+    QByteArray wrappingKey = Encryption::deriveSubkey(derivedKey, QByteArray(WrappedKeyLabel));
+    QByteArray wrapped = Encryption::seal(masterKey, wrappingKey, QByteArray(WrappedKeyLabel));
+    SecureMemory::wipe(wrappingKey.data(), wrappingKey.size());
+    if (wrapped.isEmpty()) {
+        return false;
+    }
+    m_keyCheck = keyCheck;
+    m_wrappedKey = wrapped;
+    return true;
+}
+
+QByteArray KdfHeader::keyCheckOf(const QByteArray &key) {
+    if (key.size() != 32) {
+        return QByteArray();
+    }
+    return Encryption::deriveSubkey(key, QByteArrayLiteral("key-check"));
+}
@@ -0,0 +1,102 @@
+#ifndef KDFHEADER_H
+#define KDFHEADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include "encryption.h"
+
+// How a vault's master key is derived from its master password, stored with
+// the vault:
+//
+//   header = version (u8) || algorithm (u8) || iterations (u32 BE)
+//            || memory cost in KiB (u32 BE) || parallelism (u32 BE)
+//            || salt length (u8) || salt || key check (32)
+//            || wrapped key length (u8) || wrapped key        (version 2)
+//
+// The key check is HMAC-SHA256(derived key, "key-check"): it comes from the
+// same KDF pass that yields the key, so unlocking derives once and compares
+// in constant time, and it reveals nothing about the key itself.
+//
+// Without a wrapped key the derived key is the master key. With one, the
+// master key is sealed under a subkey of the derived key, so the cost can be
+// retuned without touching a single record.
+//
+// Vaults from before the header only have a salt and an unsalted hash of
+// the password; legacy() describes their derivation, without a key check.
+class KdfHeader {
+public:
+    enum Algorithm {
+        Pbkdf2Sha256 = 1,
+        Argon2id = 2
+    };
+
+    static constexpr int Version = 2;
+    static constexpr int KeyCheckSize = 32;
+    // What calibration aims for on the machine it runs on
+    static constexpr int DefaultTargetMilliseconds = 500;
+
+    // Invalid until created, parsed or made legacy
+    KdfHeader() = default;
+
+    // A fresh salt and the given cost; the key is set with setKey() or
+    // wrapKey()
+    static KdfHeader create(Algorithm algorithm, quint32 iterations,
+                            quint32 memoryCost = 0, quint32 parallelism = 0);
+    // Benchmarks this machine and picks the cost that takes about
+    // targetMilliseconds to derive a key: Argon2id where OpenSSL provides
+    // it, PBKDF2 otherwise. The cost never drops below fixed floors, and
+    // the benchmark itself takes a few hundred milliseconds.
+    static KdfHeader calibrate(int targetMilliseconds = DefaultTargetMilliseconds);
+    // A calibrated header under which password opens masterKey. Invalid if
+    // deriving or wrapping failed.
+    static KdfHeader forMasterKey(const QString &password, const QByteArray &masterKey,
+                                  int targetMilliseconds = DefaultTargetMilliseconds);
+    static KdfHeader legacy(const QByteArray &salt);
+    // Returns an invalid header for malformed data or an unknown version
+    static KdfHeader fromByteArray(const QByteArray &data);
+    QByteArray toByteArray() const;
+
+    bool isValid() const { return m_algorithm != 0 && !m_salt.isEmpty(); }
+    bool hasKeyCheck() const { return m_keyCheck.size() == KeyCheckSize; }
+    bool wrapsKey() const { return !m_wrappedKey.isEmpty(); }
+
+    Algorithm algorithm() const { return Algorithm(m_algorithm); }
+    quint32 iterations() const { return m_iterations; }
+    quint32 memoryCost() const { return m_memoryCost; }      // KiB
+    quint32 parallelism() const { return m_parallelism; }
+    const QByteArray &salt() const { return m_salt; }
+
+    // One pass of the KDF; empty on failure or when progress aborts it.
+    // Progress counts up to iterations(); Argon2id only reports completion
+    // and cannot be aborted part way. The result still has to be checked
+    // and turned into the master key.
+    QByteArray deriveKey(const QString &password,
+                         const Encryption::ProgressCallback &progress = Encryption::ProgressCallback()) const;
+    // Constant time; false if the header has no key check
+    bool checkKey(const QByteArray &derivedKey) const;
+    // The master key a checked derived key opens; empty on failure
+    QByteArray masterKey(const QByteArray &derivedKey) const;
+    // deriveKey(), checkKey() and masterKey() in one. rejected tells a wrong
+    // password from a failure. A legacy header cannot tell, so check the
+    // vault's old password hash first.
+    QByteArray unlock(const QString &password, bool *rejected = nullptr) const;
+
+    // Records the key check of a derived key that is the master key
+    bool setKey(const QByteArray &derivedKey);
+    // Records the key check of derivedKey and seals masterKey under it
+    bool wrapKey(const QByteArray &derivedKey, const QByteArray &masterKey);
+
+private:
+    static QByteArray keyCheckOf(const QByteArray &key);
+
+    quint8 m_algorithm = 0;
+    quint32 m_iterations = 0;
+    quint32 m_memoryCost = 0;
+    quint32 m_parallelism = 0;
+    QByteArray m_salt;
+    QByteArray m_keyCheck;
+    QByteArray m_wrappedKey;
+};
+
+#endif
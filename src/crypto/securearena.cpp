@@ -0,0 +1,142 @@
+#include "securearena.h"
+#include "securememory.h"
+#include <QtGlobal>
+#include <QDebug>
+#include <QMutexLocker>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+SecureArena &SecureArena::instance() {
+    // Never destroyed: secrets held by other static objects may be released
+    // after static destructors have started running
+    static SecureArena *arena = new SecureArena();
+    return *arena;
+}
+
+void *SecureArena::allocate(size_t size) {
+    if (size == 0) return nullptr;
+    const size_t rounded = roundUp(size, Alignment);
+
+    QMutexLocker locker(&m_mutex);
+
+    Block *block = nullptr;
+    if (rounded > BlockSize) {
+        // Kept out of the way of the block being filled
+        block = mapBlock(rounded);
+        if (!block) return nullptr;
+        m_blocks.prepend(block);
+    } else {
+        block = m_blocks.isEmpty() ? nullptr : m_blocks.last();
+        if (!block || block->capacity - block->used < rounded) {
+            block = mapBlock(BlockSize);
+            if (!block) return nullptr;
+            m_blocks.append(block);
+        }
+    }
+
+    void *data = block->base + block->used;
+    block->used += rounded;
+    ++block->live;
+    m_bytesInUse += rounded;
+    ++m_allocationCount;
+    return data;
+}
+
+void SecureArena::release(void *data, size_t size) {
+    if (!data) return;
+    const size_t rounded = roundUp(size, Alignment);
+    SecureMemory::wipe(data, rounded);
+
+    QMutexLocker locker(&m_mutex);
+
+    char *address = static_cast<char*>(data);
+    for (qsizetype i = 0; i < m_blocks.size(); ++i) {
+        Block *block = m_blocks[i];
+        if (address < block->base || address >= block->base + block->capacity) {
+            continue;
+        }
+
+        m_bytesInUse -= rounded;
+        if (--block->live > 0) {
+            return;
+        }
+
+        if (i == m_blocks.size() - 1 && block->capacity == BlockSize) {
+            // Every allocation was wiped on release, so it is clean to reuse
+            block->used = 0;
+        } else {
+            m_blocks.removeAt(i);
+            unmapBlock(block);
+        }
+        return;
+    }
+
+    qWarning() << "SecureArena: released memory it did not allocate";
+}
+
+size_t SecureArena::blockCount() const {
+    QMutexLocker locker(&m_mutex);
+    return size_t(m_blocks.size());
+}
+
+size_t SecureArena::bytesInUse() const {
+    QMutexLocker locker(&m_mutex);
+    return m_bytesInUse;
+}
+
+size_t SecureArena::allocationCount() const {
+    QMutexLocker locker(&m_mutex);
+    return m_allocationCount;
+}
+
+SecureArena::Block *SecureArena::mapBlock(size_t capacity) {
+#ifdef Q_OS_WIN
+    static const size_t pageSize = []() {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return size_t(info.dwPageSize);
+    }();
+    capacity = roundUp(capacity, pageSize);
+    void *base = VirtualAlloc(nullptr, capacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!base) {
+        qWarning() << "SecureArena: could not map" << capacity << "bytes";
+        return nullptr;
+    }
+#else
+    static const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    capacity = roundUp(capacity, pageSize);
+    void *base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        qWarning() << "SecureArena: could not map" << capacity << "bytes";
+        return nullptr;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(base, capacity, MADV_DONTDUMP);
+#endif
+#endif
+
+    // One lock for the whole block; best effort as for LockedAllocator
+    SecureMemory::lockPages(base, capacity);
+    return new Block{ static_cast<char*>(base), capacity, 0, 0 };
+}
+
+void SecureArena::unmapBlock(Block *block) {
+    // Unmapping also unlocks the pages
+#ifdef Q_OS_WIN
+    VirtualUnlock(block->base, block->capacity);
+    VirtualFree(block->base, 0, MEM_RELEASE);
+#else
+    munmap(block->base, block->capacity);
+#endif
+    delete block;
+}
+
+size_t SecureArena::roundUp(size_t size, size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
@@ -0,0 +1,62 @@
+#ifndef SECUREARENA_H
+#define SECUREARENA_H
+
+#include <cstddef>
+#include <QList>
+#include <QMutex>
+
+// Process-wide pool of locked memory for plaintext secrets. Memory is mapped
+// in BlockSize blocks, each locked into RAM and excluded from core dumps once
+// when it is mapped; allocations are then carved off the current block by
+// bumping an offset, so a secret costs no system call of its own.
+//
+// Released allocations are wiped straight away. Their space is reused only
+// once every allocation in the block has been released: the block currently
+// being filled starts over, any other block is unmapped. Secrets are small
+// and short-lived, so blocks drain quickly in practice.
+//
+// Thread safe; decryption fills it from the thread pool.
+class SecureArena {
+public:
+    static constexpr size_t BlockSize = 64 * 1024;
+    static constexpr size_t Alignment = 16;
+
+    static SecureArena &instance();
+
+    // Returns nullptr only if no memory could be mapped. Allocations larger
+    // than a block get a block of their own.
+    void *allocate(size_t size);
+    // size must be the one given to allocate
+    void release(void *data, size_t size);
+
+    size_t blockCount() const;
+    size_t bytesInUse() const;
+    // Allocations made since startup; the difference across a load or a copy
+    // tells how many secrets it duplicated
+    size_t allocationCount() const;
+
+    SecureArena(const SecureArena &) = delete;
+    SecureArena &operator=(const SecureArena &) = delete;
+
+private:
+    struct Block {
+        char *base;
+        size_t capacity;
+        size_t used;        // Bump offset
+        size_t live;        // Allocations not released yet
+    };
+
+    SecureArena() = default;
+
+    static Block *mapBlock(size_t capacity);
+    static void unmapBlock(Block *block);
+    static size_t roundUp(size_t size, size_t multiple);
+
+    mutable QMutex m_mutex;
+    // The last block is the one allocations are bumped from
+    QList<Block*> m_blocks;
+    size_t m_bytesInUse = 0;
+    size_t m_allocationCount = 0;
+};
+
+#endif
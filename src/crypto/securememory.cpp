@@ -0,0 +1,42 @@
+#include "securememory.h"
+#include <QtGlobal>
+#include <QDebug>
+#include <openssl/crypto.h>
+#include <atomic>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdint>
+#endif
+
+bool SecureMemory::lockPages(void *data, size_t size) {
+    if (!data || size == 0) return true;
+    
+#ifdef Q_OS_WIN
+    bool locked = VirtualLock(data, size) != 0;
+#else
+    // POSIX allows mlock to insist on a page-aligned start
+    static const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~(pageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(data) + size;
+    bool locked = mlock(reinterpret_cast<void*>(start), end - start) == 0;
+#endif
+    
+    if (!locked) {
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true)) {
+            qWarning() << "Could not lock memory pages; plaintext may be swapped to disk";
+        }
+    }
+    
+    return locked;
+}
+
+void SecureMemory::wipe(void *data, size_t size) {
+    if (data && size > 0) {
+        OPENSSL_cleanse(data, size);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef SECUREMEMORY_H
+#define SECUREMEMORY_H
+
+#include <cstddef>
+#include <new>
+
+// Helpers for memory that holds plaintext derived from the vault
+class SecureMemory {
+public:
+    // Pins the pages spanning [data, data + size) in RAM so they are never
+    // written to swap. Best effort: failures (usually RLIMIT_MEMLOCK) are
+    // reported once and otherwise ignored.
+    static bool lockPages(void *data, size_t size);
+    static void wipe(void *data, size_t size);
+};
+
+// Standard allocator for containers holding vault plaintext. Allocations are
+// locked into RAM and wiped before they are returned to the heap. Pages are
+// not unlocked on release because neighbouring allocations may share them.
+template <typename T>
+class LockedAllocator {
+public:
+    using value_type = T;
+
+    LockedAllocator() noexcept = default;
+    template <typename U>
+    LockedAllocator(const LockedAllocator<U> &) noexcept {}
+
+    T *allocate(size_t count) {
+        void *data = ::operator new(count * sizeof(T));
+        SecureMemory::lockPages(data, count * sizeof(T));
+        return static_cast<T*>(data);
+    }
+
+    void deallocate(T *data, size_t count) noexcept {
+        SecureMemory::wipe(data, count * sizeof(T));
+        ::operator delete(data);
+    }
+
+    template <typename U>
+    bool operator==(const LockedAllocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const LockedAllocator<U> &) const noexcept { return false; }
+};
+
+#endif
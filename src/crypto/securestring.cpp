@@ -0,0 +1,148 @@
+#include "securestring.h"
+#include "securearena.h"
+#include <QStringDecoder>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Like operator new, running out of memory is not recoverable here
+static void *allocateSecure(size_t size) {
+    void *data = SecureArena::instance().allocate(size);
+    if (!data && size > 0) {
+        throw std::bad_alloc();
+    }
+    return data;
+}
+
+// ========== SecureBuffer ==========
+
+SecureBuffer::SecureBuffer(qsizetype size) {
+    if (size > 0) {
+        // Arena memory is zeroed: fresh pages are, and released ones are wiped
+        m_data = static_cast<char*>(allocateSecure(size_t(size)));
+        m_size = size;
+        m_capacity = size;
+    }
+}
+
+SecureBuffer::SecureBuffer(const SecureBuffer &other) : SecureBuffer(other.m_size) {
+    if (m_size > 0) {
+        std::memcpy(m_data, other.m_data, size_t(m_size));
+    }
+}
+
+SecureBuffer::SecureBuffer(SecureBuffer &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_capacity(std::exchange(other.m_capacity, 0)) {
+}
+
+SecureBuffer &SecureBuffer::operator=(const SecureBuffer &other) {
+    if (this != &other) {
+        SecureBuffer copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+SecureBuffer &SecureBuffer::operator=(SecureBuffer &&other) noexcept {
+    if (this != &other) {
+        clear();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_capacity = std::exchange(other.m_capacity, 0);
+    }
+    return *this;
+}
+
+SecureBuffer::~SecureBuffer() {
+    clear();
+}
+
+void SecureBuffer::truncate(qsizetype size) {
+    if (size >= 0 && size < m_size) {
+        std::memset(m_data + size, 0, size_t(m_size - size));
+        m_size = size;
+    }
+}
+
+void SecureBuffer::clear() {
+    SecureArena::instance().release(m_data, size_t(m_capacity));
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+// ========== SecureString ==========
+
+SecureString::SecureString(QStringView text) {
+    assign(text);
+}
+
+SecureString::SecureString(const SecureString &other) {
+    assign(other.view());
+}
+
+SecureString::SecureString(SecureString &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_capacity(std::exchange(other.m_capacity, 0)) {
+}
+
+SecureString &SecureString::operator=(const SecureString &other) {
+    if (this != &other) {
+        SecureString copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+SecureString &SecureString::operator=(SecureString &&other) noexcept {
+    if (this != &other) {
+        clear();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_capacity = std::exchange(other.m_capacity, 0);
+    }
+    return *this;
+}
+
+SecureString::~SecureString() {
+    clear();
+}
+
+SecureString SecureString::fromUtf8(const char *data, qsizetype size) {
+    SecureString text;
+    if (size <= 0) {
+        return text;
+    }
+
+    // Each byte decodes to at most one UTF-16 unit, plus any state the
+    // decoder carries
+    QStringDecoder decoder(QStringDecoder::Utf8);
+    text.m_capacity = decoder.requiredSpace(size);
+    text.m_data = static_cast<char16_t*>(allocateSecure(size_t(text.m_capacity) * sizeof(char16_t)));
+
+    QChar *begin = reinterpret_cast<QChar*>(text.m_data);
+    QChar *end = decoder.appendToBuffer(begin, QByteArrayView(data, size));
+    text.m_size = end - begin;
+    return text;
+}
+
+void SecureString::clear() {
+    SecureArena::instance().release(m_data, size_t(m_capacity) * sizeof(char16_t));
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+void SecureString::assign(QStringView text) {
+    if (text.isEmpty()) {
+        return;
+    }
+
+    m_data = static_cast<char16_t*>(allocateSecure(size_t(text.size()) * sizeof(char16_t)));
+    std::memcpy(m_data, text.utf16(), size_t(text.size()) * sizeof(char16_t));
+    m_size = text.size();
+    m_capacity = text.size();
+}
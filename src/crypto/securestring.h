@@ -0,0 +1,75 @@
+#ifndef SECURESTRING_H
+#define SECURESTRING_H
+
+#include <QString>
+#include <QStringView>
+#include <QByteArrayView>
+
+// Bytes held in the SecureArena, wiped when released. Decryption writes its
+// plaintext straight into one of these rather than into a QByteArray.
+class SecureBuffer {
+public:
+    SecureBuffer() noexcept = default;
+    // size zeroed bytes
+    explicit SecureBuffer(qsizetype size);
+    SecureBuffer(const SecureBuffer &other);
+    SecureBuffer(SecureBuffer &&other) noexcept;
+    SecureBuffer &operator=(const SecureBuffer &other);
+    SecureBuffer &operator=(SecureBuffer &&other) noexcept;
+    ~SecureBuffer();
+
+    bool isEmpty() const { return m_size == 0; }
+    qsizetype size() const { return m_size; }
+    char *data() { return m_data; }
+    const char *constData() const { return m_data; }
+    QByteArrayView view() const { return QByteArrayView(m_data, m_size); }
+
+    // Shrinks in place, wiping the bytes cut off
+    void truncate(qsizetype size);
+    void clear();
+
+private:
+    char *m_data = nullptr;
+    qsizetype m_size = 0;
+    qsizetype m_capacity = 0;
+};
+
+// Immutable UTF-16 text held in the SecureArena, for the secret fields of an
+// entry. Copies get their own arena allocation; every allocation is wiped
+// when released.
+//
+// Widgets, the clipboard and JSON only take QString, and toString() makes
+// that plain heap copy; keep it in as narrow a scope as possible. view()
+// reaches the text without copying.
+class SecureString {
+public:
+    SecureString() noexcept = default;
+    SecureString(QStringView text);
+    SecureString(const QString &text) : SecureString(QStringView(text)) {}
+    SecureString(const SecureString &other);
+    SecureString(SecureString &&other) noexcept;
+    SecureString &operator=(const SecureString &other);
+    SecureString &operator=(SecureString &&other) noexcept;
+    ~SecureString();
+
+    // Decodes straight into the arena, with no intermediate QString
+    static SecureString fromUtf8(const char *data, qsizetype size);
+
+    bool isEmpty() const { return m_size == 0; }
+    qsizetype size() const { return m_size; }
+    QStringView view() const { return QStringView(m_data, m_size); }
+    QString toString() const { return view().toString(); }
+    void clear();
+
+    bool operator==(const SecureString &other) const { return view() == other.view(); }
+    bool operator!=(const SecureString &other) const { return view() != other.view(); }
+
+private:
+    void assign(QStringView text);
+
+    char16_t *m_data = nullptr;
+    qsizetype m_size = 0;
+    qsizetype m_capacity = 0;   // In characters, as allocated
+};
+
+#endif
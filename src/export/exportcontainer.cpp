@@ -0,0 +1,150 @@
+#include "exportcontainer.h"
+#include "../crypto/securememory.h"
+#include <QtEndian>
+
+static const char ContainerMagic[] = "PMEXPORT";
+static const int ContainerMagicSize = 8;
+static const quint8 ContainerVersion = 1;
+static const int ContainerSaltSize = 16;
+static const int ContainerHeaderSize = ContainerMagicSize + 1 + 4 + ContainerSaltSize;
+
+// Sealing adds the nonce and tag; anything much larger than the exporter's
+// chunk size is a corrupt length field, not a chunk
+static const quint32 MaxSealedChunkSize = 16 * 1024 * 1024;
+
+ExportContainer::ExportContainer(QIODevice *device)
+    : m_device(device),
+      m_session(nullptr),
+      m_nextChunk(0),
+      m_finished(false) {}
+
+ExportContainer::~ExportContainer() {
+    delete m_session;
+}
+
+bool ExportContainer::begin(const QString &password) {
+    QByteArray salt = Encryption::generateSalt();
+    QByteArray key = Encryption::deriveMasterKey(password, salt);
+    if (key.size() != 32) {
+        m_errorString = "Failed to derive the export key.";
+        return false;
+    }
+    
+    delete m_session;
+    m_session = new Encryption::Session(key);
+    SecureMemory::wipe(key.data(), key.size());
+    
+    m_header = QByteArray(ContainerMagic, ContainerMagicSize);
+    m_header.append(char(ContainerVersion));
+    char iterations[4];
+    qToBigEndian<quint32>(Encryption::KeyDerivationIterations, iterations);
+    m_header.append(iterations, 4);
+    m_header.append(salt);
+    
+    if (m_device->write(m_header) != m_header.size()) {
+        m_errorString = m_device->errorString();
+        return false;
+    }
+    
+    m_nextChunk = 0;
+    m_finished = false;
+    return true;
+}
+
+bool ExportContainer::writeChunk(const QByteArray &plaintext, bool last) {
+    if (!m_session || m_finished) {
+        m_errorString = "The container is not open for writing.";
+        return false;
+    }
+    
+    QByteArray sealed = m_session->seal(plaintext, 
+                                        chunkAssociatedData(m_header, m_nextChunk, last));
+    if (sealed.isEmpty()) {
+        m_errorString = "Failed to encrypt export data.";
+        return false;
+    }
+    
+    char length[4];
+    qToBigEndian<quint32>(quint32(sealed.size()), length);
+    if (m_device->write(length, 4) != 4 || m_device->write(sealed) != sealed.size()) {
+        m_errorString = m_device->errorString();
+        return false;
+    }
+    
+    ++m_nextChunk;
+    m_finished = last;
+    return true;
+}
+
+bool ExportContainer::decrypt(QIODevice *input, const QString &password, QIODevice *output,
+                              QString *error) {
+    auto fail = [error](const QString &message) {
+        if (error) *error = message;
+        return false;
+    };
+    
+    QByteArray header = input->read(ContainerHeaderSize);
+    if (header.size() != ContainerHeaderSize || 
+        !header.startsWith(QByteArray(ContainerMagic, ContainerMagicSize))) {
+        return fail("Not an encrypted export file.");
+    }
+    if (quint8(header[ContainerMagicSize]) != ContainerVersion) {
+        return fail("Unsupported export file version.");
+    }
+    quint32 iterations = qFromBigEndian<quint32>(header.constData() + ContainerMagicSize + 1);
+    if (iterations != quint32(Encryption::KeyDerivationIterations)) {
+        return fail("Unsupported key derivation settings.");
+    }
+    
+    QByteArray key = Encryption::deriveMasterKey(password, header.right(ContainerSaltSize));
+    Encryption::Session session(key);
+    SecureMemory::wipe(key.data(), key.size());
+    
+    for (quint64 index = 0; ; ++index) {
+        QByteArray lengthBytes = input->read(4);
+        if (lengthBytes.size() != 4) {
+            return fail("The export file is truncated.");
+        }
+        quint32 length = qFromBigEndian<quint32>(lengthBytes.constData());
+        if (length > MaxSealedChunkSize) {
+            return fail("The export file is corrupt.");
+        }
+        QByteArray sealed = input->read(length);
+        if (sealed.size() != int(length)) {
+            return fail("The export file is truncated.");
+        }
+        
+        // Whether this chunk is the last one is only known by trying both
+        bool ok = false;
+        bool last = false;
+        QByteArray plaintext = session.open(sealed, chunkAssociatedData(header, index, false), &ok);
+        if (!ok) {
+            plaintext = session.open(sealed, chunkAssociatedData(header, index, true), &ok);
+            last = ok;
+        }
+        if (!ok) {
+            return fail(index == 0 ? "Wrong password or corrupt export file."
+                                   : "The export file is corrupt.");
+        }
+        
+        bool written = output->write(plaintext) == plaintext.size();
+        SecureMemory::wipe(plaintext.data(), plaintext.size());
+        if (!written) {
+            return fail(output->errorString());
+        }
+        
+        if (last) {
+            return true;
+        }
+    }
+}
+
+QByteArray ExportContainer::chunkAssociatedData(const QByteArray &header, quint64 index, 
+                                                bool last) {
+    QByteArray associatedData = header;
+    char indexBytes[8];
+    qToBigEndian<quint64>(index, indexBytes);
+    associatedData.append(indexBytes, 8);
+    associatedData.append(char(last ? 1 : 0));
+    return associatedData;
+}
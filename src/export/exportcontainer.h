@@ -0,0 +1,51 @@
+#ifndef EXPORTCONTAINER_H
+#define EXPORTCONTAINER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QIODevice>
+#include "../crypto/encryption.h"
+
+// Password-protected export file, written and read one chunk at a time:
+//
+//   header = magic "PMEXPORT" || version (u8) || iterations (u32 BE) || salt (16)
+//   chunk  = length (u32 BE) || Encryption::seal(plaintext, key, aad)
+//   aad    = header || chunk index (u64 BE) || last (u8)
+//
+// The key is PBKDF2-HMAC-SHA256 of the export password, independent of the
+// vault's master key. Binding the index and the last-chunk flag into every
+// chunk makes reordered, dropped or truncated chunks fail to open. The
+// plaintext stream is the JSON export, so a decrypted container can be
+// imported as Bitwarden JSON.
+class ExportContainer {
+public:
+    explicit ExportContainer(QIODevice *device);
+    ~ExportContainer();
+
+    ExportContainer(const ExportContainer &) = delete;
+    ExportContainer &operator=(const ExportContainer &) = delete;
+
+    // Derives the key and writes the header
+    bool begin(const QString &password);
+    // Every container ends with exactly one chunk marked last, which may be
+    // empty
+    bool writeChunk(const QByteArray &plaintext, bool last);
+
+    QString errorString() const { return m_errorString; }
+
+    // Streams the plaintext of a container from input to output
+    static bool decrypt(QIODevice *input, const QString &password, QIODevice *output,
+                        QString *error = nullptr);
+
+private:
+    static QByteArray chunkAssociatedData(const QByteArray &header, quint64 index, bool last);
+
+    QIODevice *m_device;
+    Encryption::Session *m_session;
+    QByteArray m_header;
+    quint64 m_nextChunk;
+    bool m_finished;
+    QString m_errorString;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "vaultexporter.h"
+#include "exportcontainer.h"
+#include "../crypto/securememory.h"
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDebug>
+
+static const char CsvHeader[] = "name,url,username,password,note\n";
+static const char JsonHeader[] = "{\"encrypted\":false,\"items\":[";
+static const char JsonFooter[] = "\n]}\n";
+
+VaultExporter::VaultExporter(Database *database, const QByteArray &masterKey)
+    : m_database(database),
+      m_masterKey(masterKey),
+      m_format(EncryptedFormat),
+      m_file(nullptr),
+      m_container(nullptr),
+      m_exported(0),
+      m_cancelled(false) {}
+
+VaultExporter::~VaultExporter() {
+    delete m_container;
+    delete m_file;
+    SecureMemory::wipe(m_buffer.data(), m_buffer.size());
+}
+
+VaultExporter::Format VaultExporter::formatForFile(const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "csv") {
+        return CsvFormat;
+    }
+    if (suffix == "json") {
+        return JsonFormat;
+    }
+    return EncryptedFormat;
+}
+
+bool VaultExporter::exportTo(const QString &path, Format format, const QString &password,
+                             const Encryption::ProgressCallback &progress) {
+    m_format = format;
+    m_exported = 0;
+    m_cancelled = false;
+    m_errorString.clear();
+    
+    delete m_container;
+    m_container = nullptr;
+    delete m_file;
+    m_file = new QSaveFile(path);
+    if (!m_file->open(QIODevice::WriteOnly)) {
+        m_errorString = m_file->errorString();
+        return false;
+    }
+    
+    if (m_format == EncryptedFormat) {
+        m_container = new ExportContainer(m_file);
+        if (!m_container->begin(password)) {
+            m_errorString = m_container->errorString();
+            m_file->cancelWriting();
+            return false;
+        }
+    }
+    
+    int total = m_database->entryCount();
+    // Slack for the entry that crosses the flush threshold, so the buffer
+    // is allocated once and never reallocated (which would leave a stale
+    // plaintext copy behind)
+    m_buffer.reserve(ChunkSize + 16 * 1024);
+    m_buffer.append(m_format == CsvFormat ? CsvHeader : JsonHeader);
+    
+    bool ok = true;
+    int skipped = 0;
+    bool completed = m_database->forEachEntry(m_masterKey, [&](const PasswordEntry &entry) {
+        appendEntry(entry);
+        ++m_exported;
+        
+        if (m_buffer.size() < ChunkSize) {
+            return true;
+        }
+        if (!flush(false)) {
+            ok = false;
+            return false;
+        }
+        if (progress && !progress(m_exported, total)) {
+            m_cancelled = true;
+            return false;
+        }
+        return true;
+    }, &skipped);
+    
+    if (ok && completed && skipped > 0) {
+        // A file missing entries would pass for a full copy of the vault
+        m_errorString = QString("%1 entries could not be decrypted, so the export "
+                                "would be incomplete.").arg(skipped);
+        ok = false;
+    } else if (ok && completed) {
+        if (m_format != CsvFormat) {
+            m_buffer.append(JsonFooter);
+        }
+        ok = flush(true);
+    } else if (ok && !m_cancelled) {
+        m_errorString = "Failed to read the vault.";
+        ok = false;
+    }
+    
+    SecureMemory::wipe(m_buffer.data(), m_buffer.size());
+    m_buffer.resize(0);
+    
+    if (!ok || m_cancelled) {
+        m_file->cancelWriting();
+        return false;
+    }
+    if (!m_file->commit()) {
+        m_errorString = m_file->errorString();
+        return false;
+    }
+    
+    if (progress) {
+        progress(m_exported, total);
+    }
+    qDebug() << "Exported" << m_exported << "entries to" << path;
+    return true;
+}
+
+void VaultExporter::appendEntry(const PasswordEntry &entry) {
+    if (m_format == CsvFormat) {
+        appendCsvField(entry.title());
+        m_buffer.append(',');
+        appendCsvField(entry.url());
+        m_buffer.append(',');
+        appendCsvField(entry.username());
+        m_buffer.append(',');
+        appendCsvField(entry.password().view());
+        m_buffer.append(',');
+        appendCsvField(entry.notes().view());
+        m_buffer.append('\n');
+        return;
+    }
+    
+    // Bitwarden's unencrypted export layout, type 1 being a login item
+    m_buffer.append(m_exported == 0 ? "\n" : ",\n");
+    m_buffer.append("{\"type\":1,\"name\":");
+    appendJsonString(entry.title());
+    m_buffer.append(",\"notes\":");
+    appendJsonString(entry.notes().view());
+    m_buffer.append(",\"login\":{\"username\":");
+    appendJsonString(entry.username());
+    m_buffer.append(",\"password\":");
+    appendJsonString(entry.password().view());
+    m_buffer.append(",\"uris\":[");
+    if (!entry.url().isEmpty()) {
+        m_buffer.append("{\"uri\":");
+        appendJsonString(entry.url());
+        m_buffer.append('}');
+    }
+    m_buffer.append("]},\"creationDate\":\"");
+    m_buffer.append(entry.created().toUTC().toString(Qt::ISODateWithMs).toLatin1());
+    m_buffer.append("\",\"revisionDate\":\"");
+    m_buffer.append(entry.modified().toUTC().toString(Qt::ISODateWithMs).toLatin1());
+    m_buffer.append("\"}");
+}
+
+bool VaultExporter::flush(bool last) {
+    bool written;
+    if (m_container) {
+        written = m_container->writeChunk(m_buffer, last);
+        if (!written) {
+            m_errorString = m_container->errorString();
+        }
+    } else {
+        written = m_file->write(m_buffer) == m_buffer.size();
+        if (!written) {
+            m_errorString = m_file->errorString();
+        }
+    }
+    
+    // resize(0) keeps the allocation for the next chunk
+    SecureMemory::wipe(m_buffer.data(), m_buffer.size());
+    m_buffer.resize(0);
+    return written;
+}
+
+void VaultExporter::appendCsvField(QStringView field) {
+    bool quote = false;
+    for (QChar c : field) {
+        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+            quote = true;
+            break;
+        }
+    }
+    if (!quote) {
+        appendUtf8(field);
+        return;
+    }
+    
+    m_buffer.append('"');
+    int start = 0;
+    int quoteAt;
+    while ((quoteAt = field.indexOf('"', start)) >= 0) {
+        appendUtf8(field.mid(start, quoteAt - start + 1));
+        m_buffer.append('"');
+        start = quoteAt + 1;
+    }
+    appendUtf8(field.mid(start));
+    m_buffer.append('"');
+}
+
+void VaultExporter::appendJsonString(QStringView text) {
+    static const char Hex[] = "0123456789abcdef";
+    
+    m_buffer.append('"');
+    int start = 0;
+    for (int i = 0; i < text.size(); ++i) {
+        ushort c = text[i].unicode();
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        appendUtf8(text.mid(start, i - start));
+        start = i + 1;
+        switch (c) {
+        case '"': m_buffer.append("\\\""); break;
+        case '\\': m_buffer.append("\\\\"); break;
+        case '\n': m_buffer.append("\\n"); break;
+        case '\r': m_buffer.append("\\r"); break;
+        case '\t': m_buffer.append("\\t"); break;
+        default:
+            m_buffer.append("\\u00");
+            m_buffer.append(Hex[c >> 4]);
+            m_buffer.append(Hex[c & 0xf]);
+        }
+    }
+    appendUtf8(text.mid(start));
+    m_buffer.append('"');
+}
+
+void VaultExporter::appendUtf8(QStringView text) {
+    // toUtf8 allocates a temporary copy of the (possibly secret) text
+    QByteArray utf8 = text.toUtf8();
+    m_buffer.append(utf8);
+    SecureMemory::wipe(utf8.data(), utf8.size());
+}
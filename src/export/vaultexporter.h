@@ -0,0 +1,65 @@
+#ifndef VAULTEXPORTER_H
+#define VAULTEXPORTER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QStringView>
+#include "../storage/database.h"
+#include "../crypto/encryption.h"
+#include "../models/passwordentry.h"
+
+class ExportContainer;
+class QSaveFile;
+
+// Writes every entry of an unlocked vault to a file. Entries are decrypted
+// one row at a time and serialized into a single reused buffer that is
+// flushed and wiped every ChunkSize bytes, so peak memory stays flat however
+// large the vault is. CSV and JSON exports use the column and field names the
+// importers read back; the encrypted format is the JSON stream sealed in an
+// ExportContainer.
+class VaultExporter {
+public:
+    enum Format {
+        EncryptedFormat,
+        CsvFormat,
+        JsonFormat
+    };
+
+    static constexpr int ChunkSize = 64 * 1024;
+
+    VaultExporter(Database *database, const QByteArray &masterKey);
+    ~VaultExporter();
+
+    // password is only used by EncryptedFormat. progress is called with the
+    // number of entries written after every chunk; returning false cancels the
+    // export and leaves any existing file at path untouched. Fails, writing
+    // nothing, if any entry cannot be decrypted.
+    bool exportTo(const QString &path, Format format, const QString &password = QString(),
+                  const Encryption::ProgressCallback &progress = Encryption::ProgressCallback());
+
+    int exportedCount() const { return m_exported; }
+    bool wasCancelled() const { return m_cancelled; }
+    QString errorString() const { return m_errorString; }
+
+    static Format formatForFile(const QString &path);
+
+private:
+    void appendEntry(const PasswordEntry &entry);
+    bool flush(bool last);
+    void appendCsvField(QStringView field);
+    void appendJsonString(QStringView text);
+    void appendUtf8(QStringView text);
+
+    Database *m_database;
+    QByteArray m_masterKey;
+
+    Format m_format;
+    QSaveFile *m_file;
+    ExportContainer *m_container;
+    QByteArray m_buffer;
+    int m_exported;
+    bool m_cancelled;
+    QString m_errorString;
+};
+
+#endif
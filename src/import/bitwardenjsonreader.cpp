@@ -0,0 +1,312 @@
+#include "bitwardenjsonreader.h"
+#include "../crypto/securememory.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonParseError>
+#include <QStringList>
+
+// Device reads are this large; consumed bytes are dropped once this many
+// have accumulated
+static const int ReadBlockSize = 64 * 1024;
+
+// Bitwarden item types
+static const int LoginItem = 1;
+static const int SecureNoteItem = 2;
+static const int CardItem = 3;
+static const int IdentityItem = 4;
+
+static inline bool isJsonWhitespace(int c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+BitwardenJsonReader::BitwardenJsonReader(QIODevice *device)
+    : EntryReader(device),
+      m_position(0),
+      m_bufferStart(0),
+      m_state(Start),
+      m_item(0) {}
+
+BitwardenJsonReader::~BitwardenJsonReader() {
+    SecureMemory::wipe(m_buffer.data(), m_buffer.size());
+}
+
+bool BitwardenJsonReader::readNext(PasswordEntry &entry) {
+    if (m_state == Start) {
+        if (!seekItems()) {
+            m_state = Finished;
+            return false;
+        }
+        m_state = InItems;
+    }
+    
+    while (m_state == InItems) {
+        skipWhitespace();
+        int c = peek();
+        if (c == ',') {
+            next();
+            continue;
+        }
+        if (c == ']') {
+            next();
+            m_state = Finished;
+            break;
+        }
+        if (c != '{') {
+            setErrorString(QString("Malformed items array at byte %1.").arg(bytesRead()));
+            m_state = Finished;
+            break;
+        }
+        
+        // Cut out exactly one item and parse only that
+        QByteArray itemJson;
+        bool complete = scanValue(&itemJson);
+        ++m_item;
+        if (!complete) {
+            SecureMemory::wipe(itemJson.data(), itemJson.size());
+            setErrorString(QString("The file ends inside item %1.").arg(m_item));
+            m_state = Finished;
+            break;
+        }
+        
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(itemJson, &parseError);
+        SecureMemory::wipe(itemJson.data(), itemJson.size());
+        if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+            addRowError(m_item, "Invalid JSON: " + parseError.errorString());
+            continue;
+        }
+        
+        QString error;
+        if (mapItem(document.object(), entry, &error)) {
+            return true;
+        }
+        addRowError(m_item, error);
+    }
+    
+    return false;
+}
+
+qint64 BitwardenJsonReader::bytesRead() const {
+    return m_bufferStart + m_position;
+}
+
+bool BitwardenJsonReader::seekItems() {
+    skipWhitespace();
+    if (next() != '{') {
+        setErrorString("Not a Bitwarden JSON export.");
+        return false;
+    }
+    
+    // Walk the top-level keys, skipping every value but "items"
+    while (true) {
+        skipWhitespace();
+        int c = peek();
+        if (c == ',') {
+            next();
+            continue;
+        }
+        if (c == '}' || c < 0) {
+            setErrorString("No items array found in the export.");
+            return false;
+        }
+        
+        QByteArray key;
+        if (!readKey(key)) {
+            setErrorString(QString("Malformed export at byte %1.").arg(bytesRead()));
+            return false;
+        }
+        skipWhitespace();
+        if (next() != ':') {
+            setErrorString(QString("Malformed export at byte %1.").arg(bytesRead()));
+            return false;
+        }
+        skipWhitespace();
+        
+        if (key == "items") {
+            if (next() != '[') {
+                setErrorString("The items entry is not an array.");
+                return false;
+            }
+            return true;
+        }
+        
+        if (key == "encrypted") {
+            QByteArray value;
+            if (!scanValue(&value)) break;
+            if (value == "true") {
+                setErrorString("Encrypted Bitwarden exports cannot be imported. "
+                               "Export the vault as unencrypted JSON instead.");
+                return false;
+            }
+        } else if (!scanValue(nullptr)) {
+            break;
+        }
+    }
+    
+    setErrorString("Unexpected end of file.");
+    return false;
+}
+
+bool BitwardenJsonReader::mapItem(const QJsonObject &item, PasswordEntry &entry, 
+                                  QString *error) const {
+    int type = item.value("type").toInt();
+    if (type == CardItem || type == IdentityItem) {
+        *error = QString("\"%1\" is a %2, which cannot be imported")
+                     .arg(item.value("name").toString(), 
+                          type == CardItem ? "card" : "identity");
+        return false;
+    }
+    if (type != LoginItem && type != SecureNoteItem) {
+        *error = QString("Unknown item type %1").arg(type);
+        return false;
+    }
+    
+    QJsonObject login = item.value("login").toObject();
+    QString url;
+    const QJsonArray uris = login.value("uris").toArray();
+    if (!uris.isEmpty()) {
+        url = uris.first().toObject().value("uri").toString();
+    }
+    
+    // Data without a field of its own is kept in the notes rather than lost
+    QStringList notes;
+    QString itemNotes = item.value("notes").toString();
+    if (!itemNotes.isEmpty()) {
+        notes.append(itemNotes);
+    }
+    QString totp = login.value("totp").toString();
+    if (!totp.isEmpty()) {
+        notes.append("TOTP: " + totp);
+    }
+    for (qsizetype i = 1; i < uris.size(); ++i) {
+        notes.append("URL: " + uris[i].toObject().value("uri").toString());
+    }
+    const QJsonArray fields = item.value("fields").toArray();
+    for (const QJsonValue &field : fields) {
+        QJsonObject object = field.toObject();
+        notes.append(object.value("name").toString() + ": " + object.value("value").toString());
+    }
+    
+    QDateTime created = QDateTime::fromString(item.value("creationDate").toString(), 
+                                              Qt::ISODateWithMs);
+    QDateTime modified = QDateTime::fromString(item.value("revisionDate").toString(), 
+                                               Qt::ISODateWithMs);
+    
+    if (!makeEntry(item.value("name").toString(), login.value("username").toString(),
+                   login.value("password").toString(), url, notes.join('\n'),
+                   created.toLocalTime(), modified.toLocalTime(), entry)) {
+        *error = "Item has no name, username, password, url or notes";
+        return false;
+    }
+    
+    return true;
+}
+
+bool BitwardenJsonReader::fill() {
+    discardConsumed();
+    
+    QByteArray block = m_device->read(ReadBlockSize);
+    if (block.isEmpty()) {
+        return false;
+    }
+    
+    m_buffer.append(block);
+    SecureMemory::wipe(block.data(), block.size());
+    return true;
+}
+
+int BitwardenJsonReader::peek() {
+    if (m_position >= m_buffer.size() && !fill()) {
+        return -1;
+    }
+    return static_cast<unsigned char>(m_buffer[m_position]);
+}
+
+int BitwardenJsonReader::next() {
+    int c = peek();
+    if (c >= 0) {
+        ++m_position;
+    }
+    return c;
+}
+
+void BitwardenJsonReader::skipWhitespace() {
+    while (isJsonWhitespace(peek())) {
+        ++m_position;
+    }
+}
+
+bool BitwardenJsonReader::readKey(QByteArray &key) {
+    if (next() != '"') {
+        return false;
+    }
+    
+    // Only compared against plain ASCII names, so escapes are kept verbatim
+    bool escaped = false;
+    while (true) {
+        int c = next();
+        if (c < 0) return false;
+        if (escaped) {
+            escaped = false;
+        } else if (c == '\\') {
+            escaped = true;
+        } else if (c == '"') {
+            return true;
+        }
+        key.append(char(c));
+    }
+}
+
+bool BitwardenJsonReader::scanValue(QByteArray *out) {
+    skipWhitespace();
+    int c = peek();
+    if (c < 0) return false;
+    
+    // Scalars other than strings end at the next delimiter
+    if (c != '{' && c != '[' && c != '"') {
+        while (c >= 0 && c != ',' && c != '}' && c != ']' && !isJsonWhitespace(c)) {
+            if (out) out->append(char(c));
+            ++m_position;
+            c = peek();
+        }
+        return true;
+    }
+    
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    while ((c = next()) >= 0) {
+        if (out) out->append(char(c));
+        
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+                if (depth == 0) return true;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) return true;
+        }
+    }
+    
+    return false;
+}
+
+void BitwardenJsonReader::discardConsumed() {
+    if (m_position < ReadBlockSize) {
+        return;
+    }
+    
+    // The consumed prefix may hold other items' secrets
+    SecureMemory::wipe(m_buffer.data(), m_position);
+    m_buffer.remove(0, m_position);
+    m_bufferStart += m_position;
+    m_position = 0;
+}
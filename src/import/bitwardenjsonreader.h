@@ -0,0 +1,48 @@
+#ifndef BITWARDENJSONREADER_H
+#define BITWARDENJSONREADER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include "entryreader.h"
+
+// Unencrypted Bitwarden JSON export. The document is one object whose
+// "items" array holds every vault item, so it is not parsed as a whole:
+// a byte-level scanner walks to the array and cuts out one item at a time,
+// and only that item goes through QJsonDocument. Memory use is bounded by
+// the largest single item.
+class BitwardenJsonReader : public EntryReader {
+public:
+    explicit BitwardenJsonReader(QIODevice *device);
+    ~BitwardenJsonReader();
+
+    bool readNext(PasswordEntry &entry) override;
+    qint64 bytesRead() const override;
+
+private:
+    enum State {
+        Start,
+        InItems,
+        Finished
+    };
+
+    bool seekItems();
+    bool mapItem(const QJsonObject &item, PasswordEntry &entry, QString *error) const;
+
+    // Scanner over m_buffer, refilled from the device on demand
+    bool fill();
+    int peek();                 // -1 at end of input
+    int next();
+    void skipWhitespace();
+    bool readKey(QByteArray &key);
+    // Consumes one complete JSON value, appending its bytes to out if given
+    bool scanValue(QByteArray *out);
+    void discardConsumed();
+
+    QByteArray m_buffer;
+    int m_position;
+    qint64 m_bufferStart;       // Device offset of m_buffer[0]
+    State m_state;
+    qint64 m_item;
+};
+
+#endif
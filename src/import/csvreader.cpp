@@ -0,0 +1,207 @@
+#include "csvreader.h"
+#include <algorithm>
+
+CsvReader::CsvReader(QIODevice *device)
+    : EntryReader(device),
+      m_stream(device),
+      m_delimiter(','),
+      m_headerSize(0),
+      m_headerRead(false),
+      m_line(0) {
+    m_stream.setEncoding(QStringConverter::Utf8);
+    std::fill(std::begin(m_columns), std::end(m_columns), -1);
+}
+
+bool CsvReader::readNext(PasswordEntry &entry) {
+    if (!m_headerRead) {
+        m_headerRead = true;
+        if (!readHeader()) {
+            return false;
+        }
+    }
+    
+    QStringList fields;
+    bool unterminated = false;
+    while (true) {
+        qint64 row = m_line + 1;
+        if (!readRecord(fields, &unterminated)) {
+            return false;
+        }
+        
+        if (unterminated) {
+            addRowError(row, "Unterminated quoted field");
+            return false;
+        }
+        
+        // Blank lines, common at the end of hand-edited files
+        if (fields.size() == 1 && fields[0].trimmed().isEmpty()) {
+            continue;
+        }
+        
+        if (fields.size() != m_headerSize) {
+            addRowError(row, QString("Expected %1 fields, found %2")
+                                 .arg(m_headerSize).arg(fields.size()));
+            continue;
+        }
+        
+        if (makeEntry(field(fields, TitleColumn), field(fields, UsernameColumn),
+                      field(fields, PasswordColumn), field(fields, UrlColumn),
+                      field(fields, NotesColumn), QDateTime(), QDateTime(), entry)) {
+            return true;
+        }
+        
+        addRowError(row, "Row has no title, username, password, url or notes");
+    }
+}
+
+bool CsvReader::readHeader() {
+    QString line = m_stream.readLine();
+    ++m_line;
+    if (line.isNull()) {
+        setErrorString("The file is empty.");
+        return false;
+    }
+    
+    m_delimiter = detectDelimiter(line);
+    
+    // Split with the record parser to honour quoting
+    QStringList names;
+    bool unterminated = false;
+    if (!readRecord(names, &unterminated, line) || unterminated) {
+        setErrorString("The header line could not be read.");
+        return false;
+    }
+    
+    m_headerSize = names.size();
+    for (int i = 0; i < names.size(); ++i) {
+        int column = columnForHeader(names[i]);
+        // First match wins, e.g. "name" before a later "title"
+        if (column >= 0 && m_columns[column] < 0) {
+            m_columns[column] = i;
+        }
+    }
+    
+    if (m_columns[PasswordColumn] < 0 && m_columns[UsernameColumn] < 0 && 
+        m_columns[UrlColumn] < 0) {
+        setErrorString("No username, password or url column found in the header. "
+                       "The first line must name the columns.");
+        return false;
+    }
+    
+    return true;
+}
+
+bool CsvReader::readRecord(QStringList &fields, bool *unterminated, 
+                           const QString &firstLine) {
+    fields.clear();
+    *unterminated = false;
+    
+    QString line = firstLine;
+    if (line.isNull()) {
+        line = m_stream.readLine();
+        if (line.isNull()) {
+            return false;
+        }
+        ++m_line;
+    }
+    
+    QString current;
+    bool inQuotes = false;
+    int i = 0;
+    while (true) {
+        if (i == line.size()) {
+            if (!inQuotes) break;
+            
+            // Quoted field continues on the next line
+            QString next = m_stream.readLine();
+            if (next.isNull()) {
+                *unterminated = true;
+                break;
+            }
+            ++m_line;
+            current += '\n';
+            line = next;
+            i = 0;
+            continue;
+        }
+        
+        QChar c = line[i++];
+        if (inQuotes) {
+            if (c == '"') {
+                if (i < line.size() && line[i] == '"') {
+                    current += '"';
+                    ++i;
+                } else {
+                    inQuotes = false;
+                }
+            } else {
+                current += c;
+            }
+        } else if (c == '"') {
+            inQuotes = true;
+        } else if (c == m_delimiter) {
+            fields.append(current);
+            current.clear();
+        } else {
+            current += c;
+        }
+    }
+    fields.append(current);
+    
+    return true;
+}
+
+QString CsvReader::field(const QStringList &fields, Column column) const {
+    int index = m_columns[column];
+    return index >= 0 && index < fields.size() ? fields[index] : QString();
+}
+
+QChar CsvReader::detectDelimiter(const QString &line) {
+    // The candidate seen most often outside quotes
+    const QChar candidates[] = { ',', ';', '\t' };
+    QChar best = ',';
+    int bestCount = 0;
+    
+    for (QChar candidate : candidates) {
+        int count = 0;
+        bool inQuotes = false;
+        for (QChar c : line) {
+            if (c == '"') {
+                inQuotes = !inQuotes;
+            } else if (c == candidate && !inQuotes) {
+                ++count;
+            }
+        }
+        if (count > bestCount) {
+            best = candidate;
+            bestCount = count;
+        }
+    }
+    
+    return best;
+}
+
+int CsvReader::columnForHeader(const QString &name) {
+    QString key = name.trimmed().toLower();
+    
+    if (key == "title" || key == "name" || key == "account" || key == "entry") {
+        return TitleColumn;
+    }
+    if (key == "username" || key == "user name" || key == "login name" || 
+        key == "login_username" || key == "login" || key == "user" || key == "email") {
+        return UsernameColumn;
+    }
+    if (key == "password" || key == "login_password" || key == "pass") {
+        return PasswordColumn;
+    }
+    if (key == "url" || key == "uri" || key == "login_uri" || key == "website" || 
+        key == "web site" || key == "address") {
+        return UrlColumn;
+    }
+    if (key == "notes" || key == "note" || key == "comments" || key == "comment" || 
+        key == "extra") {
+        return NotesColumn;
+    }
+    
+    return -1;
+}
@@ -0,0 +1,47 @@
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+#include <QTextStream>
+#include <QStringList>
+#include "entryreader.h"
+
+// Generic CSV as exported by browsers and most password managers. Columns
+// are found by header name, so Chrome, Firefox, LastPass, Bitwarden and
+// KeePass CSV layouts all map without configuration. The delimiter (comma,
+// semicolon or tab) is taken from the header line; quoted fields may span
+// lines.
+class CsvReader : public EntryReader {
+public:
+    explicit CsvReader(QIODevice *device);
+
+    bool readNext(PasswordEntry &entry) override;
+
+private:
+    enum Column {
+        TitleColumn = 0,
+        UsernameColumn,
+        PasswordColumn,
+        UrlColumn,
+        NotesColumn,
+        ColumnCount
+    };
+
+    bool readHeader();
+    // One record, which may span several physical lines. False at the end
+    // of the input. A non-null firstLine is used instead of reading one.
+    bool readRecord(QStringList &fields, bool *unterminated,
+                    const QString &firstLine = QString());
+    QString field(const QStringList &fields, Column column) const;
+
+    static QChar detectDelimiter(const QString &line);
+    static int columnForHeader(const QString &name);
+
+    QTextStream m_stream;
+    QChar m_delimiter;
+    int m_columns[ColumnCount];
+    int m_headerSize;
+    bool m_headerRead;
+    qint64 m_line;
+};
+
+#endif
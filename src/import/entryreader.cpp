@@ -0,0 +1,75 @@
+#include "entryreader.h"
+#include "csvreader.h"
+#include "bitwardenjsonreader.h"
+#include "keepassxmlreader.h"
+#include <QFileInfo>
+
+EntryReader *EntryReader::create(Format format, QIODevice *device) {
+    switch (format) {
+        case CsvFormat:
+            return new CsvReader(device);
+        case BitwardenJsonFormat:
+            return new BitwardenJsonReader(device);
+        case KeePassXmlFormat:
+            return new KeePassXmlReader(device);
+    }
+    
+    return nullptr;
+}
+
+EntryReader::Format EntryReader::formatForFile(const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "json") {
+        return BitwardenJsonFormat;
+    }
+    if (suffix == "xml") {
+        return KeePassXmlFormat;
+    }
+    return CsvFormat;
+}
+
+QString EntryReader::formatName(Format format) {
+    switch (format) {
+        case CsvFormat:
+            return "CSV";
+        case BitwardenJsonFormat:
+            return "Bitwarden JSON";
+        case KeePassXmlFormat:
+            return "KeePass XML";
+    }
+    
+    return QString();
+}
+
+QList<EntryReader::RowError> EntryReader::takeRowErrors() {
+    QList<RowError> errors = m_rowErrors;
+    m_rowErrors.clear();
+    return errors;
+}
+
+void EntryReader::addRowError(qint64 row, const QString &message) {
+    m_rowErrors.append({row, message});
+}
+
+bool EntryReader::makeEntry(const QString &title, const QString &username,
+                            const QString &password, const QString &url,
+                            const QString &notes, const QDateTime &created,
+                            const QDateTime &modified, PasswordEntry &entry) {
+    if (title.isEmpty() && username.isEmpty() && password.isEmpty() && 
+        url.isEmpty() && notes.isEmpty()) {
+        return false;
+    }
+    
+    QString entryTitle = title.trimmed();
+    if (entryTitle.isEmpty()) {
+        entryTitle = !url.isEmpty() ? url.trimmed() : username.trimmed();
+    }
+    
+    QDateTime now = QDateTime::currentDateTime();
+    QDateTime createdAt = created.isValid() ? created : now;
+    QDateTime modifiedAt = modified.isValid() ? modified : createdAt;
+    
+    entry = PasswordEntry(-1, entryTitle, username, password, url.trimmed(), notes,
+                          createdAt, modifiedAt);
+    return true;
+}
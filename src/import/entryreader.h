@@ -0,0 +1,70 @@
+#ifndef ENTRYREADER_H
+#define ENTRYREADER_H
+
+#include <QString>
+#include <QList>
+#include <QIODevice>
+#include "../models/passwordentry.h"
+
+// Pull parser over another password manager's export. Entries are produced
+// one at a time straight from the device, so memory use does not grow with
+// the size of the file.
+//
+// Problems confined to one row (a malformed line, an unsupported item type)
+// skip that row and are collected as row errors; anything that makes the
+// rest of the input unreadable ends the stream with errorString() set.
+class EntryReader {
+public:
+    enum Format {
+        CsvFormat,
+        BitwardenJsonFormat,
+        KeePassXmlFormat
+    };
+
+    struct RowError {
+        qint64 row;         // 1-based: the line for CSV, the item index otherwise
+        QString message;
+    };
+
+    virtual ~EntryReader() = default;
+
+    // Caller keeps ownership of the device, which must be open for reading
+    static EntryReader *create(Format format, QIODevice *device);
+    static Format formatForFile(const QString &path);
+    static QString formatName(Format format);
+
+    // Fills entry with the next importable row. Returns false at the end of
+    // the input or on a fatal error; the two are told apart by hasError().
+    virtual bool readNext(PasswordEntry &entry) = 0;
+
+    bool hasError() const { return !m_errorString.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+    // Row errors collected since the previous call
+    QList<RowError> takeRowErrors();
+
+    // Input consumed so far, for progress reporting
+    virtual qint64 bytesRead() const { return m_device->pos(); }
+
+protected:
+    explicit EntryReader(QIODevice *device) : m_device(device) {}
+
+    void addRowError(qint64 row, const QString &message);
+    void setErrorString(const QString &message) { m_errorString = message; }
+
+    // Builds the entry for an imported row, falling back to the url or
+    // username for a missing title. Returns false if the row carries nothing
+    // worth importing.
+    static bool makeEntry(const QString &title, const QString &username,
+                          const QString &password, const QString &url,
+                          const QString &notes, const QDateTime &created,
+                          const QDateTime &modified, PasswordEntry &entry);
+
+    QIODevice *m_device;
+
+private:
+    QString m_errorString;
+    QList<RowError> m_rowErrors;
+};
+
+#endif
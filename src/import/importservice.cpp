@@ -0,0 +1,166 @@
+#include "importservice.h"
+#include "../crypto/securememory.h"
+#include <QtConcurrent>
+#include <QPromise>
+#include <QElapsedTimer>
+#include <QDebug>
+
+ImportService::ImportService(QObject *parent)
+    : QObject(parent),
+      m_chunkWatcher(new QFutureWatcher<Chunk>(this)),
+      m_database(nullptr),
+      m_file(nullptr),
+      m_reader(nullptr),
+      m_fileSize(0),
+      m_imported(0) {
+    connect(m_chunkWatcher, &QFutureWatcher<Chunk>::finished, 
+            this, &ImportService::onChunkRead);
+}
+
+ImportService::~ImportService() {
+    m_chunkWatcher->cancel();
+    m_chunkWatcher->waitForFinished();
+    reset();
+}
+
+void ImportService::start(Database *database, const QByteArray &masterKey,
+                          const QString &path, EntryReader::Format format) {
+    if (isRunning()) {
+        return;
+    }
+    
+    reset();
+    m_file = new QFile(path);
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        QString message = QString("Could not open %1: %2").arg(path, m_file->errorString());
+        reset();
+        emit failed(message, 0);
+        return;
+    }
+    
+    m_database = database;
+    // A buffer of our own, so the caller wiping its key cannot leave a
+    // chunk to be sealed under zeros
+    m_masterKey = QByteArray(masterKey.constData(), masterKey.size());
+    m_reader = EntryReader::create(format, m_file);
+    m_fileSize = m_file->size();
+    
+    qDebug() << "Importing" << EntryReader::formatName(format) << "file of" 
+             << m_fileSize << "bytes";
+    emit progressChanged(0);
+    readNextChunk();
+}
+
+void ImportService::cancel() {
+    if (!m_reader) {
+        return;
+    }
+    
+    // The task reads through m_reader, so it has to finish before reset()
+    m_chunkWatcher->cancel();
+    m_chunkWatcher->waitForFinished();
+    
+    int imported = m_imported;
+    reset();
+    emit cancelled(imported);
+}
+
+bool ImportService::isRunning() const {
+    return m_reader != nullptr;
+}
+
+void ImportService::readNextChunk() {
+    m_chunkWatcher->setFuture(QtConcurrent::run(
+        [](QPromise<Chunk> &promise, EntryReader *reader) {
+            Chunk chunk;
+            chunk.entries.reserve(ChunkSize);
+            
+            PasswordEntry entry;
+            while (chunk.entries.size() < ChunkSize && !promise.isCanceled()) {
+                if (!reader->readNext(entry)) {
+                    chunk.atEnd = true;
+                    chunk.fatalError = reader->errorString();
+                    break;
+                }
+                chunk.entries.append(entry);
+            }
+            
+            chunk.errors = reader->takeRowErrors();
+            chunk.bytesRead = reader->bytesRead();
+            promise.addResult(chunk);
+        }, m_reader));
+}
+
+void ImportService::onChunkRead() {
+    QFuture<Chunk> future = m_chunkWatcher->future();
+    if (future.isCanceled() || future.resultCount() == 0) {
+        return;
+    }
+    
+    Chunk chunk = future.result();
+    m_errors.append(chunk.errors);
+    
+    // Parse ahead while this chunk is sealed and written
+    if (!chunk.atEnd) {
+        readNextChunk();
+    }
+    
+    if (!chunk.entries.isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+        
+        if (!m_database->addEntries(chunk.entries, m_masterKey)) {
+            m_chunkWatcher->cancel();
+            m_chunkWatcher->waitForFinished();
+            int imported = m_imported;
+            reset();
+            emit failed("Failed to write imported entries to the vault.", imported);
+            return;
+        }
+        
+        m_imported += chunk.entries.size();
+        qDebug() << "Imported chunk of" << chunk.entries.size() << "entries in" 
+                 << timer.elapsed() << "ms," << m_imported << "so far";
+        
+        QList<PasswordEntry> summaries;
+        summaries.reserve(chunk.entries.size());
+        for (const PasswordEntry &entry : chunk.entries) {
+            summaries.append(entry.summary());
+        }
+        emit entriesImported(summaries);
+    }
+    
+    if (m_fileSize > 0) {
+        emit progressChanged(int(qMin<qint64>(100, chunk.bytesRead * 100 / m_fileSize)));
+    }
+    
+    if (!chunk.atEnd) {
+        return;
+    }
+    
+    int imported = m_imported;
+    QList<EntryReader::RowError> errors = m_errors;
+    QString fatalError = chunk.fatalError;
+    reset();
+    
+    if (!fatalError.isEmpty()) {
+        emit failed(fatalError, imported);
+    } else {
+        emit progressChanged(100);
+        emit finished(imported, errors);
+    }
+}
+
+void ImportService::reset() {
+    delete m_reader;
+    m_reader = nullptr;
+    delete m_file;
+    m_file = nullptr;
+    
+    m_database = nullptr;
+    SecureMemory::wipe(const_cast<char*>(m_masterKey.constData()), m_masterKey.size());
+    m_masterKey.clear();
+    m_fileSize = 0;
+    m_imported = 0;
+    m_errors.clear();
+}
@@ -0,0 +1,71 @@
+#ifndef IMPORTSERVICE_H
+#define IMPORTSERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+#include <QFutureWatcher>
+#include "entryreader.h"
+#include "../storage/database.h"
+#include "../models/passwordentry.h"
+
+// Imports another password manager's export into the open vault without
+// loading the file into memory. A worker thread parses the next chunk of
+// rows while the previous chunk is sealed and committed through
+// Database::addEntries, one transaction per chunk, so at most two chunks
+// are in memory at a time. Rows that cannot be imported are skipped and
+// reported at the end.
+class ImportService : public QObject {
+    Q_OBJECT
+
+public:
+    // Rows per transaction
+    static constexpr int ChunkSize = 1000;
+
+    // Rows parsed by one worker task
+    struct Chunk {
+        QList<PasswordEntry> entries;
+        QList<EntryReader::RowError> errors;
+        qint64 bytesRead = 0;
+        bool atEnd = false;
+        QString fatalError;
+    };
+
+    explicit ImportService(QObject *parent = nullptr);
+    ~ImportService();
+
+    void start(Database *database, const QByteArray &masterKey,
+               const QString &path, EntryReader::Format format);
+    // Chunks already committed stay in the vault
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void progressChanged(int percent);
+    // Summaries of each committed chunk, carrying their new ids
+    void entriesImported(const QList<PasswordEntry> &entries);
+    void finished(int imported, const QList<EntryReader::RowError> &errors);
+    void cancelled(int imported);
+    void failed(const QString &message, int imported);
+
+private slots:
+    void onChunkRead();
+
+private:
+    void readNextChunk();
+    void reset();
+
+    QFutureWatcher<Chunk> *m_chunkWatcher;
+
+    Database *m_database;
+    QByteArray m_masterKey;
+    QFile *m_file;
+    EntryReader *m_reader;
+    qint64 m_fileSize;
+    int m_imported;
+    QList<EntryReader::RowError> m_errors;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "keepassxmlreader.h"
+#include <QStringList>
+#include <QtEndian>
+#include <QTimeZone>
+
+static QDateTime parseTime(const QString &text) {
+    QDateTime time = QDateTime::fromString(text, Qt::ISODate);
+    if (time.isValid()) {
+        return time.toLocalTime();
+    }
+    
+    // KDBX 4 writes times as base64 of little-endian seconds since 0001-01-01 UTC
+    QByteArray seconds = QByteArray::fromBase64(text.toLatin1());
+    if (seconds.size() != 8) {
+        return QDateTime();
+    }
+    static const QDateTime epoch(QDate(1, 1, 1), QTime(0, 0), QTimeZone::utc());
+    return epoch.addSecs(qFromLittleEndian<qint64>(seconds.constData())).toLocalTime();
+}
+
+KeePassXmlReader::KeePassXmlReader(QIODevice *device)
+    : EntryReader(device),
+      m_xml(device),
+      m_groupStarted(false),
+      m_entry(0) {}
+
+bool KeePassXmlReader::readNext(PasswordEntry &entry) {
+    while (!m_xml.atEnd()) {
+        if (m_xml.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+        
+        const QStringView name = m_xml.name();
+        bool groupStarted = m_groupStarted;
+        m_groupStarted = name == QLatin1String("Group");
+        
+        if (name == QLatin1String("RecycleBinUUID")) {
+            m_recycleBinUuid = m_xml.readElementText();
+        } else if (name == QLatin1String("UUID") && groupStarted) {
+            // A group's UUID is its first child; the recycle bin holds
+            // deleted entries, which are not imported
+            if (!m_recycleBinUuid.isEmpty() && m_xml.readElementText() == m_recycleBinUuid) {
+                skipToEndOfParent();
+            }
+        } else if (name == QLatin1String("Entry")) {
+            ++m_entry;
+            QString error;
+            if (readEntry(entry, &error)) {
+                return true;
+            }
+            if (!error.isEmpty()) {
+                addRowError(m_entry, error);
+            }
+        } else if (name == QLatin1String("Binaries") || name == QLatin1String("CustomIcons")) {
+            // Attachments and icons, which entries here cannot hold
+            m_xml.skipCurrentElement();
+        }
+    }
+    
+    if (m_xml.hasError()) {
+        setErrorString(QString("Invalid XML at line %1: %2")
+                           .arg(m_xml.lineNumber()).arg(m_xml.errorString()));
+    }
+    
+    return false;
+}
+
+bool KeePassXmlReader::readEntry(PasswordEntry &entry, QString *error) {
+    QString title, username, password, url, notes;
+    QStringList extraFields;
+    QDateTime created, modified;
+    
+    // Positioned on <Entry>; read until its end tag
+    while (m_xml.readNextStartElement()) {
+        const QStringView name = m_xml.name();
+        
+        if (name == QLatin1String("String")) {
+            QString key, value;
+            while (m_xml.readNextStartElement()) {
+                if (m_xml.name() == QLatin1String("Key")) {
+                    key = m_xml.readElementText();
+                } else if (m_xml.name() == QLatin1String("Value")) {
+                    value = m_xml.readElementText();
+                } else {
+                    m_xml.skipCurrentElement();
+                }
+            }
+            
+            if (key == "Title") {
+                title = value;
+            } else if (key == "UserName") {
+                username = value;
+            } else if (key == "Password") {
+                password = value;
+            } else if (key == "URL") {
+                url = value;
+            } else if (key == "Notes") {
+                notes = value;
+            } else if (!value.isEmpty()) {
+                extraFields.append(key + ": " + value);
+            }
+        } else if (name == QLatin1String("Times")) {
+            while (m_xml.readNextStartElement()) {
+                if (m_xml.name() == QLatin1String("CreationTime")) {
+                    created = parseTime(m_xml.readElementText());
+                } else if (m_xml.name() == QLatin1String("LastModificationTime")) {
+                    modified = parseTime(m_xml.readElementText());
+                } else {
+                    m_xml.skipCurrentElement();
+                }
+            }
+        } else {
+            // History holds earlier versions of this same entry
+            m_xml.skipCurrentElement();
+        }
+    }
+    
+    if (m_xml.hasError()) {
+        // Reported as the fatal error by readNext
+        return false;
+    }
+    
+    // Custom string fields have no column of their own; keep them in notes
+    if (!extraFields.isEmpty()) {
+        if (!notes.isEmpty()) {
+            extraFields.prepend(notes);
+        }
+        notes = extraFields.join('\n');
+    }
+    
+    if (!makeEntry(title, username, password, url, notes, created, modified, entry)) {
+        *error = "Entry has no title, username, password, url or notes";
+        return false;
+    }
+    
+    return true;
+}
+
+void KeePassXmlReader::skipToEndOfParent() {
+    int depth = 1;
+    while (depth > 0 && !m_xml.atEnd()) {
+        QXmlStreamReader::TokenType token = m_xml.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            ++depth;
+        } else if (token == QXmlStreamReader::EndElement) {
+            --depth;
+        }
+    }
+}
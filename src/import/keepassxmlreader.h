@@ -0,0 +1,26 @@
+#ifndef KEEPASSXMLREADER_H
+#define KEEPASSXMLREADER_H
+
+#include <QXmlStreamReader>
+#include "entryreader.h"
+
+// KeePass 2.x XML export ("KeePass XML (2.x)" in KeePass and KeePassXC).
+// Read with QXmlStreamReader, one Entry element at a time. Entry history and
+// the recycle bin group are skipped; group structure is flattened.
+class KeePassXmlReader : public EntryReader {
+public:
+    explicit KeePassXmlReader(QIODevice *device);
+
+    bool readNext(PasswordEntry &entry) override;
+
+private:
+    bool readEntry(PasswordEntry &entry, QString *error);
+    void skipToEndOfParent();
+
+    QXmlStreamReader m_xml;
+    QString m_recycleBinUuid;
+    bool m_groupStarted;        // The last start tag was <Group>
+    qint64 m_entry;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "entrystore.h"
+#include <algorithm>
+
+// Text no row refers to is compacted away once it makes up half the buffer
+static const qsizetype MinDeadTextForCompaction = 4096;
+
+EntryStore::EntryStore() {
+    m_strings.append(QString());
+}
+
+void EntryStore::reserve(int count) {
+    m_ids.reserve(count);
+    m_titles.reserve(count);
+    m_usernames.reserve(count);
+    m_urlPrefixes.reserve(count);
+    m_hosts.reserve(count);
+    m_urlSuffixes.reserve(count);
+    m_modified.reserve(count);
+}
+
+void EntryStore::append(const PasswordEntry &entry) {
+    m_ids.append(entry.id());
+    m_titles.append(Span{ 0, 0 });
+    m_usernames.append(0);
+    m_urlPrefixes.append(Span{ 0, 0 });
+    m_hosts.append(0);
+    m_urlSuffixes.append(Span{ 0, 0 });
+    m_modified.append(0);
+    store(m_ids.size() - 1, entry);
+}
+
+void EntryStore::replace(int row, const PasswordEntry &entry) {
+    release(row);
+    m_ids[row] = entry.id();
+    store(row, entry);
+
+    if (m_deadText >= MinDeadTextForCompaction && m_deadText > m_text.size() / 2) {
+        compact();
+    }
+}
+
+void EntryStore::removeAt(int row) {
+    release(row);
+    m_ids.removeAt(row);
+    m_titles.removeAt(row);
+    m_usernames.removeAt(row);
+    m_urlPrefixes.removeAt(row);
+    m_hosts.removeAt(row);
+    m_urlSuffixes.removeAt(row);
+    m_modified.removeAt(row);
+
+    if (m_deadText >= MinDeadTextForCompaction && m_deadText > m_text.size() / 2) {
+        compact();
+    }
+}
+
+void EntryStore::clear() {
+    *this = EntryStore();
+}
+
+int EntryStore::rowOfEntry(int entryId) const {
+    auto it = std::find(m_ids.cbegin(), m_ids.cend(), entryId);
+    return it == m_ids.cend() ? -1 : int(it - m_ids.cbegin());
+}
+
+QString EntryStore::url(int row) const {
+    QStringView prefix = urlPrefix(row);
+    QStringView hostPart = host(row);
+    QStringView suffix = urlSuffix(row);
+
+    QString result;
+    result.reserve(prefix.size() + hostPart.size() + suffix.size());
+    result.append(prefix).append(hostPart).append(suffix);
+    return result;
+}
+
+void EntryStore::findHost(QStringView url, qsizetype *start, qsizetype *length) {
+    // scheme://user@host:port/path -> host
+    const qsizetype size = url.size();
+    qsizetype begin = 0;
+    for (qsizetype i = 0; i + 2 < size; ++i) {
+        if (url[i] == u':' && url[i + 1] == u'/' && url[i + 2] == u'/') {
+            begin = i + 3;
+            break;
+        }
+        if (url[i] == u'/' || url[i] == u'?' || url[i] == u'#') break;
+    }
+
+    qsizetype end = begin;
+    while (end < size && url[end] != u'/' && url[end] != u'?' && url[end] != u'#') {
+        ++end;
+    }
+
+    for (qsizetype i = begin; i < end; ++i) {
+        if (url[i] == u'@') begin = i + 1;
+    }
+    for (qsizetype i = begin; i < end; ++i) {
+        if (url[i] == u':') {
+            end = i;
+            break;
+        }
+    }
+
+    *start = begin;
+    *length = end - begin;
+}
+
+EntryStore::Span EntryStore::appendText(QStringView text) {
+    Span span{ quint32(m_text.size()), quint32(text.size()) };
+    m_text.append(text);
+    return span;
+}
+
+quint32 EntryStore::intern(QStringView string) {
+    if (string.isEmpty()) return 0;
+
+    auto it = m_indexOfString.constFind(string);
+    if (it != m_indexOfString.cend()) {
+        return it.value();
+    }
+
+    quint32 index = quint32(m_strings.size());
+    m_strings.append(string.toString());
+    m_indexOfString.insert(QStringView(m_strings.last()), index);
+    return index;
+}
+
+void EntryStore::store(int row, const PasswordEntry &entry) {
+    QStringView url(entry.url());
+    qsizetype hostStart = 0;
+    qsizetype hostLength = 0;
+    findHost(url, &hostStart, &hostLength);
+
+    m_titles[row] = appendText(entry.title());
+    m_usernames[row] = intern(entry.username());
+    m_urlPrefixes[row] = appendText(url.first(hostStart));
+    m_hosts[row] = intern(url.mid(hostStart, hostLength));
+    m_urlSuffixes[row] = appendText(url.sliced(hostStart + hostLength));
+    m_modified[row] = entry.modified().toMSecsSinceEpoch();
+}
+
+void EntryStore::release(int row) {
+    m_deadText += m_titles[row].length + m_urlPrefixes[row].length + m_urlSuffixes[row].length;
+}
+
+void EntryStore::compact() {
+    // Rebuilds the text buffer and the interned strings from the live rows,
+    // which also drops usernames and hosts no row uses any more
+    const QString text = m_text;
+    const QList<QString> strings = m_strings;
+
+    m_text = QString();
+    m_text.reserve(text.size() - m_deadText);
+    m_deadText = 0;
+    m_strings = QList<QString>{ QString() };
+    m_indexOfString.clear();
+
+    for (int row = 0; row < m_ids.size(); ++row) {
+        auto move = [&](Span &span) {
+            span = appendText(QStringView(text).mid(span.offset, span.length));
+        };
+        move(m_titles[row]);
+        move(m_urlPrefixes[row]);
+        move(m_urlSuffixes[row]);
+        m_usernames[row] = intern(strings[m_usernames[row]]);
+        m_hosts[row] = intern(strings[m_hosts[row]]);
+    }
+}
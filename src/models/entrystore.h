@@ -0,0 +1,85 @@
+#ifndef ENTRYSTORE_H
+#define ENTRYSTORE_H
+
+#include <QString>
+#include <QStringView>
+#include <QList>
+#include <QHash>
+#include <QtGlobal>
+#include "passwordentry.h"
+
+// The display columns of a vault's entries, laid out column by column
+// rather than as one object per entry. Titles and the parts of each url
+// around its host live back to back in one text buffer and are addressed by
+// offset and length; usernames and url hosts, which repeat across entries,
+// are interned and stored once. Timestamps are kept as milliseconds.
+//
+// A store of 100k entries is a handful of allocations, and scanning one
+// column walks contiguous memory. Rows keep insertion order.
+//
+// Implicitly shared like the Qt containers it is made of, so handing a
+// snapshot to another thread is cheap.
+class EntryStore {
+public:
+    EntryStore();
+
+    int size() const { return m_ids.size(); }
+    bool isEmpty() const { return m_ids.isEmpty(); }
+    void reserve(int count);
+
+    // Only the summary fields of the entry are stored
+    void append(const PasswordEntry &entry);
+    void replace(int row, const PasswordEntry &entry);
+    void removeAt(int row);
+    void clear();
+
+    // Linear, but over a contiguous array of ids
+    int rowOfEntry(int entryId) const;
+
+    int id(int row) const { return m_ids[row]; }
+    QStringView title(int row) const { return text(m_titles[row]); }
+    QStringView username(int row) const { return m_strings[m_usernames[row]]; }
+    // The url is stored in three parts: everything before the host, the
+    // interned host and everything after it
+    QStringView urlPrefix(int row) const { return text(m_urlPrefixes[row]); }
+    QStringView host(int row) const { return m_strings[m_hosts[row]]; }
+    QStringView urlSuffix(int row) const { return text(m_urlSuffixes[row]); }
+    QString url(int row) const;
+    qint64 modified(int row) const { return m_modified[row]; }
+
+    // Splits scheme://user@host:port/path around host; the host is empty if
+    // there is none
+    static void findHost(QStringView url, qsizetype *start, qsizetype *length);
+
+private:
+    struct Span {
+        quint32 offset;
+        quint32 length;
+    };
+
+    QStringView text(Span span) const { return QStringView(m_text).mid(span.offset, span.length); }
+    Span appendText(QStringView text);
+    quint32 intern(QStringView string);
+    void store(int row, const PasswordEntry &entry);
+    void release(int row);
+    void compact();
+
+    // One list per column, parallel to m_ids
+    QList<int> m_ids;
+    QList<Span> m_titles;
+    QList<quint32> m_usernames;     // Indices into m_strings
+    QList<Span> m_urlPrefixes;
+    QList<quint32> m_hosts;         // Indices into m_strings
+    QList<Span> m_urlSuffixes;
+    QList<qint64> m_modified;       // ms since the epoch
+
+    QString m_text;
+    qsizetype m_deadText = 0;       // Characters no row refers to any more
+
+    // Interned strings; index 0 is the empty string. The keys view the
+    // strings' own data, which never changes once interned.
+    QList<QString> m_strings;
+    QHash<QStringView, quint32> m_indexOfString;
+};
+
+#endif
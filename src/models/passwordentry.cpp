@@ -4,9 +4,17 @@ PasswordEntry::PasswordEntry()
     : m_id(-1), m_created(QDateTime::currentDateTime()),
       m_modified(QDateTime::currentDateTime()) {}
 
-PasswordEntry::PasswordEntry(int id, const QString &title,
-                             const QString &username, const QString &password,
-                             const QString &url, const QString &notes,
+PasswordEntry::PasswordEntry(int id, QString title, QString username, SecureString password,
+                             QString url, SecureString notes,
                              const QDateTime &created, const QDateTime &modified)
-    : m_id(id), m_title(title), m_username(username), m_password(password),
-      m_url(url), m_notes(notes), m_created(created), m_modified(modified) {}
+    : m_id(id), m_title(std::move(title)), m_username(std::move(username)),
+      m_password(std::move(password)), m_url(std::move(url)), m_notes(std::move(notes)),
+      m_created(created), m_modified(modified) {}
+
+PasswordEntry::PasswordEntry(int id, const QDateTime &created, const QDateTime &modified)
+    : m_id(id), m_created(created), m_modified(modified) {}
+
+PasswordEntry PasswordEntry::summary() const {
+    return PasswordEntry(m_id, m_title, m_username, SecureString(), m_url, SecureString(),
+                         m_created, m_modified);
+}
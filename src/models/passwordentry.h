@@ -3,39 +3,50 @@
 
 #include <QString>
 #include <QDateTime>
+#include <utility>
+#include "../crypto/securestring.h"
 
+// One vault entry. Accessors return references; nothing is copied unless
+// the caller asks for a copy. The constructor and setters take their
+// arguments by value, so callers that pass temporaries (decoded record
+// fields, dialog input) move them in without another allocation.
 class PasswordEntry {
 public:
     PasswordEntry();
-    PasswordEntry(int id, const QString &title, const QString &username,
-                  const QString &password, const QString &url,
-                  const QString &notes, const QDateTime &created,
+    PasswordEntry(int id, QString title, QString username, SecureString password,
+                  QString url, SecureString notes, const QDateTime &created,
                   const QDateTime &modified);
+    // An entry whose fields are about to be filled in from its record
+    PasswordEntry(int id, const QDateTime &created, const QDateTime &modified);
 
     int id() const { return m_id; }
-    QString title() const { return m_title; }
-    QString username() const { return m_username; }
-    QString password() const { return m_password; }
-    QString url() const { return m_url; }
-    QString notes() const { return m_notes; }
-    QDateTime created() const { return m_created; }
-    QDateTime modified() const { return m_modified; }
+    const QString &title() const { return m_title; }
+    const QString &username() const { return m_username; }
+    // The secret fields live in the secure arena
+    const SecureString &password() const { return m_password; }
+    const QString &url() const { return m_url; }
+    const SecureString &notes() const { return m_notes; }
+    const QDateTime &created() const { return m_created; }
+    const QDateTime &modified() const { return m_modified; }
+
+    // Copy without the secret fields, as kept in the entry list
+    PasswordEntry summary() const;
 
     void setId(int id) { m_id = id; }
-    void setTitle(const QString &title) { m_title = title; }
-    void setUsername(const QString &username) { m_username = username; }
-    void setPassword(const QString &password) { m_password = password; }
-    void setUrl(const QString &url) { m_url = url; }
-    void setNotes(const QString &notes) { m_notes = notes; }
+    void setTitle(QString title) { m_title = std::move(title); }
+    void setUsername(QString username) { m_username = std::move(username); }
+    void setPassword(SecureString password) { m_password = std::move(password); }
+    void setUrl(QString url) { m_url = std::move(url); }
+    void setNotes(SecureString notes) { m_notes = std::move(notes); }
     void setModified(const QDateTime &modified) { m_modified = modified; }
 
 private:
     int m_id;
     QString m_title;
     QString m_username;
-    QString m_password;
+    SecureString m_password;
     QString m_url;
-    QString m_notes;
+    SecureString m_notes;
     QDateTime m_created;
     QDateTime m_modified;
 };
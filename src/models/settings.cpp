@@ -168,6 +168,7 @@ void VaultSettings::load() {
     // Load sync settings
     m_syncEnabled = m_database->getSetting("sync.syncEnabled", false).toBool();
     m_syncAccountEmail = m_database->getSetting("sync.syncAccountEmail", "").toString();
+    m_syncFolder = m_database->getSetting("sync.syncFolder", "").toString();
     m_syncOption = static_cast<SyncOption>(
         m_database->getSetting("sync.syncOption", Everything).toInt());
     m_autoSyncEnabled = m_database->getSetting("sync.autoSyncEnabled", false).toBool();
@@ -195,6 +196,7 @@ void VaultSettings::save() {
     // Save sync settings
     m_database->setSetting("sync.syncEnabled", m_syncEnabled);
     m_database->setSetting("sync.syncAccountEmail", m_syncAccountEmail);
+    m_database->setSetting("sync.syncFolder", m_syncFolder);
     m_database->setSetting("sync.syncOption", static_cast<int>(m_syncOption));
     m_database->setSetting("sync.autoSyncEnabled", m_autoSyncEnabled);
     
@@ -248,6 +250,13 @@ void VaultSettings::setSyncAccountEmail(const QString &email) {
     }
 }
 
+void VaultSettings::setSyncFolder(const QString &folder) {
+    if (m_syncFolder != folder) {
+        m_syncFolder = folder;
+        save();
+    }
+}
+
 void VaultSettings::setSyncOption(SyncOption option) {
     if (m_syncOption != option) {
         m_syncOption = option;
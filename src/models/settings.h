@@ -111,6 +111,10 @@ public:
     QString syncAccountEmail() const { return m_syncAccountEmail; }
     void setSyncAccountEmail(const QString &email);
     
+    // Shared folder the directory sync backend exchanges records through
+    QString syncFolder() const { return m_syncFolder; }
+    void setSyncFolder(const QString &folder);
+    
     SyncOption syncOption() const { return m_syncOption; }
     void setSyncOption(SyncOption option);
     
@@ -139,6 +143,7 @@ private:
     int m_maxBackupCount;
     bool m_syncEnabled;
     QString m_syncAccountEmail;
+    QString m_syncFolder;
     SyncOption m_syncOption;
     bool m_autoSyncEnabled;
     bool m_showPasswordStrength;
@@ -0,0 +1,353 @@
+#include "fuzzymatcher.h"
+#include <algorithm>
+
+// Scoring, loosely after fzf's v1 algorithm
+static const int ScoreMatch = 16;
+static const int ScoreGapStart = -3;
+static const int ScoreGapExtension = -1;
+static const int BonusFieldStart = 10;
+static const int BonusBoundary = 8;
+static const int BonusConsecutive = 4;
+static const int BonusFirstCharMultiplier = 2;
+static const int BonusHost = 12;
+
+// Slots visited between polls of the cancel check
+static const int CancelCheckInterval = 4096;
+
+// Removed slots are compacted away once they outnumber the live ones
+static const int MinDeadSlotsForCompaction = 64;
+
+static inline bool isWordChar(char16_t c) {
+    return (c >= u'a' && c <= u'z') || (c >= u'0' && c <= u'9') || c >= 0x80;
+}
+
+static inline bool isQuerySpace(char16_t c) {
+    return c == u' ' || c == u'\t';
+}
+
+static inline quint64 charBit(char16_t c) {
+    if (c >= u'a' && c <= u'z') return quint64(1) << (c - u'a');
+    if (c >= u'0' && c <= u'9') return quint64(1) << (26 + (c - u'0'));
+    return quint64(1) << (36 + c % 28);
+}
+
+FuzzyMatcher::~FuzzyMatcher() {
+    clear();
+}
+
+void FuzzyMatcher::setEntries(const EntryStore &store) {
+    clear();
+    m_slots.reserve(store.size());
+    m_masks.reserve(store.size());
+    m_slotOfEntry.reserve(store.size());
+    
+    for (int row = 0; row < store.size(); ++row) {
+        append(store, row);
+    }
+}
+
+void FuzzyMatcher::addEntry(const EntryStore &store, int row) {
+    removeEntry(store.id(row));
+    append(store, row);
+    resetRefinement();
+}
+
+void FuzzyMatcher::updateEntry(const EntryStore &store, int row) {
+    addEntry(store, row);
+}
+
+void FuzzyMatcher::removeEntry(int entryId) {
+    auto it = m_slotOfEntry.find(entryId);
+    if (it == m_slotOfEntry.end()) return;
+    
+    int slot = it.value();
+    m_slotOfEntry.erase(it);
+    
+    // The mask of a dead slot never passes the prefilter; its text stays in
+    // the buffer until the next compaction
+    m_slots[slot].entryId = -1;
+    m_masks[slot] = 0;
+    ++m_deadSlots;
+    resetRefinement();
+    
+    if (m_deadSlots >= MinDeadSlotsForCompaction && m_deadSlots > m_slotOfEntry.size()) {
+        compact();
+    }
+}
+
+void FuzzyMatcher::clear() {
+    // The locked allocator wipes the text and masks as they are released
+    Text().swap(m_text);
+    std::vector<quint64, LockedAllocator<quint64>>().swap(m_masks);
+    std::vector<Slot>().swap(m_slots);
+    m_slotOfEntry.clear();
+    m_deadSlots = 0;
+    resetRefinement();
+}
+
+QList<FuzzyMatcher::Match> FuzzyMatcher::match(const QString &queryText,
+                                               const CancelCheck &isCancelled) {
+    QList<Match> matches;
+    Text query = fold(queryText);
+    
+    std::vector<Term> terms;
+    quint64 queryMask = 0;
+    for (size_t i = 0; i < query.size(); ) {
+        while (i < query.size() && isQuerySpace(query[i])) ++i;
+        size_t start = i;
+        while (i < query.size() && !isQuerySpace(query[i])) ++i;
+        if (i > start) {
+            Term term;
+            term.text = query.substr(start, i - start);
+            term.mask = charMask(term.text.data(), term.text.size());
+            queryMask |= term.mask;
+            terms.push_back(std::move(term));
+        }
+    }
+    
+    if (terms.empty()) {
+        resetRefinement();
+        return matches;
+    }
+    
+    // Appending to the query can only narrow its matches: each old term is
+    // either unchanged or a prefix of the new one, and new terms only add
+    // constraints
+    bool refine = m_hasLastQuery && query.size() >= m_lastQuery.size() &&
+                  query.compare(0, m_lastQuery.size(), m_lastQuery) == 0;
+    
+    // Prefilter on the character masks. A flat loop over contiguous words,
+    // which compilers vectorise.
+    std::vector<int> candidates;
+    if (refine) {
+        candidates.reserve(m_lastSlots.size());
+        for (int slot : m_lastSlots) {
+            if ((m_masks[slot] & queryMask) == queryMask) {
+                candidates.push_back(slot);
+            }
+        }
+    } else {
+        const quint64 *masks = m_masks.data();
+        const int slotCount = int(m_masks.size());
+        for (int slot = 0; slot < slotCount; ++slot) {
+            if ((masks[slot] & queryMask) == queryMask) {
+                candidates.push_back(slot);
+            }
+        }
+    }
+    
+    std::vector<std::pair<int, int>> scored;    // (score, slot)
+    scored.reserve(candidates.size());
+    m_lastSlots.clear();
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (isCancelled && i % CancelCheckInterval == 0 && isCancelled()) {
+            // m_lastSlots is incomplete, so the next query starts afresh
+            resetRefinement();
+            return matches;
+        }
+        
+        int slot = candidates[i];
+        int score = scoreSlot(m_slots[slot], terms);
+        if (score >= 0) {
+            scored.emplace_back(score, slot);
+            m_lastSlots.push_back(slot);
+        }
+    }
+    m_lastQuery = query;
+    m_hasLastQuery = true;
+    
+    // Candidates are in slot order, so a stable sort keeps ties in insertion order
+    std::stable_sort(scored.begin(), scored.end(),
+                     [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+        return a.first > b.first;
+    });
+    
+    matches.reserve(scored.size());
+    for (const auto &result : scored) {
+        matches.append({m_slots[result.second].entryId, result.first});
+    }
+    
+    return matches;
+}
+
+void FuzzyMatcher::append(const EntryStore &store, int row) {
+    // Fold straight from the store into the shared buffer; per-field copies
+    // would each cost a locked allocation. The url is folded part by part,
+    // so its host range falls out of the part lengths.
+    Slot slot;
+    slot.entryId = store.id(row);
+    slot.offset = quint32(m_text.size());
+    
+    size_t before = m_text.size();
+    appendFolded(store.title(row), m_text);
+    slot.length[TitleField] = quint32(m_text.size() - before);
+    
+    before = m_text.size();
+    appendFolded(store.username(row), m_text);
+    slot.length[UsernameField] = quint32(m_text.size() - before);
+    
+    before = m_text.size();
+    appendFolded(store.urlPrefix(row), m_text);
+    slot.hostStart = quint32(m_text.size() - before);
+    appendFolded(store.host(row), m_text);
+    slot.hostLength = quint32(m_text.size() - before) - slot.hostStart;
+    appendFolded(store.urlSuffix(row), m_text);
+    slot.length[UrlField] = quint32(m_text.size() - before);
+    
+    const char16_t *text = m_text.data() + slot.offset;
+    quint32 textLength = quint32(m_text.size()) - slot.offset;
+    
+    m_slotOfEntry.insert(slot.entryId, int(m_slots.size()));
+    m_slots.push_back(slot);
+    m_masks.push_back(charMask(text, textLength));
+}
+
+void FuzzyMatcher::compact() {
+    Text text;
+    std::vector<Slot> slots;
+    std::vector<quint64, LockedAllocator<quint64>> masks;
+    text.reserve(m_text.size());
+    slots.reserve(m_slotOfEntry.size());
+    masks.reserve(m_slotOfEntry.size());
+    m_slotOfEntry.clear();
+    
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        Slot slot = m_slots[i];
+        if (slot.entryId < 0) continue;
+        
+        quint32 length = slot.length[TitleField] + slot.length[UsernameField] +
+                         slot.length[UrlField];
+        quint32 offset = quint32(text.size());
+        text.append(m_text, slot.offset, length);
+        slot.offset = offset;
+        
+        m_slotOfEntry.insert(slot.entryId, int(slots.size()));
+        slots.push_back(slot);
+        masks.push_back(m_masks[i]);
+    }
+    
+    m_text.swap(text);
+    m_slots.swap(slots);
+    m_masks.swap(masks);
+    m_deadSlots = 0;
+}
+
+void FuzzyMatcher::resetRefinement() {
+    Text().swap(m_lastQuery);
+    m_lastSlots.clear();
+    m_hasLastQuery = false;
+}
+
+int FuzzyMatcher::scoreSlot(const Slot &slot, const std::vector<Term> &terms) const {
+    int total = 0;
+    for (const Term &term : terms) {
+        const char16_t *field = m_text.data() + slot.offset;
+        int best = -1;
+        for (int f = 0; f < FieldCount; ++f) {
+            bool isUrl = f == UrlField;
+            int score = scoreTerm(field, int(slot.length[f]), term,
+                                  isUrl ? int(slot.hostStart) : 0,
+                                  isUrl ? int(slot.hostLength) : 0);
+            best = std::max(best, score);
+            field += slot.length[f];
+        }
+        
+        if (best < 0) return -1;
+        total += best;
+    }
+    return total;
+}
+
+int FuzzyMatcher::scoreTerm(const char16_t *field, int length, const Term &term,
+                            int hostStart, int hostLength) const {
+    const char16_t *pattern = term.text.data();
+    const int patternLength = int(term.text.size());
+    if (patternLength > length) return -1;
+    
+    // Forward pass: the earliest position at which the whole term has matched
+    int end = -1;
+    for (int i = 0, j = 0; i < length; ++i) {
+        if (field[i] == pattern[j] && ++j == patternLength) {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) return -1;
+    
+    // Backward pass: the latest start that still matches, giving the
+    // tightest window ending at `end`
+    int start = end;
+    for (int i = end, j = patternLength - 1; i >= 0; --i) {
+        if (field[i] == pattern[j] && j-- == 0) {
+            start = i;
+            break;
+        }
+    }
+    
+    int score = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    for (int i = start, j = 0; i <= end; ++i) {
+        if (j < patternLength && field[i] == pattern[j]) {
+            int bonus = 0;
+            if (i == 0) {
+                bonus = BonusFieldStart;
+            } else if (!isWordChar(field[i - 1])) {
+                bonus = BonusBoundary;
+            }
+            
+            // A run keeps the bonus of the boundary it started on
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                if (bonus >= BonusBoundary) firstBonus = bonus;
+                bonus = std::max(bonus, std::max(firstBonus, BonusConsecutive));
+            }
+            
+            score += ScoreMatch + (j == 0 ? bonus * BonusFirstCharMultiplier : bonus);
+            ++consecutive;
+            ++j;
+            inGap = false;
+        } else {
+            score += inGap ? ScoreGapExtension : ScoreGapStart;
+            consecutive = 0;
+            inGap = true;
+        }
+    }
+    
+    if (hostLength > 0 && start >= hostStart && end < hostStart + hostLength) {
+        score += BonusHost;
+    }
+    
+    return std::max(score, 0);
+}
+
+FuzzyMatcher::Text FuzzyMatcher::fold(QStringView text) {
+    Text result;
+    appendFolded(text, result);
+    return result;
+}
+
+void FuzzyMatcher::appendFolded(QStringView text, Text &out) {
+    // Simple case folding one code point at a time, as QString::toCaseFolded
+    // does, but with no folded copy of the plaintext on the heap
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        char16_t c = text[i].unicode();
+        if (QChar::isHighSurrogate(c) && i + 1 < text.size() && text[i + 1].isLowSurrogate()) {
+            char32_t folded = QChar::toCaseFolded(QChar::surrogateToUcs4(c, text[++i].unicode()));
+            out.push_back(QChar::highSurrogate(folded));
+            out.push_back(QChar::lowSurrogate(folded));
+        } else {
+            out.push_back(char16_t(QChar::toCaseFolded(char32_t(c))));
+        }
+    }
+}
+
+quint64 FuzzyMatcher::charMask(const char16_t *text, size_t length) {
+    quint64 mask = 0;
+    for (size_t i = 0; i < length; ++i) {
+        mask |= charBit(text[i]);
+    }
+    return mask;
+}
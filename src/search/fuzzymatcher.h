@@ -0,0 +1,103 @@
+#ifndef FUZZYMATCHER_H
+#define FUZZYMATCHER_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QtGlobal>
+#include <string>
+#include <vector>
+#include <functional>
+#include "../crypto/securememory.h"
+#include "../models/entrystore.h"
+
+// Ranked fuzzy search over title, username and url, in the style of fzf:
+// every whitespace-separated query term has to appear as a subsequence of
+// one field, and matches score higher when they are contiguous, start at
+// word boundaries or fall inside the url's host.
+//
+// The case-folded fields of all entries live back to back in one buffer
+// next to a flat array of per-entry character masks. A query first sweeps
+// the mask array, which rejects most entries with one AND and compare each,
+// and only scores the survivors. A query that extends the previous one only
+// revisits the previous matches.
+//
+// Like the rest of the search state the buffers hold plaintext, so they are
+// allocated in locked memory and wiped on release.
+class FuzzyMatcher {
+public:
+    struct Match {
+        int entryId;
+        int score;
+    };
+
+    // Polled while matching; returning true abandons the query
+    using CancelCheck = std::function<bool()>;
+
+    FuzzyMatcher() = default;
+    ~FuzzyMatcher();
+
+    FuzzyMatcher(const FuzzyMatcher &) = delete;
+    FuzzyMatcher &operator=(const FuzzyMatcher &) = delete;
+
+    // Indexes the rows of the store; the matcher keeps no reference to it
+    void setEntries(const EntryStore &store);
+    void addEntry(const EntryStore &store, int row);
+    void updateEntry(const EntryStore &store, int row);
+    void removeEntry(int entryId);
+    void clear();
+
+    int size() const { return m_slotOfEntry.size(); }
+
+    // Matches ordered by descending score; ties keep insertion order. An
+    // empty or abandoned query matches nothing.
+    QList<Match> match(const QString &query, const CancelCheck &isCancelled = CancelCheck());
+
+private:
+    using Text = std::basic_string<char16_t, std::char_traits<char16_t>,
+                                   LockedAllocator<char16_t>>;
+
+    enum Field {
+        TitleField = 0,
+        UsernameField,
+        UrlField,
+        FieldCount
+    };
+
+    struct Slot {
+        int entryId;            // -1 once removed
+        quint32 offset;         // Start of the entry's fields in m_text
+        quint32 length[FieldCount];
+        quint32 hostStart;      // Host range, relative to the url field
+        quint32 hostLength;
+    };
+
+    struct Term {
+        Text text;
+        quint64 mask;
+    };
+
+    void append(const EntryStore &store, int row);
+    void compact();
+    void resetRefinement();
+    int scoreSlot(const Slot &slot, const std::vector<Term> &terms) const;
+    int scoreTerm(const char16_t *field, int length, const Term &term,
+                  int hostStart, int hostLength) const;
+
+    static Text fold(QStringView text);
+    static void appendFolded(QStringView text, Text &out);
+    static quint64 charMask(const char16_t *text, size_t length);
+
+    Text m_text;
+    std::vector<Slot> m_slots;
+    std::vector<quint64, LockedAllocator<quint64>> m_masks;   // Parallel to m_slots
+    QHash<int, int> m_slotOfEntry;
+    int m_deadSlots = 0;
+
+    // Previous query and the slots it matched, for incremental refinement
+    Text m_lastQuery;
+    std::vector<int> m_lastSlots;
+    bool m_hasLastQuery = false;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "searchscheduler.h"
+#include <QtConcurrent>
+#include <QPromise>
+
+// Past this many changes since the last snapshot, reindexing the whole
+// store is cheaper than replaying them
+static const int MaxPendingChanges = 256;
+
+SearchScheduler::SearchScheduler(QObject *parent)
+    : QObject(parent),
+      m_watcher(new QFutureWatcher<QList<FuzzyMatcher::Match>>(this)),
+      m_worker(new Worker()),
+      m_generation(1),
+      m_revision(0) {
+    // One thread keeps searches in order and the matcher single-threaded
+    m_pool.setMaxThreadCount(1);
+    
+    m_debounceTimer.setSingleShot(true);
+    m_debounceTimer.setInterval(DefaultDebounceInterval);
+    connect(&m_debounceTimer, &QTimer::timeout, this, &SearchScheduler::startSearch);
+    connect(m_watcher, &QFutureWatcher<QList<FuzzyMatcher::Match>>::finished, 
+            this, &SearchScheduler::onSearchFinished);
+}
+
+SearchScheduler::~SearchScheduler() {
+    // Tasks use m_worker directly, so they must be gone before it is
+    clear();
+    delete m_worker;
+}
+
+void SearchScheduler::setEntries(const EntryStore &store) {
+    m_store = store;
+    ++m_generation;
+    m_changes.clear();
+    
+    // Re-run the current query against the new snapshot, unless a keystroke
+    // is about to do that anyway
+    if (!m_query.isEmpty() && !m_debounceTimer.isActive()) {
+        startSearch();
+    }
+}
+
+void SearchScheduler::updateEntries(const EntryStore &store, const QList<int> &entryIds) {
+    if (m_changes.size() + entryIds.size() > MaxPendingChanges) {
+        setEntries(store);
+        return;
+    }
+    
+    m_store = store;
+    for (int entryId : entryIds) {
+        m_changes.append(Change{ ++m_revision, entryId });
+    }
+    
+    // Re-run the current query against the new snapshot, unless a keystroke
+    // is about to do that anyway
+    if (!m_query.isEmpty() && !m_debounceTimer.isActive()) {
+        startSearch();
+    }
+}
+
+void SearchScheduler::search(const QString &query) {
+    if (query == m_query && (m_debounceTimer.isActive() || m_watcher->isRunning())) {
+        return;
+    }
+    m_query = query;
+    
+    if (query.isEmpty()) {
+        m_debounceTimer.stop();
+        cancelRunning();
+        emit resultsReady(QString(), QList<FuzzyMatcher::Match>());
+        return;
+    }
+    
+    m_debounceTimer.start();
+}
+
+void SearchScheduler::clear() {
+    m_debounceTimer.stop();
+    cancelRunning();
+    m_pool.waitForDone();
+    
+    m_worker->matcher.clear();
+    m_worker->generation = 0;
+    m_worker->revision = 0;
+    m_store.clear();
+    ++m_generation;
+    m_changes.clear();
+    m_revision = 0;
+    m_query.clear();
+}
+
+void SearchScheduler::setDebounceInterval(int milliseconds) {
+    m_debounceTimer.setInterval(milliseconds);
+}
+
+void SearchScheduler::startSearch() {
+    cancelRunning();
+    if (m_query.isEmpty()) return;
+    
+    m_runningQuery = m_query;
+    m_watcher->setFuture(QtConcurrent::run(&m_pool,
+        [](QPromise<QList<FuzzyMatcher::Match>> &promise, Worker *worker,
+           const EntryStore &store, quint64 generation, const QList<Change> &changes,
+           quint64 revision, const QString &query) {
+            if (worker->generation != generation) {
+                worker->matcher.setEntries(store);
+                worker->generation = generation;
+                worker->revision = revision;
+            } else {
+                // Each change is looked up in the current snapshot, so the
+                // entry ends up as it is now whatever happened in between
+                for (const Change &change : changes) {
+                    if (change.revision <= worker->revision) continue;
+                    int row = store.rowOfEntry(change.entryId);
+                    if (row >= 0) {
+                        worker->matcher.updateEntry(store, row);
+                    } else {
+                        worker->matcher.removeEntry(change.entryId);
+                    }
+                    worker->revision = change.revision;
+                }
+            }
+            
+            QList<FuzzyMatcher::Match> matches = worker->matcher.match(query, 
+                [&promise]() { return promise.isCanceled(); });
+            if (!promise.isCanceled()) {
+                promise.addResult(matches);
+            }
+        }, m_worker, m_store, m_generation, m_changes, m_revision, m_query));
+}
+
+void SearchScheduler::onSearchFinished() {
+    QFuture<QList<FuzzyMatcher::Match>> future = m_watcher->future();
+    if (future.isCanceled() || future.resultCount() == 0) {
+        return;
+    }
+    
+    // A newer query may have been typed while this one ran; its own search
+    // is already scheduled, so this result is stale
+    if (m_runningQuery != m_query) {
+        return;
+    }
+    
+    emit resultsReady(m_runningQuery, future.result());
+}
+
+void SearchScheduler::cancelRunning() {
+    // Cancelled tasks that have not started are skipped by the pool; a
+    // running one notices at its next cancel check
+    m_watcher->cancel();
+    m_runningQuery.clear();
+}
@@ -0,0 +1,80 @@
+#ifndef SEARCHSCHEDULER_H
+#define SEARCHSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QTimer>
+#include <QThreadPool>
+#include <QFutureWatcher>
+#include "fuzzymatcher.h"
+#include "../models/entrystore.h"
+
+// Runs searches off the GUI thread. Keystrokes are coalesced by a short
+// debounce, and each search matches against the entry snapshot current at
+// the time it started. Starting a search cancels the one in flight, and
+// only the results of the latest query are ever published.
+//
+// The matcher lives on a single worker thread so that it can keep its
+// refinement state between queries; a new snapshot is indexed lazily by
+// the first search that sees it. Changes to a few entries are replayed on
+// the matcher one entry at a time instead of reindexing the snapshot.
+class SearchScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultDebounceInterval = 120;    // ms
+
+    explicit SearchScheduler(QObject *parent = nullptr);
+    ~SearchScheduler();
+
+    // The store is implicitly shared, not copied
+    void setEntries(const EntryStore &store);
+    // The store after the given entries were added, changed or removed
+    void updateEntries(const EntryStore &store, const QList<int> &entryIds);
+    // Debounced; an empty query publishes immediately
+    void search(const QString &query);
+    // Cancels pending work and wipes the snapshot and the matcher
+    void clear();
+
+    QString query() const { return m_query; }
+    void setDebounceInterval(int milliseconds);
+
+signals:
+    // An empty query comes with no matches and means "show everything"
+    void resultsReady(const QString &query, const QList<FuzzyMatcher::Match> &matches);
+
+private slots:
+    void startSearch();
+    void onSearchFinished();
+
+private:
+    // Only touched from m_pool's single thread, or after waitForDone()
+    struct Worker {
+        FuzzyMatcher matcher;
+        quint64 generation = 0;
+        quint64 revision = 0;       // Last change applied to the matcher
+    };
+
+    struct Change {
+        quint64 revision;
+        int entryId;
+    };
+
+    void cancelRunning();
+
+    QThreadPool m_pool;
+    QTimer m_debounceTimer;
+    QFutureWatcher<QList<FuzzyMatcher::Match>> *m_watcher;
+    Worker *m_worker;
+
+    EntryStore m_store;
+    quint64 m_generation;
+    // Changes made to the store since the generation began
+    QList<Change> m_changes;
+    quint64 m_revision;
+    QString m_query;
+    QString m_runningQuery;
+};
+
+#endif
@@ -1,21 +1,163 @@
 #include "database.h"
+#include "entryrecord.h"
 #include "../crypto/encryption.h"
+#include "../crypto/securearena.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
 #include <QStandardPaths>
 #include <QDir>
 #include <QVariant>
+#include <QElapsedTimer>
+#include <QUuid>
+#include <QSettings>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <iterator>
+#include <algorithm>
 
-Database::Database() {
+// Rows handed to one decryption task. Large enough to amortise scheduling and
+// context borrowing, small enough to keep every core busy on mid-sized vaults.
+static const int DecryptChunkSize = 512;
+
+// Entries sealed by one task during a bulk insert
+static const int SealChunkSize = 512;
+
+static QThreadPool *decryptionPool() {
+    // Kept apart from the global pool so callers already running there, such
+    // as the unlock pipeline, cannot starve their own decryption tasks.
+    static QThreadPool pool;
+    return &pool;
+}
+
+// One schema step. Each runs in its own transaction together with the
+// schema_version row that records it, so a vault is never left half-migrated.
+struct SchemaMigration {
+    int version;
+    const char *description;
+    bool (*apply)(QSqlQuery &query);
+};
+
+static bool createInitialSchema(QSqlQuery &query) {
+    // IF NOT EXISTS: vaults from before schema_version already have these.
+    // Legacy vaults keep their per-field passwords table until
+    // migrateLegacyEntries() runs with the master key.
+    return query.exec("CREATE TABLE IF NOT EXISTS user ("
+                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                      "master_password_hash TEXT NOT NULL, "
+                      "salt BLOB NOT NULL)")
+        // One sealed record per entry, see EntryRecord
+        && query.exec("CREATE TABLE IF NOT EXISTS passwords ("
+                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                      "record BLOB NOT NULL, "
+                      "created_at DATETIME NOT NULL, "
+                      "modified_at DATETIME NOT NULL)")
+        && query.exec("CREATE TABLE IF NOT EXISTS vault_settings ("
+                      "key TEXT PRIMARY KEY, "
+                      "value TEXT NOT NULL, "
+                      "type TEXT NOT NULL)");
+}
+
+// Entry ids are local to a vault file; the uuid names an entry across the
+// devices it is synced to
+static bool createEntryUuidIndex(QSqlQuery &query) {
+    return query.exec("CREATE UNIQUE INDEX IF NOT EXISTS passwords_uuid ON passwords (uuid)");
+}
+
+static bool addSyncIdentity(QSqlQuery &query) {
+    return query.exec("ALTER TABLE passwords ADD COLUMN uuid TEXT")
+        && query.exec("UPDATE passwords SET uuid = lower(hex(randomblob(16))) WHERE uuid IS NULL")
+        && createEntryUuidIndex(query)
+        // Local changes not yet sent to the sync backend, one row per entry
+        && query.exec("CREATE TABLE sync_outbox ("
+                      "uuid TEXT PRIMARY KEY, "
+                      "deleted INTEGER NOT NULL, "
+                      "changed_at DATETIME NOT NULL)");
+}
+
+static bool addChangeJournal(QSqlQuery &query) {
+    // Superseded by the journal; anything pending in it is sent again as the
+    // entries' current state the first time they change
+    return query.exec("DROP TABLE IF EXISTS sync_outbox")
+        // Current version of every entry ever changed, deleted ones included:
+        // the tombstones keep a deleted entry from being resurrected by an
+        // older copy arriving later
+        && query.exec("CREATE TABLE entry_clocks ("
+                      "uuid TEXT PRIMARY KEY, "
+                      "clock TEXT NOT NULL, "
+                      "writer TEXT NOT NULL, "
+                      "changed_at DATETIME NOT NULL, "
+                      "deleted INTEGER NOT NULL)")
+        // Append only: one row per change, local or merged from another device
+        && query.exec("CREATE TABLE change_journal ("
+                      "seq INTEGER PRIMARY KEY AUTOINCREMENT, "
+                      "uuid TEXT NOT NULL, "
+                      "device TEXT NOT NULL, "
+                      "clock TEXT NOT NULL, "
+                      "deleted INTEGER NOT NULL, "
+                      "changed_at DATETIME NOT NULL)");
+}
+
+static bool addKdfHeader(QSqlQuery &query) {
+    // NULL until an existing vault is next unlocked, see KdfHeader::legacy()
+    return query.exec("ALTER TABLE user ADD COLUMN kdf_header BLOB");
+}
+
+// Append only; never edit a migration that has shipped
+static const SchemaMigration SchemaMigrations[] = {
+    { 1, "initial schema", createInitialSchema },
+    { 2, "entry uuids and sync outbox", addSyncIdentity },
+    { 3, "change journal and entry clocks", addChangeJournal },
+    { 4, "kdf header", addKdfHeader },
+};
+
+// SQL of each Database::Statement, in enum order
+static const char *const StatementSql[Database::StatementCount] = {
+    // New vaults have no password hash; the header's key check replaces it
+    "INSERT INTO user (master_password_hash, salt, kdf_header) VALUES ('', ?, ?)",
+    "SELECT master_password_hash FROM user WHERE id = 1",
+    "SELECT salt, kdf_header FROM user WHERE id = 1",
+    "UPDATE user SET master_password_hash = '', salt = ?, kdf_header = ? WHERE id = 1",
+    // AUTOINCREMENT never hands out an id twice, so continue from its counter
+    "SELECT COALESCE(MAX(seq), 0) + 1 FROM sqlite_sequence WHERE name = 'passwords'",
+    "INSERT INTO passwords (id, record, created_at, modified_at, uuid) VALUES (?, ?, ?, ?, ?)",
+    "UPDATE passwords SET record = ?, modified_at = ? WHERE id = ?",
+    "DELETE FROM passwords WHERE id = ?",
+    "SELECT id, record, created_at, modified_at FROM passwords WHERE id = ?",
+    "SELECT id, record, created_at, modified_at FROM passwords",
+    "SELECT COUNT(*) FROM passwords",
+    "SELECT id, record, created_at, modified_at FROM passwords WHERE uuid = ?",
+    "SELECT uuid FROM passwords WHERE id = ?",
+    "SELECT clock, writer, changed_at, deleted FROM entry_clocks WHERE uuid = ?",
+    "INSERT OR REPLACE INTO entry_clocks (uuid, clock, writer, changed_at, deleted) "
+    "VALUES (?, ?, ?, ?, ?)",
+    "INSERT INTO change_journal (uuid, device, clock, deleted, changed_at) VALUES (?, ?, ?, ?, ?)",
+    // Range scans of the primary key: cost follows the number of changes
+    "SELECT seq, uuid, device, clock, deleted, changed_at FROM change_journal "
+    "WHERE seq > ? ORDER BY seq",
+    "SELECT seq, uuid, device, clock, deleted, changed_at FROM change_journal "
+    "WHERE seq > ? AND device = ? ORDER BY seq",
+    // INSERT OR REPLACE (SQLite specific) handles both insert and update
+    "INSERT OR REPLACE INTO vault_settings (key, value, type) VALUES (?, ?, ?)",
+    "SELECT value, type FROM vault_settings WHERE key = ?",
+    "SELECT COUNT(*) FROM vault_settings WHERE key = ?",
+    "DELETE FROM vault_settings WHERE key = ?",
+    "SELECT key FROM vault_settings",
+};
+
+Database::Database() : m_session(nullptr) {
     m_db = QSqlDatabase::addDatabase("QSQLITE");
+    std::fill(std::begin(m_statements), std::end(m_statements), nullptr);
+    std::fill(std::begin(m_prepared), std::end(m_prepared), false);
+    std::fill(std::begin(m_bound), std::end(m_bound), false);
+    resetStatementStats();
 }
 
 Database::~Database() {
     close();
 }
 
-bool Database::open(const QString &path) {
+bool Database::open(const QString &path, const StorageOptions &options) {
     QString dbPath = path;
     if (dbPath.isEmpty()) {
         QString dataDir = QStandardPaths::writableLocation(
@@ -25,16 +167,35 @@ bool Database::open(const QString &path) {
     }
 
     m_db.setDatabaseName(dbPath);
+    m_options = options;
+    resetStatementStats();
     
     if (!m_db.open()) {
         qDebug() << "Failed to open database:" << m_db.lastError().text();
         return false;
     }
 
-    return createTables();
+    if (!applyStorageOptions() || !migrateSchema()) {
+        m_db.close();
+        return false;
+    }
+    
+    return true;
 }
 
 void Database::close() {
+    delete m_session;
+    m_session = nullptr;
+    
+    for (const StatementStats &stats : statementStats()) {
+        if (stats.calls > 0) {
+            qDebug() << "Statement" << stats.sql << ":" << stats.calls << "calls," 
+                     << stats.totalNanoseconds / 1000000.0 << "ms";
+        }
+    }
+    // Statements must be finalized before the connection can close cleanly
+    releaseStatements();
+    
     if (m_db.isOpen()) {
         m_db.close();
     }
@@ -44,174 +205,1042 @@ bool Database::isOpen() const {
     return m_db.isOpen();
 }
 
-bool Database::createTables() {
+bool Database::applyStorageOptions() {
     QSqlQuery query(m_db);
-
-    // User table
-    if (!query.exec("CREATE TABLE IF NOT EXISTS user ("
-                   "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                   "master_password_hash TEXT NOT NULL, "
-                   "salt BLOB NOT NULL)")) {
-        qDebug() << "Failed to create user table:" << query.lastError().text();
+    
+    // page_size has to come first: it only takes effect before the first
+    // table is written, and is silently ignored afterwards
+    if (!query.exec(QString("PRAGMA page_size = %1").arg(m_options.pageSize))) {
+        qWarning() << "Failed to set page size:" << query.lastError().text();
         return false;
     }
-
-    // Passwords table
-    if (!query.exec("CREATE TABLE IF NOT EXISTS passwords ("
-                   "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                   "title_encrypted BLOB NOT NULL, "
-                   "username_encrypted BLOB NOT NULL, "
-                   "password_encrypted BLOB NOT NULL, "
-                   "url_encrypted BLOB, "
-                   "notes_encrypted BLOB, "
-                   "created_at DATETIME NOT NULL, "
-                   "modified_at DATETIME NOT NULL)")) {
-        qDebug() << "Failed to create passwords table:" << query.lastError().text();
+    
+    // journal_mode reports the mode actually in effect; WAL is refused on
+    // some filesystems, in which case the vault still works with the
+    // rollback journal
+    QString journalMode = m_options.journalMode == StorageOptions::WriteAheadLog 
+                          ? "wal" : "delete";
+    if (!query.exec("PRAGMA journal_mode = " + journalMode) || !query.next()) {
+        qWarning() << "Failed to set journal mode:" << query.lastError().text();
         return false;
     }
-
-    // Settings table - stores vault-specific settings
-    if (!query.exec("CREATE TABLE IF NOT EXISTS vault_settings ("
-                   "key TEXT PRIMARY KEY, "
-                   "value TEXT NOT NULL, "
-                   "type TEXT NOT NULL)")) {
-        qDebug() << "Failed to create vault_settings table:" << query.lastError().text();
+    if (query.value(0).toString().toLower() != journalMode) {
+        qWarning() << "Journal mode" << journalMode << "unavailable, using" 
+                   << query.value(0).toString();
+    }
+    query.finish();
+    
+    // Negative cache_size is in KiB rather than pages
+    if (!query.exec(QString("PRAGMA cache_size = %1").arg(-m_options.cacheSizeKiB)) ||
+        !query.exec(QString("PRAGMA mmap_size = %1").arg(m_options.mmapSize))) {
+        qWarning() << "Failed to configure page cache:" << query.lastError().text();
         return false;
     }
+    query.finish();
+    
+    return setWriteMode(InteractiveWrites);
+}
 
-    qDebug() << "Database tables created/verified successfully";
+bool Database::setWriteMode(WriteMode mode) {
+    StorageOptions::Synchronous level = mode == BulkWrites ? m_options.bulkSync 
+                                                           : m_options.interactiveSync;
+    
+    QSqlQuery query(m_db);
+    if (!query.exec(QString("PRAGMA synchronous = %1").arg(int(level)))) {
+        qWarning() << "Failed to set synchronous level:" << query.lastError().text();
+        return false;
+    }
+    
     return true;
 }
 
-bool Database::createUser(const QString &masterPasswordHash, 
-                         const QByteArray &salt) {
+int Database::schemaVersion() {
+    // schema_version is created by the first migration run, so a vault
+    // without it is at version 0
     QSqlQuery query(m_db);
-    query.prepare("INSERT INTO user (master_password_hash, salt) VALUES (?, ?)");
-    query.addBindValue(masterPasswordHash);
-    query.addBindValue(salt);
+    if (!query.exec("SELECT MAX(version) FROM schema_version") || !query.next()) {
+        return 0;
+    }
     
-    return query.exec();
+    return query.value(0).toInt();
+}
+
+bool Database::migrateSchema() {
+    const int latest = SchemaMigrations[std::size(SchemaMigrations) - 1].version;
+    int version = schemaVersion();
+    
+    // The common case: one indexed read and no DDL
+    if (version == latest) {
+        return true;
+    }
+    
+    if (version > latest) {
+        qWarning() << "Vault schema version" << version 
+                   << "is newer than this build supports (" << latest << ")";
+        return false;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    for (const SchemaMigration &migration : SchemaMigrations) {
+        if (migration.version <= version) continue;
+        
+        if (!m_db.transaction()) {
+            return false;
+        }
+        
+        QSqlQuery query(m_db);
+        bool ok = query.exec("CREATE TABLE IF NOT EXISTS schema_version ("
+                            "version INTEGER PRIMARY KEY, "
+                            "description TEXT NOT NULL, "
+                            "applied_at DATETIME NOT NULL)")
+               && migration.apply(query);
+        
+        QSqlQuery record(m_db);
+        ok = ok && record.prepare("INSERT INTO schema_version (version, description, applied_at) "
+                                 "VALUES (?, ?, ?)");
+        record.addBindValue(migration.version);
+        record.addBindValue(QString(migration.description));
+        record.addBindValue(QDateTime::currentDateTime());
+        ok = ok && record.exec();
+        
+        if (!ok) {
+            qWarning() << "Schema migration to version" << migration.version << "failed:"
+                       << query.lastError().text() << record.lastError().text();
+            m_db.rollback();
+            return false;
+        }
+        
+        if (!m_db.commit()) {
+            return false;
+        }
+        version = migration.version;
+    }
+    
+    qDebug() << "Migrated vault schema to version" << version << "in" 
+             << timer.elapsed() << "ms";
+    return true;
+}
+
+void Database::releaseStatements() {
+    for (QSqlQuery *&query : m_statements) {
+        delete query;
+        query = nullptr;
+    }
+    std::fill(std::begin(m_prepared), std::end(m_prepared), false);
+    std::fill(std::begin(m_bound), std::end(m_bound), false);
+}
+
+QSqlQuery &Database::statement(Statement id) const {
+    // Prepared on first use rather than on open: a legacy vault's passwords
+    // table lacks the columns until migrateLegacyEntries() has run
+    if (!m_statements[id]) {
+        m_statements[id] = new QSqlQuery(m_db);
+        // Results are walked once, so Qt need not cache rows for seeking
+        m_statements[id]->setForwardOnly(true);
+    }
+    if (m_bound[id]) {
+        // The last caller bailed out between statement() and exec(). Qt only
+        // rewinds positional binds on exec, so its values would shift ours;
+        // preparing again drops them.
+        m_prepared[id] = false;
+    }
+    if (!m_prepared[id]) {
+        // On failure exec() fails too and the caller reports it; the next
+        // use tries again
+        m_prepared[id] = m_statements[id]->prepare(StatementSql[id]);
+        if (!m_prepared[id]) {
+            qWarning() << "Failed to prepare" << StatementSql[id] << ":" 
+                       << m_statements[id]->lastError().text();
+        }
+    }
+    
+    // Callers finish() SELECTs once read so no read snapshot outlives the
+    // call; this only guards against one that was left open
+    QSqlQuery &query = *m_statements[id];
+    query.finish();
+    m_bound[id] = true;
+    return query;
+}
+
+bool Database::exec(Statement id) const {
+    QElapsedTimer timer;
+    timer.start();
+    
+    bool ok = m_statements[id]->exec();
+    m_bound[id] = false;
+    
+    m_statementNanoseconds[id] += timer.nsecsElapsed();
+    ++m_statementCalls[id];
+    return ok;
+}
+
+QList<Database::StatementStats> Database::statementStats() const {
+    QList<StatementStats> stats;
+    stats.reserve(StatementCount);
+    
+    for (int i = 0; i < StatementCount; ++i) {
+        StatementStats entry;
+        entry.statement = Statement(i);
+        entry.sql = StatementSql[i];
+        entry.calls = m_statementCalls[i];
+        entry.totalNanoseconds = m_statementNanoseconds[i];
+        stats.append(entry);
+    }
+    
+    return stats;
+}
+
+void Database::resetStatementStats() {
+    std::fill(std::begin(m_statementCalls), std::end(m_statementCalls), 0);
+    std::fill(std::begin(m_statementNanoseconds), std::end(m_statementNanoseconds), 0);
+}
+
+bool Database::createUser(const KdfHeader &header) {
+    QByteArray headerBytes = header.toByteArray();
+    if (headerBytes.isEmpty()) {
+        qWarning() << "Refusing to create a user without a key check";
+        return false;
+    }
+    
+    QSqlQuery &query = statement(InsertUser);
+    query.addBindValue(header.salt());
+    query.addBindValue(headerBytes);
+    
+    return exec(InsertUser);
 }
 
 bool Database::verifyUser(const QString &masterPasswordHash) {
-    QSqlQuery query(m_db);
-    query.prepare("SELECT master_password_hash FROM user WHERE id = 1");
+    QSqlQuery &query = statement(SelectPasswordHash);
     
-    if (!query.exec() || !query.next()) {
+    if (!exec(SelectPasswordHash) || !query.next()) {
         return false;
     }
     
-    return query.value(0).toString() == masterPasswordHash;
+    QString storedHash = query.value(0).toString();
+    query.finish();
+    // An empty hash belongs to a vault that has a key check instead
+    return !storedHash.isEmpty() && storedHash == masterPasswordHash;
 }
 
-QByteArray Database::getUserSalt() {
-    QSqlQuery query(m_db);
-    query.prepare("SELECT salt FROM user WHERE id = 1");
+KdfHeader Database::getKdfHeader() {
+    QSqlQuery &query = statement(SelectKdfHeader);
+    
+    if (!exec(SelectKdfHeader) || !query.next()) {
+        return KdfHeader();
+    }
     
-    if (!query.exec() || !query.next()) {
-        return QByteArray();
+    QByteArray salt = query.value(0).toByteArray();
+    QVariant headerBytes = query.value(1);
+    query.finish();
+    
+    if (headerBytes.isNull()) {
+        return salt.isEmpty() ? KdfHeader() : KdfHeader::legacy(salt);
+    }
+    return KdfHeader::fromByteArray(headerBytes.toByteArray());
+}
+
+bool Database::setKdfHeader(const KdfHeader &header) {
+    QByteArray headerBytes = header.toByteArray();
+    if (headerBytes.isEmpty()) {
+        return false;
     }
     
-    return query.value(0).toByteArray();
+    QSqlQuery &query = statement(UpdateKdfHeader);
+    query.addBindValue(header.salt());
+    query.addBindValue(headerBytes);
+    
+    return exec(UpdateKdfHeader);
 }
 
-bool Database::addEntry(const PasswordEntry &entry, const QByteArray &masterKey) {
-    QSqlQuery query(m_db);
-    query.prepare("INSERT INTO passwords (title_encrypted, username_encrypted, "
-                 "password_encrypted, url_encrypted, notes_encrypted, "
-                 "created_at, modified_at) VALUES (?, ?, ?, ?, ?, ?, ?)");
-    
-    query.addBindValue(Encryption::encrypt(entry.title().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.username().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.password().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.url().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.notes().toUtf8(), masterKey));
+bool Database::addEntry(PasswordEntry &entry, const QByteArray &masterKey) {
+    // The id is sealed into the record, so it has to be known before insert
+    if (!m_db.transaction()) {
+        return false;
+    }
+    
+    int id = nextEntryId();
+    QByteArray record = id > 0 ? EntryRecord::seal(entry, id, session(masterKey)) : QByteArray();
+    if (record.isEmpty()) {
+        m_db.rollback();
+        return false;
+    }
+    
+    QSqlQuery &query = statement(InsertEntry);
+    query.addBindValue(id);
+    query.addBindValue(record);
     query.addBindValue(entry.created());
     query.addBindValue(entry.modified());
+    const QString uuid = newEntryUuid();
+    query.addBindValue(uuid);
+    
+    if (!exec(InsertEntry) || !journalChange(uuid, false)) {
+        qWarning() << "Failed to add entry:" << query.lastError().text();
+        m_db.rollback();
+        return false;
+    }
     
-    return query.exec();
+    if (!m_db.commit()) {
+        return false;
+    }
+    
+    entry.setId(id);
+    return true;
 }
 
-bool Database::updateEntry(const PasswordEntry &entry, const QByteArray &masterKey) {
-    QSqlQuery query(m_db);
-    query.prepare("UPDATE passwords SET title_encrypted = ?, username_encrypted = ?, "
-                 "password_encrypted = ?, url_encrypted = ?, notes_encrypted = ?, "
-                 "modified_at = ? WHERE id = ?");
-    
-    query.addBindValue(Encryption::encrypt(entry.title().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.username().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.password().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.url().toUtf8(), masterKey));
-    query.addBindValue(Encryption::encrypt(entry.notes().toUtf8(), masterKey));
-    query.addBindValue(QDateTime::currentDateTime());
+bool Database::updateEntry(PasswordEntry &entry, const QByteArray &masterKey) {
+    QByteArray record = EntryRecord::seal(entry, entry.id(), session(masterKey));
+    if (record.isEmpty() || !m_db.transaction()) {
+        return false;
+    }
+    
+    QDateTime modified = QDateTime::currentDateTime();
+    
+    QSqlQuery &query = statement(UpdateEntry);
+    query.addBindValue(record);
+    query.addBindValue(modified);
     query.addBindValue(entry.id());
     
-    return query.exec();
+    if (!exec(UpdateEntry) || query.numRowsAffected() != 1 || 
+        !journalChange(entryUuid(entry.id()), false) || !m_db.commit()) {
+        m_db.rollback();
+        return false;
+    }
+    
+    entry.setModified(modified);
+    return true;
+}
+
+bool Database::addEntries(QList<PasswordEntry> &entries, const QByteArray &masterKey,
+                          const Encryption::ProgressCallback &progress) {
+    if (entries.isEmpty()) {
+        return true;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    // One commit for the whole batch, and that commit need not be fully
+    // synced: WAL keeps the vault consistent if the import is cut short
+    setWriteMode(BulkWrites);
+    if (!m_db.transaction()) {
+        setWriteMode(InteractiveWrites);
+        return false;
+    }
+    
+    // Ids are sealed into the records, so the whole range is reserved up
+    // front. Nothing else writes while the transaction is open.
+    const int firstId = nextEntryId();
+    const int total = entries.size();
+    
+    // Sealing runs ahead on the pool; the loop below only waits when it
+    // catches up with the encryption
+    const Encryption::Session *recordSession = &session(masterKey);
+    QList<QFuture<QList<QByteArray>>> chunks;
+    if (firstId > 0) {
+        for (int offset = 0; offset < total; offset += SealChunkSize) {
+            QList<PasswordEntry> chunk = entries.mid(offset, SealChunkSize);
+            chunks.append(QtConcurrent::run(decryptionPool(), 
+                [chunk, id = firstId + offset, recordSession]() { 
+                    return sealChunk(chunk, id, *recordSession); 
+                }));
+        }
+    }
+    
+    QSqlQuery &insert = statement(InsertEntry);
+    bool ok = firstId > 0;
+    
+    int inserted = 0;
+    for (QFuture<QList<QByteArray>> &chunk : chunks) {
+        if (!ok) break;
+        
+        const QList<QByteArray> records = chunk.result();
+        for (const QByteArray &record : records) {
+            if (record.isEmpty()) {
+                qWarning() << "Failed to seal entry" << inserted << "of batch";
+                ok = false;
+                break;
+            }
+            
+            const PasswordEntry &entry = entries[inserted];
+            insert.addBindValue(firstId + inserted);
+            insert.addBindValue(record);
+            insert.addBindValue(entry.created());
+            insert.addBindValue(entry.modified());
+            const QString uuid = newEntryUuid();
+            insert.addBindValue(uuid);
+            if (!exec(InsertEntry) || !journalChange(uuid, false)) {
+                qWarning() << "Failed to add entry" << inserted << "of batch:" 
+                           << insert.lastError().text();
+                ok = false;
+                break;
+            }
+            ++inserted;
+        }
+        
+        if (ok && progress && !progress(inserted, total)) {
+            qDebug() << "Bulk insert cancelled after" << inserted << "of" << total << "entries";
+            ok = false;
+        }
+    }
+    
+    // The tasks hold the cached session by pointer, so none may outlive this call
+    for (QFuture<QList<QByteArray>> &chunk : chunks) {
+        chunk.cancel();
+        chunk.waitForFinished();
+    }
+    
+    ok = ok && m_db.commit();
+    if (!ok) {
+        m_db.rollback();
+    }
+    setWriteMode(InteractiveWrites);
+    
+    if (!ok) {
+        return false;
+    }
+    
+    for (int i = 0; i < total; ++i) {
+        entries[i].setId(firstId + i);
+    }
+    
+    qDebug() << "Added" << total << "entries in" << timer.elapsed() << "ms";
+    return true;
+}
+
+QList<QByteArray> Database::sealChunk(const QList<PasswordEntry> &entries, int firstId,
+                                      const Encryption::Session &session) {
+    QList<QByteArray> records;
+    records.reserve(entries.size());
+    
+    for (int i = 0; i < entries.size(); ++i) {
+        records.append(EntryRecord::seal(entries[i], firstId + i, session));
+    }
+    
+    return records;
 }
 
 bool Database::deleteEntry(int id) {
-    QSqlQuery query(m_db);
-    query.prepare("DELETE FROM passwords WHERE id = ?");
+    // Looked up first: the tombstone needs the uuid of the row
+    const QString uuid = entryUuid(id);
+    if (!m_db.transaction()) {
+        return false;
+    }
+    
+    QSqlQuery &query = statement(DeleteEntry);
     query.addBindValue(id);
     
-    return query.exec();
+    if (!exec(DeleteEntry) || !journalChange(uuid, true) || !m_db.commit()) {
+        m_db.rollback();
+        return false;
+    }
+    return true;
 }
 
 QList<PasswordEntry> Database::getAllEntries(const QByteArray &masterKey) {
+    return loadEntries(masterKey, EntryRecord::All);
+}
+
+QList<PasswordEntry> Database::getEntrySummaries(const QByteArray &masterKey) {
+    return loadEntries(masterKey, EntryRecord::Summary);
+}
+
+QList<PasswordEntry> Database::loadEntries(const QByteArray &masterKey, 
+                                           EntryRecord::Parts parts) {
+    QElapsedTimer timer;
+    timer.start();
+    const size_t allocationsBefore = SecureArena::instance().allocationCount();
+    
+    // Two-stage pipeline: rows stream out of SQLite on this thread and every
+    // full chunk is decrypted on the pool while the next one is being read.
+    const Encryption::Session *rowSession = &session(masterKey);
+    QList<QFuture<QList<PasswordEntry>>> chunks;
+    QList<EncryptedRow> buffer;
+    buffer.reserve(DecryptChunkSize);
+    qsizetype rowCount = 0;
+    
+    auto submit = [&]() {
+        // Counted before the buffer is moved into the task
+        rowCount += buffer.size();
+        chunks.append(QtConcurrent::run(decryptionPool(), 
+            [rows = std::move(buffer), rowSession, parts]() { return decryptChunk(rows, *rowSession, parts); }));
+        buffer.clear();
+        buffer.reserve(DecryptChunkSize);
+    };
+    
+    QSqlQuery &query = statement(SelectAllEntries);
+    if (exec(SelectAllEntries)) {
+        while (query.next()) {
+            buffer.append(readEncryptedRow(query));
+            if (buffer.size() == DecryptChunkSize) {
+                submit();
+            }
+        }
+    }
+    query.finish();
+    
     QList<PasswordEntry> entries;
-    QSqlQuery query(m_db);
+    if (chunks.isEmpty()) {
+        // Small vault, not worth a thread hop
+        rowCount = buffer.size();
+        entries = decryptChunk(buffer, *rowSession, parts);
+    } else {
+        if (!buffer.isEmpty()) {
+            submit();
+        }
+        entries.reserve(rowCount);
+        // Taken rather than copied: a copy of each entry would duplicate
+        // its secrets
+        for (QFuture<QList<PasswordEntry>> &chunk : chunks) {
+            entries.append(chunk.takeResult());
+        }
+    }
     
-    if (!query.exec("SELECT id, title_encrypted, username_encrypted, "
-                   "password_encrypted, url_encrypted, notes_encrypted, "
-                   "created_at, modified_at FROM passwords")) {
-        return entries;
+    qDebug() << "Loaded" << rowCount << "entries in" << timer.elapsed() << "ms on"
+             << decryptionThreadCount() << "decryption threads,"
+             << SecureArena::instance().allocationCount() - allocationsBefore
+             << "secure allocations";
+    return entries;
+}
+
+const Encryption::Session &Database::session(const QByteArray &masterKey) {
+    // Keep the expanded key around for as long as the same key is in use
+    if (!m_session || !m_session->hasKey(masterKey)) {
+        delete m_session;
+        m_session = new Encryption::Session(masterKey);
+    }
+    return *m_session;
+}
+
+PasswordEntry Database::getEntry(int id, const QByteArray &masterKey, 
+                                 EntryRecord::Parts parts) {
+    QSqlQuery &query = statement(SelectEntry);
+    query.addBindValue(id);
+    
+    if (!exec(SelectEntry) || !query.next()) {
+        return PasswordEntry();
     }
     
+    EncryptedRow row = readEncryptedRow(query);
+    query.finish();
+    return decryptRow(row, session(masterKey), parts);
+}
+
+bool Database::forEachEntry(const QByteArray &masterKey, const EntryVisitor &visit,
+                            int *skipped) {
+    const Encryption::Session &rowSession = session(masterKey);
+    QSqlQuery &query = statement(SelectAllEntries);
+    if (!exec(SelectAllEntries)) {
+        qWarning() << "Failed to read entries:" << query.lastError().text();
+        return false;
+    }
+    
+    PasswordEntry entry;
+    bool completed = true;
+    int failures = 0;
     while (query.next()) {
-        PasswordEntry entry;
-        entry.setId(query.value(0).toInt());
-        entry.setTitle(QString::fromUtf8(
-            Encryption::decrypt(query.value(1).toByteArray(), masterKey)));
-        entry.setUsername(QString::fromUtf8(
-            Encryption::decrypt(query.value(2).toByteArray(), masterKey)));
-        entry.setPassword(QString::fromUtf8(
-            Encryption::decrypt(query.value(3).toByteArray(), masterKey)));
-        entry.setUrl(QString::fromUtf8(
-            Encryption::decrypt(query.value(4).toByteArray(), masterKey)));
-        entry.setNotes(QString::fromUtf8(
-            Encryption::decrypt(query.value(5).toByteArray(), masterKey)));
+        int id = query.value(0).toInt();
+        entry = PasswordEntry(id, query.value(2).toDateTime(), query.value(3).toDateTime());
+        if (!EntryRecord::open(query.value(1).toByteArray(), id, rowSession, entry)) {
+            ++failures;
+            continue;
+        }
         
+        if (!visit(entry)) {
+            completed = false;
+            break;
+        }
+    }
+    query.finish();
+    
+    if (failures > 0) {
+        qWarning() << "Skipped" << failures << "records that failed to open";
+    }
+    if (skipped) *skipped = failures;
+    return completed;
+}
+
+int Database::entryCount() {
+    QSqlQuery &query = statement(CountEntries);
+    if (!exec(CountEntries) || !query.next()) {
+        return 0;
+    }
+    
+    int count = query.value(0).toInt();
+    query.finish();
+    return count;
+}
+
+QList<Database::EncryptedRow> Database::getEncryptedRows() {
+    QList<EncryptedRow> rows;
+    QSqlQuery &query = statement(SelectAllEntries);
+    
+    if (!exec(SelectAllEntries)) {
+        return rows;
+    }
+    
+    while (query.next()) {
+        rows.append(readEncryptedRow(query));
+    }
+    query.finish();
+    
+    return rows;
+}
+
+Database::EncryptedRow Database::readEncryptedRow(const QSqlQuery &query) {
+    EncryptedRow row;
+    row.id = query.value(0).toInt();
+    row.record = query.value(1).toByteArray();
+    row.created = query.value(2).toDateTime();
+    row.modified = query.value(3).toDateTime();
+    return row;
+}
+
+PasswordEntry Database::decryptRow(const EncryptedRow &row, const Encryption::Session &session,
+                                   EntryRecord::Parts parts) {
+    PasswordEntry entry(row.id, row.created, row.modified);
+    
+    if (!EntryRecord::open(row.record, row.id, session, entry, parts)) {
+        qWarning() << "Failed to open record for entry" << row.id;
+    }
+    
+    return entry;
+}
+
+QList<PasswordEntry> Database::decryptChunk(const QList<EncryptedRow> &rows,
+                                            const Encryption::Session &session,
+                                            EntryRecord::Parts parts) {
+    QList<QByteArray> records;
+    QList<PasswordEntry> entries;
+    records.reserve(rows.size());
+    entries.reserve(rows.size());
+    
+    for (const EncryptedRow &row : rows) {
+        records.append(row.record);
+        entries.append(PasswordEntry(row.id, row.created, row.modified));
+    }
+    
+    int failures = EntryRecord::openBatch(records, session, entries, parts);
+    if (failures > 0) {
+        qWarning() << "Failed to open" << failures << "of" << rows.size() << "records";
+    }
+    
+    return entries;
+}
+
+QList<PasswordEntry> Database::decryptRows(const QList<EncryptedRow> &rows,
+                                           const QByteArray &masterKey,
+                                           EntryRecord::Parts parts) {
+    QElapsedTimer timer;
+    timer.start();
+    const size_t allocationsBefore = SecureArena::instance().allocationCount();
+    
+    // A private session, as this may run on a worker thread. It is shared by
+    // all chunk tasks, each of which borrows its own cipher context.
+    Encryption::Session rowSession(masterKey);
+    
+    QList<PasswordEntry> entries;
+    if (rows.size() <= DecryptChunkSize) {
+        entries = decryptChunk(rows, rowSession, parts);
+    } else {
+        QList<QFuture<QList<PasswordEntry>>> chunks;
+        for (qsizetype offset = 0; offset < rows.size(); offset += DecryptChunkSize) {
+            QList<EncryptedRow> chunk = rows.mid(offset, DecryptChunkSize);
+            chunks.append(QtConcurrent::run(decryptionPool(), 
+                [chunk, &rowSession, parts]() { return decryptChunk(chunk, rowSession, parts); }));
+        }
+        
+        entries.reserve(rows.size());
+        // Taken rather than copied: a copy of each entry would duplicate
+        // its secrets
+        for (QFuture<QList<PasswordEntry>> &chunk : chunks) {
+            entries.append(chunk.takeResult());
+        }
+    }
+    
+    qint64 elapsed = timer.nsecsElapsed();
+    qDebug() << "Decrypted" << rows.size() << "entries in" << elapsed / 1000000.0 << "ms"
+             << "(" << (rows.isEmpty() ? 0.0 : elapsed / 1000.0 / rows.size()) << "us/entry,"
+             << decryptionThreadCount() << "threads,"
+             << SecureArena::instance().allocationCount() - allocationsBefore
+             << "secure allocations )";
+    
+    return entries;
+}
+
+int Database::decryptionThreadCount() {
+    return decryptionPool()->maxThreadCount();
+}
+
+void Database::setDecryptionThreadCount(int count) {
+    decryptionPool()->setMaxThreadCount(qMax(1, count));
+}
+
+int Database::nextEntryId() {
+    QSqlQuery &query = statement(NextEntryId);
+    if (!exec(NextEntryId) || !query.next()) {
+        qWarning() << "Failed to reserve entry id:" << query.lastError().text();
+        return -1;
+    }
+    
+    int id = query.value(0).toInt();
+    query.finish();
+    return id;
+}
+
+// ========== Change Journal ==========
+
+QString Database::deviceId() {
+    // Application settings rather than the vault, so a copied vault does
+    // not bring the device id of its origin along
+    static const QString id = []() {
+        QSettings settings;
+        QString stored = settings.value("sync/deviceId").toString();
+        if (stored.isEmpty()) {
+            stored = QUuid::createUuid().toString(QUuid::Id128);
+            settings.setValue("sync/deviceId", stored);
+        }
+        return stored;
+    }();
+    return id;
+}
+
+QString Database::newEntryUuid() {
+    // Same form as the uuids migration 2 backfilled
+    return QUuid::createUuid().toString(QUuid::Id128);
+}
+
+QString Database::entryUuid(int id) {
+    QSqlQuery &query = statement(SelectEntryUuid);
+    query.addBindValue(id);
+    
+    if (!exec(SelectEntryUuid) || !query.next()) {
+        return QString();
+    }
+    
+    QString uuid = query.value(0).toString();
+    query.finish();
+    return uuid;
+}
+
+bool Database::journalChange(const QString &uuid, bool deleted) {
+    if (uuid.isEmpty()) {
+        return false;
+    }
+    
+    // An entry that was never journaled starts from the empty clock, which
+    // every other version descends from
+    EntryVersion version;
+    entryVersion(uuid, version);
+    version.clock.increment(deviceId());
+    version.writer = deviceId();
+    version.changed = QDateTime::currentDateTimeUtc();
+    version.deleted = deleted;
+    
+    return recordVersion(uuid, version, deviceId());
+}
+
+bool Database::recordVersion(const QString &uuid, const EntryVersion &version,
+                             const QString &device) {
+    const QString clock = version.clock.toString();
+    
+    QSqlQuery &upsert = statement(UpsertEntryVersion);
+    upsert.addBindValue(uuid);
+    upsert.addBindValue(clock);
+    upsert.addBindValue(version.writer);
+    upsert.addBindValue(version.changed);
+    upsert.addBindValue(version.deleted ? 1 : 0);
+    if (!exec(UpsertEntryVersion)) {
+        qWarning() << "Failed to record version of entry" << uuid << ":" 
+                   << upsert.lastError().text();
+        return false;
+    }
+    
+    QSqlQuery &append = statement(AppendJournal);
+    append.addBindValue(uuid);
+    append.addBindValue(device);
+    append.addBindValue(clock);
+    append.addBindValue(version.deleted ? 1 : 0);
+    append.addBindValue(version.changed);
+    if (!exec(AppendJournal)) {
+        qWarning() << "Failed to journal change of entry" << uuid << ":" 
+                   << append.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool Database::entryVersion(const QString &uuid, EntryVersion &version) {
+    QSqlQuery &query = statement(SelectEntryVersion);
+    query.addBindValue(uuid);
+    
+    if (!exec(SelectEntryVersion) || !query.next()) {
+        version = EntryVersion();
+        return false;
+    }
+    
+    version.clock = VectorClock::fromString(query.value(0).toString());
+    version.writer = query.value(1).toString();
+    version.changed = query.value(2).toDateTime();
+    version.deleted = query.value(3).toInt() != 0;
+    query.finish();
+    return true;
+}
+
+bool Database::setEntryVersion(const QString &uuid, const EntryVersion &version,
+                               const QString &device) {
+    return recordVersion(uuid, version, device);
+}
+
+QList<Database::JournalEntry> Database::journalSince(qint64 sequence, const QString &device) {
+    QList<JournalEntry> entries;
+    const Statement id = device.isEmpty() ? SelectJournalSince : SelectJournalSinceForDevice;
+    QSqlQuery &query = statement(id);
+    query.addBindValue(sequence);
+    if (!device.isEmpty()) {
+        query.addBindValue(device);
+    }
+    
+    if (!exec(id)) {
+        qWarning() << "Failed to read the change journal:" << query.lastError().text();
+        return entries;
+    }
+    
+    while (query.next()) {
+        JournalEntry entry;
+        entry.sequence = query.value(0).toLongLong();
+        entry.uuid = query.value(1).toString();
+        entry.device = query.value(2).toString();
+        entry.clock = VectorClock::fromString(query.value(3).toString());
+        entry.deleted = query.value(4).toInt() != 0;
+        entry.changed = query.value(5).toDateTime();
         entries.append(entry);
     }
+    query.finish();
     
     return entries;
 }
 
-PasswordEntry Database::getEntry(int id, const QByteArray &masterKey) {
+int Database::entryIdForUuid(const QString &uuid, EncryptedRow *row) {
+    QSqlQuery &query = statement(SelectEntryByUuid);
+    query.addBindValue(uuid);
+    
+    if (!exec(SelectEntryByUuid) || !query.next()) {
+        return 0;
+    }
+    
+    EncryptedRow found = readEncryptedRow(query);
+    query.finish();
+    if (row) {
+        *row = found;
+    }
+    return found.id;
+}
+
+bool Database::getEntryByUuid(const QString &uuid, const QByteArray &masterKey, 
+                              PasswordEntry &entry) {
+    EncryptedRow row;
+    if (entryIdForUuid(uuid, &row) <= 0) {
+        return false;
+    }
+    
+    entry = PasswordEntry(row.id, row.created, row.modified);
+    return EntryRecord::open(row.record, row.id, session(masterKey), entry);
+}
+
+bool Database::putSyncedEntry(const QString &uuid, PasswordEntry &entry, 
+                              const QByteArray &masterKey, const EntryVersion &version) {
+    int id = entryIdForUuid(uuid);
+    
+    if (id > 0) {
+        QByteArray record = EntryRecord::seal(entry, id, session(masterKey));
+        if (record.isEmpty()) {
+            return false;
+        }
+        
+        QSqlQuery &query = statement(UpdateEntry);
+        query.addBindValue(record);
+        // Keeps the remote timestamp, as shown in the entry list
+        query.addBindValue(entry.modified());
+        query.addBindValue(id);
+        if (!exec(UpdateEntry)) {
+            qWarning() << "Failed to update synced entry:" << query.lastError().text();
+            return false;
+        }
+    } else {
+        id = nextEntryId();
+        QByteArray record = id > 0 ? EntryRecord::seal(entry, id, session(masterKey)) 
+                                   : QByteArray();
+        if (record.isEmpty()) {
+            return false;
+        }
+        
+        QSqlQuery &query = statement(InsertEntry);
+        query.addBindValue(id);
+        query.addBindValue(record);
+        query.addBindValue(entry.created());
+        query.addBindValue(entry.modified());
+        query.addBindValue(uuid);
+        if (!exec(InsertEntry)) {
+            qWarning() << "Failed to add synced entry:" << query.lastError().text();
+            return false;
+        }
+    }
+    
+    if (!recordVersion(uuid, version, version.writer)) {
+        return false;
+    }
+    
+    entry.setId(id);
+    return true;
+}
+
+int Database::deleteSyncedEntry(const QString &uuid, const EntryVersion &version) {
+    // The tombstone is kept even if the entry never made it here
+    int id = entryIdForUuid(uuid);
+    if (id > 0) {
+        QSqlQuery &query = statement(DeleteEntry);
+        query.addBindValue(id);
+        if (!exec(DeleteEntry)) {
+            return -1;
+        }
+    }
+    
+    return recordVersion(uuid, version, version.writer) ? id : -1;
+}
+
+bool Database::beginTransaction() {
+    return m_db.transaction();
+}
+
+bool Database::commitTransaction() {
+    return m_db.commit();
+}
+
+void Database::rollbackTransaction() {
+    m_db.rollback();
+}
+
+// ========== Legacy Format Migration ==========
+
+// One AES-CBC column of a legacy row; empty if it does not decrypt
+// ok is cleared if a field has ciphertext that does not decrypt; an empty
+// column is an empty field
+static SecureString decryptLegacyField(const QVariant &column, const QByteArray &masterKey,
+                                       bool *ok) {
+    const QByteArray ciphertext = column.toByteArray();
+    SecureBuffer plaintext;
+    if (!ciphertext.isEmpty() && !Encryption::decrypt(ciphertext, masterKey, plaintext)) {
+        *ok = false;
+    }
+    return SecureString::fromUtf8(plaintext.constData(), plaintext.size());
+}
+
+bool Database::hasLegacyEntries() {
     QSqlQuery query(m_db);
-    query.prepare("SELECT id, title_encrypted, username_encrypted, "
-                 "password_encrypted, url_encrypted, notes_encrypted, "
-                 "created_at, modified_at FROM passwords WHERE id = ?");
-    query.addBindValue(id);
+    if (!query.exec("PRAGMA table_info(passwords)")) {
+        return false;
+    }
     
-    PasswordEntry entry;
-    if (!query.exec() || !query.next()) {
-        return entry;
-    }
-    
-    entry.setId(query.value(0).toInt());
-    entry.setTitle(QString::fromUtf8(
-        Encryption::decrypt(query.value(1).toByteArray(), masterKey)));
-    entry.setUsername(QString::fromUtf8(
-        Encryption::decrypt(query.value(2).toByteArray(), masterKey)));
-    entry.setPassword(QString::fromUtf8(
-        Encryption::decrypt(query.value(3).toByteArray(), masterKey)));
-    entry.setUrl(QString::fromUtf8(
-        Encryption::decrypt(query.value(4).toByteArray(), masterKey)));
-    entry.setNotes(QString::fromUtf8(
-        Encryption::decrypt(query.value(5).toByteArray(), masterKey)));
+    while (query.next()) {
+        if (query.value(1).toString() == "title_encrypted") {
+            return true;
+        }
+    }
     
-    return entry;
+    return false;
+}
+
+bool Database::migrateLegacyEntries(const QByteArray &masterKey, QString *error) {
+    if (!hasLegacyEntries()) {
+        return true;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    if (!m_db.transaction()) {
+        if (error) *error = "Cannot start a transaction on the vault.";
+        return false;
+    }
+    
+    QSqlQuery query(m_db);
+    bool ok = query.exec("CREATE TABLE passwords_records ("
+                        "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                        "record BLOB NOT NULL, "
+                        "created_at DATETIME NOT NULL, "
+                        "modified_at DATETIME NOT NULL, "
+                        "uuid TEXT)");
+    
+    QSqlQuery legacy(m_db);
+    legacy.setForwardOnly(true);
+    ok = ok && legacy.exec("SELECT id, title_encrypted, username_encrypted, "
+                          "password_encrypted, url_encrypted, notes_encrypted, "
+                          "created_at, modified_at, uuid FROM passwords");
+    
+    QSqlQuery insert(m_db);
+    ok = ok && insert.prepare("INSERT INTO passwords_records "
+                             "(id, record, created_at, modified_at, uuid) VALUES (?, ?, ?, ?, ?)");
+    
+    const Encryption::Session &recordSession = session(masterKey);
+    int migrated = 0;
+    int undecryptable = -1;
+    while (ok && legacy.next()) {
+        int id = legacy.value(0).toInt();
+        bool decrypted = true;
+        PasswordEntry entry(id,
+            decryptLegacyField(legacy.value(1), masterKey, &decrypted).toString(),
+            decryptLegacyField(legacy.value(2), masterKey, &decrypted).toString(),
+            decryptLegacyField(legacy.value(3), masterKey, &decrypted),
+            decryptLegacyField(legacy.value(4), masterKey, &decrypted).toString(),
+            decryptLegacyField(legacy.value(5), masterKey, &decrypted),
+            legacy.value(6).toDateTime(), legacy.value(7).toDateTime());
+        if (!decrypted) {
+            // Migrating it with blank fields would lose them for good once
+            // the legacy table is dropped
+            undecryptable = id;
+            ok = false;
+            break;
+        }
+        
+        QByteArray record = EntryRecord::seal(entry, id, recordSession);
+        insert.addBindValue(id);
+        insert.addBindValue(record);
+        insert.addBindValue(entry.created());
+        insert.addBindValue(entry.modified());
+        insert.addBindValue(legacy.value(8));
+        ok = !record.isEmpty() && insert.exec();
+        ++migrated;
+    }
+    legacy.finish();
+    
+    ok = ok && query.exec("DROP TABLE passwords")
+            && query.exec("ALTER TABLE passwords_records RENAME TO passwords")
+            && createEntryUuidIndex(query);
+    
+    if (!ok) {
+        qWarning() << "Failed to migrate legacy entries:" << query.lastError().text()
+                   << insert.lastError().text();
+        m_db.rollback();
+        if (error) {
+            *error = undecryptable >= 0
+                ? QString("Entry %1 could not be decrypted. The vault was left in its "
+                          "old format and nothing was changed.").arg(undecryptable)
+                : QString("Failed to upgrade the vault to the current format.");
+        }
+        return false;
+    }
+    
+    if (!m_db.commit()) {
+        m_db.rollback();
+        if (error) *error = "Failed to save the upgraded vault.";
+        return false;
+    }
+    
+    qDebug() << "Migrated" << migrated << "legacy entries to sealed records in"
+             << timer.elapsed() << "ms";
+    return true;
 }
 
 // ========== Vault Settings Methods ==========
@@ -222,19 +1251,17 @@ bool Database::setSetting(const QString &key, const QVariant &value) {
         return false;
     }
 
-    QSqlQuery query(m_db);
+    QSqlQuery &query = statement(UpsertSetting);
     
     // Store the type information so we can restore it correctly
     QString typeStr = QString(value.typeName());
     QString valueStr = value.toString();
     
-    // Use INSERT OR REPLACE (SQLite specific) to handle both insert and update
-    query.prepare("INSERT OR REPLACE INTO vault_settings (key, value, type) VALUES (?, ?, ?)");
     query.addBindValue(key);
     query.addBindValue(valueStr);
     query.addBindValue(typeStr);
     
-    bool success = query.exec();
+    bool success = exec(UpsertSetting);
     if (!success) {
         qWarning() << "Failed to save setting" << key << ":" << query.lastError().text();
     } else {
@@ -250,16 +1277,16 @@ QVariant Database::getSetting(const QString &key, const QVariant &defaultValue)
         return defaultValue;
     }
 
-    QSqlQuery query(m_db);
-    query.prepare("SELECT value, type FROM vault_settings WHERE key = ?");
+    QSqlQuery &query = statement(SelectSetting);
     query.addBindValue(key);
     
-    if (!query.exec() || !query.next()) {
+    if (!exec(SelectSetting) || !query.next()) {
         return defaultValue;
     }
     
     QString valueStr = query.value(0).toString();
     QString typeStr = query.value(1).toString();
+    query.finish();
     
     // Convert string back to appropriate type
     QVariant result;
@@ -286,15 +1313,16 @@ bool Database::hasSetting(const QString &key) const {
         return false;
     }
 
-    QSqlQuery query(m_db);
-    query.prepare("SELECT COUNT(*) FROM vault_settings WHERE key = ?");
+    QSqlQuery &query = statement(CountSetting);
     query.addBindValue(key);
     
-    if (!query.exec() || !query.next()) {
+    if (!exec(CountSetting) || !query.next()) {
         return false;
     }
     
-    return query.value(0).toInt() > 0;
+    bool found = query.value(0).toInt() > 0;
+    query.finish();
+    return found;
 }
 
 bool Database::removeSetting(const QString &key) {
@@ -302,11 +1330,10 @@ bool Database::removeSetting(const QString &key) {
         return false;
     }
 
-    QSqlQuery query(m_db);
-    query.prepare("DELETE FROM vault_settings WHERE key = ?");
+    QSqlQuery &query = statement(DeleteSetting);
     query.addBindValue(key);
     
-    bool success = query.exec();
+    bool success = exec(DeleteSetting);
     if (success) {
         qDebug() << "Removed vault setting:" << key;
     }
@@ -321,14 +1348,15 @@ QStringList Database::getAllSettingKeys() const {
         return keys;
     }
 
-    QSqlQuery query(m_db);
-    if (!query.exec("SELECT key FROM vault_settings")) {
+    QSqlQuery &query = statement(SelectSettingKeys);
+    if (!exec(SelectSettingKeys)) {
         return keys;
     }
     
     while (query.next()) {
         keys.append(query.value(0).toString());
     }
+    query.finish();
     
     return keys;
 }
\ No newline at end of file
@@ -2,29 +2,226 @@
 #define DATABASE_H
 
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QString>
 #include <QList>
 #include <QVariant>
+#include <QDateTime>
+#include <functional>
+#include "entryrecord.h"
+#include "vectorclock.h"
+#include "../crypto/encryption.h"
+#include "../crypto/kdfheader.h"
 #include "../models/passwordentry.h"
 
 class Database {
 public:
+    // A passwords row exactly as stored, before any decryption
+    struct EncryptedRow {
+        int id = -1;
+        QByteArray record;
+        QDateTime created;
+        QDateTime modified;
+    };
+
+    // Connection-level storage configuration, applied as pragmas on open
+    struct StorageOptions {
+        enum JournalMode {
+            RollbackJournal,
+            WriteAheadLog
+        };
+
+        // Values of PRAGMA synchronous
+        enum Synchronous {
+            SyncOff = 0,
+            SyncNormal = 1,
+            SyncFull = 2,
+            SyncExtra = 3
+        };
+
+        JournalMode journalMode = WriteAheadLog;
+        // Single edits stay durable across power loss. Bulk writes (imports,
+        // batch adds) may only lose their last transactions, which WAL keeps
+        // consistent either way.
+        Synchronous interactiveSync = SyncFull;
+        Synchronous bulkSync = SyncNormal;
+        qint64 mmapSize = 64 * 1024 * 1024;     // bytes, 0 disables
+        int cacheSizeKiB = 8 * 1024;
+        int pageSize = 4096;                    // only applies to new vaults
+    };
+
+    enum WriteMode {
+        InteractiveWrites,
+        BulkWrites
+    };
+
+    // Statements prepared once per connection and reused
+    enum Statement {
+        InsertUser,
+        SelectPasswordHash,
+        SelectKdfHeader,
+        UpdateKdfHeader,
+        NextEntryId,
+        InsertEntry,
+        UpdateEntry,
+        DeleteEntry,
+        SelectEntry,
+        SelectAllEntries,
+        CountEntries,
+        SelectEntryByUuid,
+        SelectEntryUuid,
+        SelectEntryVersion,
+        UpsertEntryVersion,
+        AppendJournal,
+        SelectJournalSince,
+        SelectJournalSinceForDevice,
+        UpsertSetting,
+        SelectSetting,
+        CountSetting,
+        DeleteSetting,
+        SelectSettingKeys,
+        StatementCount
+    };
+
+    struct StatementStats {
+        Statement statement;
+        QString sql;
+        qint64 calls = 0;
+        qint64 totalNanoseconds = 0;    // Spent in exec(), including the first step
+    };
+
     Database();
     ~Database();
 
-    bool open(const QString &path);
+    bool open(const QString &path, const StorageOptions &options = StorageOptions());
     void close();
     bool isOpen() const;
+    QString path() const { return m_db.databaseName(); }
+
+    const StorageOptions &storageOptions() const { return m_options; }
+    // Switches PRAGMA synchronous to the level the options give the mode
+    bool setWriteMode(WriteMode mode);
+
+    // Version of the newest schema migration applied to the open vault
+    int schemaVersion();
 
-    bool createUser(const QString &masterPasswordHash, const QByteArray &salt);
+    // Usage of the cached statements since open (or the last reset)
+    QList<StatementStats> statementStats() const;
+    void resetStatementStats();
+
+    // header must carry its key check
+    bool createUser(const KdfHeader &header);
+    // Vaults from before KDF headers only: compares the unsalted hash they
+    // were created with
     bool verifyUser(const QString &masterPasswordHash);
-    QByteArray getUserSalt();
+    // Invalid if the vault has not been initialized. Vaults from before KDF
+    // headers get a legacy header, without a key check.
+    KdfHeader getKdfHeader();
+    // Stores a header with its key check and drops the legacy password hash
+    bool setKdfHeader(const KdfHeader &header);
 
-    bool addEntry(const PasswordEntry &entry, const QByteArray &masterKey);
-    bool updateEntry(const PasswordEntry &entry, const QByteArray &masterKey);
+    // On success these write back what the database assigned: the new row id
+    // for addEntry, the modified timestamp for updateEntry
+    bool addEntry(PasswordEntry &entry, const QByteArray &masterKey);
+    bool updateEntry(PasswordEntry &entry, const QByteArray &masterKey);
+    // Inserts all entries in one transaction under bulk write mode. Records
+    // are sealed on the decryption pool ahead of the insert loop, which reuses
+    // one prepared statement. progress gets (inserted, total) after every
+    // chunk and can return false to abort; nothing is written unless every
+    // entry is. On success each entry carries its new id.
+    bool addEntries(QList<PasswordEntry> &entries, const QByteArray &masterKey,
+                    const Encryption::ProgressCallback &progress = Encryption::ProgressCallback());
     bool deleteEntry(int id);
     QList<PasswordEntry> getAllEntries(const QByteArray &masterKey);
-    PasswordEntry getEntry(int id, const QByteArray &masterKey);
+    // With EntryRecord::Summary, password and notes stay sealed
+    PasswordEntry getEntry(int id, const QByteArray &masterKey,
+                           EntryRecord::Parts parts = EntryRecord::All);
+
+    // Walks the passwords table with a forward-only cursor and decrypts one
+    // row at a time into the same PasswordEntry, so memory use does not grow
+    // with the vault. visit must copy anything it keeps and can return false
+    // to stop early. Rows that fail to open are not visited; their number
+    // goes to skipped.
+    using EntryVisitor = std::function<bool(const PasswordEntry &entry)>;
+    bool forEachEntry(const QByteArray &masterKey, const EntryVisitor &visit,
+                      int *skipped = nullptr);
+    int entryCount();
+
+    // Entries with only the columns the entry list shows (title, username,
+    // url and timestamps). Password and notes stay sealed; use getEntry when
+    // they are actually needed.
+    QList<PasswordEntry> getEntrySummaries(const QByteArray &masterKey);
+
+    // Split loading: reading ciphertext needs no key and must run on the thread
+    // owning the connection, decryption touches no database state and can run
+    // on any thread. Bulk decryption is spread over the decryption thread pool
+    // in fixed-size chunks and returns entries in row order.
+    QList<EncryptedRow> getEncryptedRows();
+    static PasswordEntry decryptRow(const EncryptedRow &row, const Encryption::Session &session,
+                                    EntryRecord::Parts parts = EntryRecord::All);
+    static QList<PasswordEntry> decryptRows(const QList<EncryptedRow> &rows,
+                                            const QByteArray &masterKey,
+                                            EntryRecord::Parts parts = EntryRecord::All);
+
+    // Number of threads used for bulk decryption, defaults to the core count
+    static int decryptionThreadCount();
+    static void setDecryptionThreadCount(int count);
+
+    // Vaults written before sealed records stored each field separately with
+    // AES-CBC. Converting them needs the master key, so it happens on unlock.
+    // All or nothing: if any field fails to decrypt, the legacy table is
+    // kept as it is and error says which entry.
+    bool hasLegacyEntries();
+    bool migrateLegacyEntries(const QByteArray &masterKey, QString *error = nullptr);
+
+    // Change journal. Every add, edit and delete bumps this device's counter
+    // in the entry's vector clock and appends a row to the journal; deleted
+    // entries keep their version as a tombstone. The synced calls store a
+    // version that was merged from another device as is, journaled under the
+    // device that wrote it, so journalSince(n, deviceId()) holds only the
+    // changes made here.
+    struct EntryVersion {
+        VectorClock clock;
+        QString writer;         // Device that made this version
+        QDateTime changed;      // UTC, on the writer's clock
+        bool deleted = false;
+    };
+    struct JournalEntry {
+        qint64 sequence = 0;
+        QString uuid;
+        QString device;
+        VectorClock clock;
+        bool deleted = false;
+        QDateTime changed;
+    };
+    // Identifies this installation; kept in the application settings, not
+    // the vault, so that a copied vault does not copy it
+    static QString deviceId();
+    // Journal rows after sequence, oldest first, optionally only those
+    // written by one device. A range scan, so the cost follows the number
+    // of changes rather than the size of the vault.
+    QList<JournalEntry> journalSince(qint64 sequence, const QString &device = QString());
+    // False, with an empty version, for entries never changed since the
+    // journal was added
+    bool entryVersion(const QString &uuid, EntryVersion &version);
+    // Replaces the version without touching the entry, when a merge keeps the
+    // local state but learns of the remote clock. Journaled under device, the
+    // one the merged change came from.
+    bool setEntryVersion(const QString &uuid, const EntryVersion &version,
+                         const QString &device);
+    bool getEntryByUuid(const QString &uuid, const QByteArray &masterKey, PasswordEntry &entry);
+    // Inserts or overwrites the entry with this uuid, keeping the entry's
+    // timestamps; on success entry carries its local id
+    bool putSyncedEntry(const QString &uuid, PasswordEntry &entry, const QByteArray &masterKey,
+                        const EntryVersion &version);
+    // Returns the local id of the removed entry, 0 if there was none (the
+    // tombstone is still recorded) or -1 on failure
+    int deleteSyncedEntry(const QString &uuid, const EntryVersion &version);
+
+    // For callers that group several of the calls above
+    bool beginTransaction();
+    bool commitTransaction();
+    void rollbackTransaction();
 
     // Vault settings storage
     bool setSetting(const QString &key, const QVariant &value);
@@ -35,7 +232,37 @@ public:
 
 private:
     QSqlDatabase m_db;
-    bool createTables();
+    Encryption::Session *m_session;
+    StorageOptions m_options;
+    
+    // Owned, prepared on first use and released on close. Mutable so the
+    // const settings readers can use the cache too.
+    mutable QSqlQuery *m_statements[StatementCount];
+    mutable bool m_prepared[StatementCount];
+    // Handed out by statement() and not executed since
+    mutable bool m_bound[StatementCount];
+    mutable qint64 m_statementCalls[StatementCount];
+    mutable qint64 m_statementNanoseconds[StatementCount];
+    
+    bool applyStorageOptions();
+    bool migrateSchema();
+    void releaseStatements();
+    QSqlQuery &statement(Statement id) const;
+    bool exec(Statement id) const;
+    const Encryption::Session &session(const QByteArray &masterKey);
+    int nextEntryId();
+    int entryIdForUuid(const QString &uuid, EncryptedRow *row = nullptr);
+    QString entryUuid(int id);
+    bool journalChange(const QString &uuid, bool deleted);
+    bool recordVersion(const QString &uuid, const EntryVersion &version, const QString &device);
+    static QString newEntryUuid();
+    static EncryptedRow readEncryptedRow(const QSqlQuery &query);
+    QList<PasswordEntry> loadEntries(const QByteArray &masterKey, EntryRecord::Parts parts);
+    static QList<QByteArray> sealChunk(const QList<PasswordEntry> &entries, int firstId,
+                                       const Encryption::Session &session);
+    static QList<PasswordEntry> decryptChunk(const QList<EncryptedRow> &rows,
+                                             const Encryption::Session &session,
+                                             EntryRecord::Parts parts);
 };
 
 #endif
\ No newline at end of file
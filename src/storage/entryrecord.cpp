@@ -0,0 +1,204 @@
+#include "entryrecord.h"
+#include <QtEndian>
+#include <openssl/crypto.h>
+#include <utility>
+
+static const char LegacyVersion = 1;
+
+static void appendField(QByteArray &payload, QStringView value) {
+    QByteArray bytes = value.toUtf8();
+    char length[4];
+    qToBigEndian<quint32>(bytes.size(), length);
+    payload.append(length, sizeof(length));
+    payload.append(bytes);
+    OPENSSL_cleanse(bytes.data(), bytes.size());
+}
+
+// Finds the next field of payload without decoding it
+static bool nextField(const SecureBuffer &payload, qsizetype &offset,
+                      const char *&data, qsizetype &size) {
+    if (payload.size() - offset < 4) return false;
+    quint32 length = qFromBigEndian<quint32>(payload.constData() + offset);
+    offset += 4;
+    if (payload.size() - offset < qsizetype(length)) return false;
+    data = payload.constData() + offset;
+    size = length;
+    offset += length;
+    return true;
+}
+
+static bool readField(const SecureBuffer &payload, qsizetype &offset, QString &value) {
+    const char *data = nullptr;
+    qsizetype size = 0;
+    if (!nextField(payload, offset, data, size)) return false;
+    value = QString::fromUtf8(data, size);
+    return true;
+}
+
+// Secret fields are decoded from the arena straight back into it
+static bool readField(const SecureBuffer &payload, qsizetype &offset, SecureString &value) {
+    const char *data = nullptr;
+    qsizetype size = 0;
+    if (!nextField(payload, offset, data, size)) return false;
+    value = SecureString::fromUtf8(data, size);
+    return true;
+}
+
+QByteArray EntryRecord::seal(const PasswordEntry &entry, qint64 id,
+                             const Encryption::Session &session) {
+    QByteArray summary;
+    appendField(summary, entry.title());
+    appendField(summary, entry.username());
+    appendField(summary, entry.url());
+    
+    QByteArray secrets;
+    appendField(secrets, entry.password().view());
+    appendField(secrets, entry.notes().view());
+    
+    QByteArray sealedSummary = session.seal(summary, associatedData(CurrentVersion, id, Summary));
+    QByteArray sealedSecrets = session.seal(secrets, associatedData(CurrentVersion, id, Secrets));
+    OPENSSL_cleanse(summary.data(), summary.size());
+    OPENSSL_cleanse(secrets.data(), secrets.size());
+    
+    if (sealedSummary.isEmpty() || sealedSecrets.isEmpty()) return QByteArray();
+    
+    QByteArray record(5, 0);
+    record[0] = CurrentVersion;
+    qToBigEndian<quint32>(sealedSummary.size(), record.data() + 1);
+    record.append(sealedSummary);
+    record.append(sealedSecrets);
+    return record;
+}
+
+bool EntryRecord::open(const QByteArray &record, qint64 id,
+                       const Encryption::Session &session, PasswordEntry &entry,
+                       Parts parts) {
+    QList<Segment> segments;
+    if (!split(record, id, parts, segments)) return false;
+    
+    bool ok = true;
+    for (const Segment &segment : segments) {
+        SecureBuffer payload;
+        ok = ok && session.open(segment.sealed, segment.associatedData, payload)
+                && decode(payload, segment, entry);
+    }
+    
+    return ok;
+}
+
+int EntryRecord::openBatch(const QList<QByteArray> &records,
+                           const Encryption::Session &session,
+                           QList<PasswordEntry> &entries, Parts parts) {
+    // Flatten every record into its segments so one batch call opens them all
+    QList<QByteArray> sealed;
+    QList<QByteArray> aads;
+    QList<Segment> segmentInfo;
+    QList<qsizetype> owners;
+    QList<bool> failed(records.size(), false);
+    sealed.reserve(records.size());
+    aads.reserve(records.size());
+    
+    for (qsizetype i = 0; i < records.size(); ++i) {
+        QList<Segment> segments;
+        if (!split(records[i], entries[i].id(), parts, segments)) {
+            failed[i] = true;
+            continue;
+        }
+        for (const Segment &segment : segments) {
+            sealed.append(segment.sealed);
+            aads.append(segment.associatedData);
+            segmentInfo.append(segment);
+            owners.append(i);
+        }
+    }
+    
+    QList<bool> opened;
+    QList<SecureBuffer> payloads = session.openBatch(sealed, aads, &opened);
+    
+    for (qsizetype i = 0; i < payloads.size(); ++i) {
+        qsizetype owner = owners[i];
+        if (!opened[i] || !decode(payloads[i], segmentInfo[i], entries[owner])) {
+            failed[owner] = true;
+        }
+        // Released as it goes, so the arena blocks drain during the batch
+        payloads[i].clear();
+    }
+    
+    return failed.count(true);
+}
+
+bool EntryRecord::split(const QByteArray &record, qint64 id, Parts parts,
+                        QList<Segment> &segments) {
+    if (record.isEmpty()) return false;
+    
+    if (record.at(0) == LegacyVersion) {
+        // A single payload, only the requested fields are kept from it
+        segments.append({All, parts, record.mid(1), associatedData(LegacyVersion, id)});
+        return true;
+    }
+    
+    if (record.at(0) != CurrentVersion || record.size() < 5) return false;
+    
+    quint32 summarySize = qFromBigEndian<quint32>(record.constData() + 1);
+    if (record.size() - 5 < qsizetype(summarySize)) return false;
+    
+    if (parts & Summary) {
+        segments.append({Summary, Summary, record.mid(5, summarySize),
+                         associatedData(CurrentVersion, id, Summary)});
+    }
+    if (parts & Secrets) {
+        segments.append({Secrets, Secrets, record.mid(5 + summarySize),
+                         associatedData(CurrentVersion, id, Secrets)});
+    }
+    return true;
+}
+
+bool EntryRecord::decode(const SecureBuffer &payload, const Segment &segment,
+                         PasswordEntry &entry) {
+    QString title, username, url;
+    SecureString password, notes;
+    qsizetype offset = 0;
+    bool ok = false;
+    
+    switch (segment.layout) {
+        case Summary:
+            ok = readField(payload, offset, title) && readField(payload, offset, username) &&
+                 readField(payload, offset, url);
+            break;
+        case Secrets:
+            ok = readField(payload, offset, password) && readField(payload, offset, notes);
+            break;
+        case All:
+            // Version 1 field order
+            ok = readField(payload, offset, title) && readField(payload, offset, username) &&
+                 readField(payload, offset, password) && readField(payload, offset, url) &&
+                 readField(payload, offset, notes);
+            break;
+    }
+    
+    if (!ok) return false;
+    
+    if (segment.wanted & Summary) {
+        entry.setTitle(title);
+        entry.setUsername(username);
+        entry.setUrl(url);
+    }
+    if (segment.wanted & Secrets) {
+        entry.setPassword(std::move(password));
+        entry.setNotes(std::move(notes));
+    }
+    return true;
+}
+
+QByteArray EntryRecord::associatedData(char version, qint64 id) {
+    QByteArray aad(9, 0);
+    aad[0] = version;
+    qToBigEndian<qint64>(id, aad.data() + 1);
+    return aad;
+}
+
+QByteArray EntryRecord::associatedData(char version, qint64 id, Part part) {
+    QByteArray aad = associatedData(version, id);
+    aad.append(char(part == Summary ? 0 : 1));
+    return aad;
+}
@@ -0,0 +1,69 @@
+#ifndef ENTRYRECORD_H
+#define ENTRYRECORD_H
+
+#include <QByteArray>
+#include <QList>
+#include "../crypto/encryption.h"
+#include "../models/passwordentry.h"
+
+// On-disk format of a passwords row. The text fields of an entry are encoded
+// as length-prefixed UTF-8 and sealed with AES-256-GCM. The row id is bound as
+// associated data so a record cannot be moved to another row.
+//
+// Version 2 seals the fields shown in the entry list separately from the
+// secrets, so the list can be loaded without decrypting any password:
+//
+//   record    = 0x02 || summaryLength (uint32 big-endian) || summary || secrets
+//   summary   = Encryption::seal(field{title, username, url}, key, aad(0x00))
+//   secrets   = Encryption::seal(field{password, notes}, key, aad(0x01))
+//   aad(part) = version (1 byte) || row id (int64 big-endian) || part (1 byte)
+//
+// Version 1 sealed all five fields as one payload with aad = version || row id.
+// It is still read; records are rewritten as version 2 when next saved.
+//
+//   field     = length (uint32 big-endian) || UTF-8 bytes
+class EntryRecord {
+public:
+    enum Part {
+        Summary = 0x1,
+        Secrets = 0x2,
+        All = Summary | Secrets
+    };
+    Q_DECLARE_FLAGS(Parts, Part)
+
+    static const char CurrentVersion = 2;
+
+    static QByteArray seal(const PasswordEntry &entry, qint64 id,
+                           const Encryption::Session &session);
+    static bool open(const QByteArray &record, qint64 id,
+                     const Encryption::Session &session, PasswordEntry &entry,
+                     Parts parts = All);
+
+    // Opens records[i] into entries[i], using entries[i].id() as the row id.
+    // Borrows a single cipher context for the batch. Returns the number of
+    // records that failed to open; their fields are left untouched.
+    static int openBatch(const QList<QByteArray> &records,
+                         const Encryption::Session &session,
+                         QList<PasswordEntry> &entries, Parts parts = All);
+
+private:
+    // A sealed piece of a record: what its payload contains and which of
+    // those fields the caller asked for
+    struct Segment {
+        Part layout;
+        Parts wanted;
+        QByteArray sealed;
+        QByteArray associatedData;
+    };
+
+    static bool split(const QByteArray &record, qint64 id, Parts parts,
+                      QList<Segment> &segments);
+    static bool decode(const SecureBuffer &payload, const Segment &segment,
+                       PasswordEntry &entry);
+    static QByteArray associatedData(char version, qint64 id);
+    static QByteArray associatedData(char version, qint64 id, Part part);
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(EntryRecord::Parts)
+
+#endif
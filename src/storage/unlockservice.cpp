@@ -0,0 +1,181 @@
+#include "unlockservice.h"
+#include "../crypto/encryption.h"
+#include "../crypto/securememory.h"
+#include <QtConcurrent>
+#include <QPromise>
+#include <QDebug>
+
+// Key derivation accounts for most of the unlock time, decryption the rest
+static const int KeyDerivationProgressShare = 90;
+
+UnlockService::UnlockService(QObject *parent)
+    : QObject(parent),
+      m_keyWatcher(new QFutureWatcher<QByteArray>(this)),
+      m_entriesWatcher(new QFutureWatcher<QList<PasswordEntry>>(this)),
+      m_database(nullptr),
+      m_needsMigration(false) {
+    connect(m_keyWatcher, &QFutureWatcher<QByteArray>::progressValueChanged, 
+            this, [this](int iterations) {
+        // qint64: calibrated iteration counts times the share overflow an int
+        emit progressChanged(int(qint64(iterations) * KeyDerivationProgressShare
+                                 / qMax(1, m_keyWatcher->progressMaximum())));
+    });
+    connect(m_keyWatcher, &QFutureWatcher<QByteArray>::finished, 
+            this, &UnlockService::onKeyDerived);
+    connect(m_entriesWatcher, &QFutureWatcher<QList<PasswordEntry>>::finished, 
+            this, &UnlockService::onEntriesDecrypted);
+}
+
+UnlockService::~UnlockService() {
+    // Running tasks hold their own copies of the inputs, so they can be left
+    // to wind down in the thread pool once cancelled.
+    cancel();
+    reset();
+}
+
+void UnlockService::start(Database *database, const QString &masterPassword) {
+    if (isRunning()) {
+        return;
+    }
+
+    m_database = database;
+    m_header = database->getKdfHeader();
+    if (!m_header.isValid()) {
+        reset();
+        emit failed("The vault's key derivation settings are missing or unsupported.");
+        return;
+    }
+    // Vaults from before KDF headers are checked against their old hash
+    // first, so that the key check recorded below is the right one
+    if (!m_header.hasKeyCheck() && !database->verifyUser(Encryption::hashPassword(masterPassword))) {
+        reset();
+        emit rejected();
+        return;
+    }
+    emit progressChanged(0);
+
+    m_keyTimer.start();
+    QFuture<QByteArray> keyFuture = QtConcurrent::run(
+        [](QPromise<QByteArray> &promise, const QString &password, const KdfHeader &header) {
+            promise.setProgressRange(0, int(header.iterations()));
+            QByteArray key = header.deriveKey(password, 
+                [&promise](int completed, int) {
+                    promise.setProgressValue(completed);
+                    return !promise.isCanceled();
+                });
+            if (!key.isEmpty()) {
+                promise.addResult(key);
+            }
+        }, masterPassword, m_header);
+    m_keyWatcher->setFuture(keyFuture);
+
+    // Reading the ciphertext needs no key, so it overlaps with the derivation.
+    // The connection belongs to this thread, which is why it is not offloaded.
+    // Legacy vaults are rewritten once the key is known and read afterwards.
+    m_needsMigration = database->hasLegacyEntries();
+    if (!m_needsMigration) {
+        m_rows = database->getEncryptedRows();
+    }
+}
+
+void UnlockService::cancel() {
+    m_keyWatcher->cancel();
+    m_entriesWatcher->cancel();
+}
+
+bool UnlockService::isRunning() const {
+    return m_keyWatcher->isRunning() || m_entriesWatcher->isRunning();
+}
+
+void UnlockService::onKeyDerived() {
+    QFuture<QByteArray> keyFuture = m_keyWatcher->future();
+    if (keyFuture.isCanceled() || keyFuture.resultCount() == 0) {
+        bool wasCancelled = keyFuture.isCanceled();
+        reset();
+        if (wasCancelled) {
+            emit cancelled();
+        } else {
+            emit failed("Failed to derive the master key.");
+        }
+        return;
+    }
+
+    // Taken rather than copied: a copy would share its buffer with the
+    // future's, and wiping it would only detach
+    QByteArray derivedKey = keyFuture.takeResult();
+    qDebug() << "Derived the key in" << m_keyTimer.elapsed() << "ms";
+    if (m_header.hasKeyCheck()) {
+        if (!m_header.checkKey(derivedKey)) {
+            SecureMemory::wipe(derivedKey.data(), derivedKey.size());
+            reset();
+            emit rejected();
+            return;
+        }
+        m_masterKey = m_header.masterKey(derivedKey);
+        if (m_header.wrapsKey()) {
+            SecureMemory::wipe(derivedKey.data(), derivedKey.size());
+        }
+        if (m_masterKey.isEmpty()) {
+            reset();
+            emit failed("Failed to open the vault's master key.");
+            return;
+        }
+    } else {
+        m_masterKey = derivedKey;
+        if (!m_header.setKey(m_masterKey) || !m_database->setKdfHeader(m_header)) {
+            // The vault still opens through its old hash; try again next time
+            qWarning() << "Failed to store the vault's key check";
+        }
+    }
+    emit progressChanged(KeyDerivationProgressShare);
+    
+    if (m_needsMigration) {
+        QString error;
+        if (!m_database->migrateLegacyEntries(m_masterKey, &error)) {
+            reset();
+            emit failed(error);
+            return;
+        }
+        m_rows = m_database->getEncryptedRows();
+    }
+
+    QList<Database::EncryptedRow> rows = m_rows;
+    m_rows.clear();
+    m_entriesWatcher->setFuture(QtConcurrent::run(
+        [](QPromise<QList<PasswordEntry>> &promise, 
+           const QList<Database::EncryptedRow> &rows, const QByteArray &key) {
+            if (!promise.isCanceled()) {
+                // The entry list only needs the summary columns
+                promise.addResult(Database::decryptRows(rows, key, EntryRecord::Summary));
+            }
+        }, rows, m_masterKey));
+}
+
+void UnlockService::onEntriesDecrypted() {
+    QFuture<QList<PasswordEntry>> entriesFuture = m_entriesWatcher->future();
+    if (entriesFuture.isCanceled() || entriesFuture.resultCount() == 0) {
+        reset();
+        emit cancelled();
+        return;
+    }
+
+    QByteArray masterKey = std::move(m_masterKey);
+    QList<PasswordEntry> entries = entriesFuture.takeResult();
+    reset();
+
+    emit progressChanged(100);
+    // Receivers keep their own copy of the key, see MainWindow
+    emit unlocked(masterKey, entries);
+    SecureMemory::wipe(const_cast<char*>(masterKey.constData()), masterKey.size());
+}
+
+void UnlockService::reset() {
+    m_database = nullptr;
+    m_header = KdfHeader();
+    m_needsMigration = false;
+    // Through constData(): fill() would detach from the copies still shared
+    // with the decryption task and leave the key itself in place
+    SecureMemory::wipe(const_cast<char*>(m_masterKey.constData()), m_masterKey.size());
+    m_masterKey.clear();
+    m_rows.clear();
+}
@@ -0,0 +1,55 @@
+#ifndef UNLOCKSERVICE_H
+#define UNLOCKSERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include "database.h"
+#include "../models/passwordentry.h"
+
+// Unlocks a vault without blocking the event loop. The master key is derived
+// on a worker thread while the encrypted rows are read from the database and
+// is checked against the vault's KdfHeader; then the entry summaries are
+// decrypted off the GUI thread so the main window opens populated. Passwords
+// and notes are left sealed.
+class UnlockService : public QObject {
+    Q_OBJECT
+
+public:
+    explicit UnlockService(QObject *parent = nullptr);
+    ~UnlockService();
+
+    void start(Database *database, const QString &masterPassword);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void progressChanged(int percent);
+    void unlocked(const QByteArray &masterKey, const QList<PasswordEntry> &entries);
+    // The master password was wrong
+    void rejected();
+    void cancelled();
+    void failed(const QString &message);
+
+private slots:
+    void onKeyDerived();
+    void onEntriesDecrypted();
+
+private:
+    QFutureWatcher<QByteArray> *m_keyWatcher;
+    QFutureWatcher<QList<PasswordEntry>> *m_entriesWatcher;
+
+    Database *m_database;
+    KdfHeader m_header;
+    QElapsedTimer m_keyTimer;
+    bool m_needsMigration;
+    QList<Database::EncryptedRow> m_rows;
+    QByteArray m_masterKey;
+
+    void reset();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "vectorclock.h"
+#include <QStringList>
+
+void VectorClock::increment(const QString &device) {
+    ++m_counters[device];
+}
+
+void VectorClock::merge(const VectorClock &other) {
+    for (auto it = other.m_counters.constBegin(); it != other.m_counters.constEnd(); ++it) {
+        quint64 &counter = m_counters[it.key()];
+        counter = qMax(counter, it.value());
+    }
+}
+
+VectorClock::Ordering VectorClock::compare(const VectorClock &other) const {
+    bool ahead = false;
+    bool behind = false;
+    
+    // A device missing from one side counts as zero there
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        quint64 theirs = other.counter(it.key());
+        ahead = ahead || it.value() > theirs;
+        behind = behind || it.value() < theirs;
+    }
+    for (auto it = other.m_counters.constBegin(); it != other.m_counters.constEnd(); ++it) {
+        behind = behind || it.value() > counter(it.key());
+    }
+    
+    if (ahead && behind) return Concurrent;
+    if (ahead) return After;
+    if (behind) return Before;
+    return Equal;
+}
+
+QString VectorClock::toString() const {
+    QStringList parts;
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        parts.append(it.key() + ':' + QString::number(it.value()));
+    }
+    return parts.join(',');
+}
+
+VectorClock VectorClock::fromString(const QString &text) {
+    VectorClock clock;
+    for (const QString &part : text.split(',', Qt::SkipEmptyParts)) {
+        int colon = part.lastIndexOf(':');
+        bool ok = false;
+        quint64 counter = part.mid(colon + 1).toULongLong(&ok);
+        if (colon > 0 && ok && counter > 0) {
+            clock.m_counters.insert(part.left(colon), counter);
+        }
+    }
+    return clock;
+}
@@ -0,0 +1,43 @@
+#ifndef VECTORCLOCK_H
+#define VECTORCLOCK_H
+
+#include <QString>
+#include <QMap>
+
+// Version vector of one entry: for every device that changed the entry, how
+// many of its changes the current version includes. Comparing two clocks
+// tells whether one version was derived from the other or whether they were
+// made concurrently, without trusting any device's wall clock.
+//
+// Stored as text, devices in ascending order: "<device>:<counter>,..."
+class VectorClock {
+public:
+    enum Ordering {
+        Equal,
+        Before,         // this version is an ancestor of the other
+        After,          // this version descends from the other
+        Concurrent
+    };
+
+    VectorClock() {}
+
+    bool isEmpty() const { return m_counters.isEmpty(); }
+    quint64 counter(const QString &device) const { return m_counters.value(device, 0); }
+
+    // Records one more change made on device
+    void increment(const QString &device);
+    // Pointwise maximum: the version that has seen both
+    void merge(const VectorClock &other);
+    Ordering compare(const VectorClock &other) const;
+
+    bool operator==(const VectorClock &other) const { return m_counters == other.m_counters; }
+    bool operator!=(const VectorClock &other) const { return m_counters != other.m_counters; }
+
+    QString toString() const;
+    static VectorClock fromString(const QString &text);
+
+private:
+    QMap<QString, quint64> m_counters;
+};
+
+#endif
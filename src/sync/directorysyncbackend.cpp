@@ -0,0 +1,78 @@
+#include "directorysyncbackend.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QRegularExpression>
+
+static const char RecordSuffix[] = ".pmsync";
+// Records are a few hundred bytes; anything far larger is not one of ours
+static const qint64 MaxRecordSize = 1024 * 1024;
+
+DirectorySyncBackend::DirectorySyncBackend(const QString &folder)
+    : m_folder(QDir::cleanPath(folder)) {}
+
+bool DirectorySyncBackend::test(QString *error) {
+    QDir dir(m_folder);
+    if (m_folder.isEmpty() || !dir.exists()) {
+        if (error) *error = "The sync folder does not exist.";
+        return false;
+    }
+    
+    QSaveFile probe(dir.filePath(".pmsync-test"));
+    if (!probe.open(QIODevice::WriteOnly) || probe.write("ok") != 2 || !probe.commit()) {
+        if (error) *error = "Cannot write to the sync folder: " + probe.errorString();
+        return false;
+    }
+    QFile::remove(dir.filePath(".pmsync-test"));
+    return true;
+}
+
+QStringList DirectorySyncBackend::devices() {
+    static const QRegularExpression deviceName("^[0-9a-f]{32}$");
+    
+    QStringList result;
+    for (const QString &name : QDir(m_folder).entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        if (deviceName.match(name).hasMatch()) {
+            result.append(name);
+        }
+    }
+    return result;
+}
+
+bool DirectorySyncBackend::exists(const QString &device, quint64 sequence) {
+    return QFile::exists(recordPath(device, sequence));
+}
+
+bool DirectorySyncBackend::write(const QString &device, quint64 sequence, 
+                                 const QByteArray &record, QString *error) {
+    QString path = recordPath(device, sequence);
+    if (!QDir().mkpath(QFileInfo(path).path())) {
+        if (error) *error = "Cannot create " + QFileInfo(path).path();
+        return false;
+    }
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(record) != record.size() || 
+        !file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool DirectorySyncBackend::read(const QString &device, quint64 sequence, QByteArray *record) {
+    QFile file(recordPath(device, sequence));
+    if (!file.open(QIODevice::ReadOnly) || file.size() > MaxRecordSize) {
+        return false;
+    }
+    
+    *record = file.readAll();
+    return true;
+}
+
+QString DirectorySyncBackend::recordPath(const QString &device, quint64 sequence) const {
+    return QString("%1/%2/%3%4").arg(m_folder, device)
+                                .arg(sequence, 16, 10, QChar('0'))
+                                .arg(RecordSuffix);
+}
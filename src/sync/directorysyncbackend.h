@@ -0,0 +1,34 @@
+#ifndef DIRECTORYSYNCBACKEND_H
+#define DIRECTORYSYNCBACKEND_H
+
+#include "syncbackend.h"
+
+// Sync through a shared folder, such as a NAS mount or a Syncthing or
+// Dropbox directory. Each device writes to its own subfolder, one file per
+// record:
+//
+//   <folder>/<device>/<sequence, 16 digits>.pmsync
+//
+// Files are written under a temporary name and renamed into place, so file
+// sync tools never pick up half a record. Reading the next record is a
+// single open, and nothing is ever listed except the device folders.
+class DirectorySyncBackend : public SyncBackend {
+public:
+    explicit DirectorySyncBackend(const QString &folder);
+
+    QString description() const override { return m_folder; }
+    bool test(QString *error = nullptr) override;
+
+    QStringList devices() override;
+    bool exists(const QString &device, quint64 sequence) override;
+    bool write(const QString &device, quint64 sequence, const QByteArray &record,
+               QString *error = nullptr) override;
+    bool read(const QString &device, quint64 sequence, QByteArray *record) override;
+
+private:
+    QString recordPath(const QString &device, quint64 sequence) const;
+
+    QString m_folder;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "entrymerge.h"
+
+EntryMerge::Outcome EntryMerge::resolve(const Database::EntryVersion &local,
+                                        const Database::EntryVersion &remote) {
+    switch (remote.clock.compare(local.clock)) {
+    case VectorClock::Equal:
+    case VectorClock::Before:
+        return KeepLocal;
+    case VectorClock::After:
+        return TakeRemote;
+    case VectorClock::Concurrent:
+        break;
+    }
+    
+    if (local.deleted != remote.deleted) {
+        return local.deleted ? TakeRemote : KeepLocal;
+    }
+    if (local.changed != remote.changed) {
+        return remote.changed > local.changed ? TakeRemote : KeepLocal;
+    }
+    return remote.writer > local.writer ? TakeRemote : KeepLocal;
+}
+
+Database::EntryVersion EntryMerge::merged(const Database::EntryVersion &local,
+                                          const Database::EntryVersion &remote,
+                                          Outcome outcome) {
+    Database::EntryVersion version = outcome == TakeRemote ? remote : local;
+    version.clock.merge(outcome == TakeRemote ? local.clock : remote.clock);
+    return version;
+}
@@ -0,0 +1,33 @@
+#ifndef ENTRYMERGE_H
+#define ENTRYMERGE_H
+
+#include "../storage/database.h"
+
+// Decides between the local version of an entry and one that arrived from
+// another device. Causality comes first: a version whose clock descends from
+// the other's wins outright. Only truly concurrent versions fall back to a
+// fixed rule, so every device that has seen both settles on the same one:
+//
+//   1. an edit beats a concurrent deletion
+//   2. otherwise the later change wins (the writer's UTC timestamp)
+//   3. ties go to the greater writer id
+//
+// Either way the stored clock becomes the pointwise maximum of both, so the
+// loser is never applied again when it arrives through a third device.
+class EntryMerge {
+public:
+    enum Outcome {
+        KeepLocal,
+        TakeRemote
+    };
+
+    // local has an empty clock if the entry is unknown here
+    static Outcome resolve(const Database::EntryVersion &local,
+                           const Database::EntryVersion &remote);
+    // The version to store once outcome is applied
+    static Database::EntryVersion merged(const Database::EntryVersion &local,
+                                         const Database::EntryVersion &remote,
+                                         Outcome outcome);
+};
+
+#endif
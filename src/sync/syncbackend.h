@@ -0,0 +1,32 @@
+#ifndef SYNCBACKEND_H
+#define SYNCBACKEND_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+// Transport for sync change records. Every device appends sealed records to
+// its own stream, numbered from 1 without gaps, and reads the streams of the
+// other devices from where it left off. A backend only stores opaque blobs by
+// (device, sequence); it never sees plaintext and needs no locking, since
+// each stream has a single writer.
+class SyncBackend {
+public:
+    virtual ~SyncBackend() {}
+
+    // Shown to the user, e.g. the folder path
+    virtual QString description() const = 0;
+    // Checks that the backend can be reached and written to
+    virtual bool test(QString *error = nullptr) = 0;
+
+    // Devices that have written at least one record
+    virtual QStringList devices() = 0;
+    virtual bool exists(const QString &device, quint64 sequence) = 0;
+    // Must not make a partial record visible to readers
+    virtual bool write(const QString &device, quint64 sequence, const QByteArray &record,
+                       QString *error = nullptr) = 0;
+    // False when the stream has no record at sequence (yet)
+    virtual bool read(const QString &device, quint64 sequence, QByteArray *record) = 0;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "syncengine.h"
+#include "entrymerge.h"
+#include "../crypto/securememory.h"
+#include <QHash>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QDebug>
+
+// Vault settings with this prefix are synced; backup and sync settings
+// describe the device (folders, schedules) and stay local
+static const char SyncedSettingsPrefix[] = "vault.";
+
+// Bookkeeping in vault_settings. Keyed by device so that a copied vault
+// stays correct on the device it is copied to.
+static const char SequenceKeyPrefix[] = "sync.sequence.";  // last record written
+static const char CursorKeyPrefix[] = "sync.cursor.";      // last record applied
+static const char JournalKeyPrefix[] = "sync.journal.";    // last journal row pushed
+static const char SettingsDigestKey[] = "sync.settingsDigest";
+// The synced settings as last sent or received, for telling which keys
+// were changed here since
+static const char SettingsBaseKey[] = "sync.settingsBase";
+
+SyncEngine::SyncEngine(Database *database, VaultSettings *settings, 
+                       const QByteArray &masterKey)
+    : m_database(database),
+      m_settings(settings),
+      // A buffer of our own: the window wipes its key on close, which must
+      // not leave a late sync sealing entries under zeros
+      m_masterKey(masterKey.constData(), masterKey.size()),
+      m_backend(nullptr),
+      m_deviceId(Database::deviceId()) {
+    QByteArray syncKey = Encryption::deriveSubkey(masterKey, "password-manager sync v1");
+    m_session = new Encryption::Session(syncKey);
+    SecureMemory::wipe(syncKey.data(), syncKey.size());
+}
+
+SyncEngine::~SyncEngine() {
+    delete m_backend;
+    delete m_session;
+    SecureMemory::wipe(const_cast<char*>(m_masterKey.constData()), m_masterKey.size());
+}
+
+void SyncEngine::setBackend(SyncBackend *backend) {
+    if (backend != m_backend) {
+        delete m_backend;
+        m_backend = backend;
+    }
+}
+
+bool SyncEngine::sync(Result *result, QString *error) {
+    if (!m_backend) {
+        if (error) *error = "No sync backend is configured.";
+        return false;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    Result local;
+    // Pull first: pushing then sends only what survived the merge
+    bool ok = m_backend->test(error) && pull(local, error) && push(local, error);
+    local.elapsedMs = timer.elapsed();
+    
+    qDebug() << "Sync with" << m_backend->description() << (ok ? "done:" : "failed:")
+             << local.pulled << "pulled," << local.pushed << "pushed in" 
+             << local.elapsedMs << "ms";
+    if (result) *result = local;
+    return ok;
+}
+
+bool SyncEngine::pull(Result &result, QString *error) {
+    const VaultSettings::SyncOption option = m_settings->syncOption();
+    
+    // Cursors move in the same transaction as the changes they cover
+    if (!m_database->beginTransaction()) {
+        if (error) *error = "Cannot start a transaction on the vault.";
+        return false;
+    }
+    
+    for (const QString &device : m_backend->devices()) {
+        if (device == m_deviceId) continue;
+        
+        // A vault copied from that device already holds what it wrote
+        quint64 cursor = qMax(storedSequence(CursorKeyPrefix + device),
+                              storedSequence(SequenceKeyPrefix + device));
+        const quint64 start = cursor;
+        
+        QByteArray sealed;
+        while (m_backend->read(device, cursor + 1, &sealed)) {
+            SyncRecord record;
+            if (!SyncRecord::open(sealed, *m_session, device, cursor + 1, &record)) {
+                result.warnings.append(QString("Cannot read record %1 of device %2.")
+                                           .arg(cursor + 1).arg(device));
+                break;
+            }
+            
+            if (record.kind == SyncRecord::EntryChange) {
+                if (option != VaultSettings::SettingsOnly &&
+                    !applyEntryChange(record, device, result)) {
+                    m_database->rollbackTransaction();
+                    if (error) *error = "Failed to apply a synced entry.";
+                    return false;
+                }
+            } else if (option != VaultSettings::PasswordsOnly) {
+                applySettingsChange(record, result);
+            }
+            
+            ++cursor;
+            ++result.pulled;
+        }
+        
+        if (cursor != start) {
+            m_database->setSetting(CursorKeyPrefix + device, QString::number(cursor));
+        }
+    }
+    
+    if (!m_database->commitTransaction()) {
+        m_database->rollbackTransaction();
+        if (error) *error = "Failed to save synced changes.";
+        return false;
+    }
+    
+    if (result.settingsChanged) {
+        m_settings->load();
+    }
+    return true;
+}
+
+bool SyncEngine::push(Result &result, QString *error) {
+    const VaultSettings::SyncOption option = m_settings->syncOption();
+    const QString sequenceKey = SequenceKeyPrefix + m_deviceId;
+    
+    // Skip past records written by a sync that was cut short before it
+    // could save the sequence, so none is ever overwritten
+    quint64 sequence = storedSequence(sequenceKey);
+    while (m_backend->exists(m_deviceId, sequence + 1)) {
+        ++sequence;
+    }
+    
+    auto publish = [&](const SyncRecord &record) {
+        QByteArray sealed = SyncRecord::seal(record, *m_session, m_deviceId, sequence + 1);
+        if (sealed.isEmpty() || !m_backend->write(m_deviceId, sequence + 1, sealed, error)) {
+            return false;
+        }
+        ++sequence;
+        ++result.pushed;
+        m_database->setSetting(sequenceKey, QString::number(sequence));
+        return true;
+    };
+    
+    // With SettingsOnly the journal cursor stays put, so entries go out once
+    // the option includes them again
+    if (option != VaultSettings::SettingsOnly) {
+        const QString journalKey = JournalKeyPrefix + m_deviceId;
+        const QList<Database::JournalEntry> changes = m_database->journalSince(
+            m_database->getSetting(journalKey, "0").toString().toLongLong(), m_deviceId);
+        
+        // An entry changed several times goes out once, with its current
+        // state, at its last change
+        QHash<QString, qint64> lastChange;
+        for (const Database::JournalEntry &change : changes) {
+            lastChange.insert(change.uuid, change.sequence);
+        }
+        
+        for (const Database::JournalEntry &change : changes) {
+            if (lastChange.value(change.uuid) != change.sequence) {
+                continue;
+            }
+            
+            Database::EntryVersion version;
+            m_database->entryVersion(change.uuid, version);
+            
+            SyncRecord record;
+            record.kind = SyncRecord::EntryChange;
+            record.uuid = change.uuid;
+            record.deleted = version.deleted;
+            record.clock = version.clock;
+            record.writer = version.writer;
+            record.modified = version.changed;
+            
+            if (record.deleted || 
+                m_database->getEntryByUuid(change.uuid, m_masterKey, record.entry)) {
+                if (!publish(record)) {
+                    return false;
+                }
+            }
+            m_database->setSetting(journalKey, QString::number(change.sequence));
+        }
+    }
+    
+    if (option != VaultSettings::PasswordsOnly) {
+        SyncRecord record;
+        record.kind = SyncRecord::SettingsChange;
+        record.settings = syncedSettings();
+        record.modified = QDateTime::currentDateTimeUtc();
+        
+        QByteArray digest = settingsDigest(record.settings);
+        if (digest != m_database->getSetting(SettingsDigestKey).toByteArray()) {
+            if (!publish(record)) {
+                return false;
+            }
+            m_database->setSetting(SettingsDigestKey, QString::fromLatin1(digest));
+            storeSettingsBase(record.settings);
+        }
+    }
+    
+    return true;
+}
+
+bool SyncEngine::applyEntryChange(const SyncRecord &record, const QString &device,
+                                  Result &result) {
+    Database::EntryVersion remote;
+    remote.clock = record.clock;
+    remote.writer = record.writer;
+    remote.changed = record.modified;
+    remote.deleted = record.deleted;
+    
+    Database::EntryVersion local;
+    m_database->entryVersion(record.uuid, local);
+    
+    const EntryMerge::Outcome outcome = EntryMerge::resolve(local, remote);
+    const Database::EntryVersion merged = EntryMerge::merged(local, remote, outcome);
+    
+    if (outcome == EntryMerge::KeepLocal) {
+        // Remember the remote clock, so the losing version is recognised as
+        // already seen when it comes round again through another device
+        return merged.clock == local.clock || 
+               m_database->setEntryVersion(record.uuid, merged, device);
+    }
+    
+    if (record.deleted) {
+        int id = m_database->deleteSyncedEntry(record.uuid, merged);
+        if (id < 0) {
+            return false;
+        }
+        if (id > 0) {
+            result.changedEntries.removeAll(id);
+            result.removedEntries.append(id);
+        }
+        return true;
+    }
+    
+    PasswordEntry entry = record.entry;
+    if (!m_database->putSyncedEntry(record.uuid, entry, m_masterKey, merged)) {
+        return false;
+    }
+    if (!result.changedEntries.contains(entry.id())) {
+        result.changedEntries.append(entry.id());
+    }
+    return true;
+}
+
+void SyncEngine::applySettingsChange(const SyncRecord &record, Result &result) {
+    // Records carry every synced setting. Keys changed here since the last
+    // sync keep their local value, which the push that follows sends on;
+    // the others take the record's.
+    const QVariantMap local = syncedSettings();
+    const QVariantMap base = settingsBase(local);
+    
+    QVariantMap remote;
+    for (auto it = record.settings.constBegin(); it != record.settings.constEnd(); ++it) {
+        if (!it.key().startsWith(SyncedSettingsPrefix)) continue;
+        remote.insert(it.key(), it.value());
+        
+        const bool changedHere = local.contains(it.key()) != base.contains(it.key()) ||
+            local.value(it.key()).toString() != base.value(it.key()).toString();
+        if (changedHere) {
+            qDebug() << "Keeping local change of" << it.key() << "over the synced value";
+        } else if (!local.contains(it.key()) ||
+                   local.value(it.key()).toString() != it.value().toString()) {
+            m_database->setSetting(it.key(), it.value());
+            result.settingsChanged = true;
+        }
+    }
+    
+    // What arrived is now the shared state. Local changes that were kept
+    // leave the settings different from it, so the push sends them.
+    m_database->setSetting(SettingsDigestKey, QString::fromLatin1(settingsDigest(remote)));
+    storeSettingsBase(remote);
+}
+
+QVariantMap SyncEngine::settingsBase(const QVariantMap &local) const {
+    const QString stored = m_database->getSetting(SettingsBaseKey).toString();
+    if (!stored.isEmpty()) {
+        return QJsonDocument::fromJson(stored.toUtf8()).object().toVariantMap();
+    }
+    
+    // Vaults synced before the base was kept only have its digest: if the
+    // settings still match it nothing changed here, otherwise all of them
+    // count as changed
+    if (settingsDigest(local) == m_database->getSetting(SettingsDigestKey).toByteArray()) {
+        return local;
+    }
+    return QVariantMap();
+}
+
+void SyncEngine::storeSettingsBase(const QVariantMap &settings) {
+    // Compared as strings, the same way settingsDigest() sees them
+    QJsonObject base;
+    for (auto it = settings.constBegin(); it != settings.constEnd(); ++it) {
+        base.insert(it.key(), it.value().toString());
+    }
+    m_database->setSetting(SettingsBaseKey, 
+                           QString::fromUtf8(QJsonDocument(base).toJson(QJsonDocument::Compact)));
+}
+
+QVariantMap SyncEngine::syncedSettings() const {
+    QVariantMap settings;
+    for (const QString &key : m_database->getAllSettingKeys()) {
+        if (key.startsWith(SyncedSettingsPrefix)) {
+            settings.insert(key, m_database->getSetting(key));
+        }
+    }
+    return settings;
+}
+
+QByteArray SyncEngine::settingsDigest(const QVariantMap &settings) {
+    // QVariantMap iterates in key order, so equal settings hash equally
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    for (auto it = settings.constBegin(); it != settings.constEnd(); ++it) {
+        hash.addData(it.key().toUtf8());
+        hash.addData(QByteArray(1, '\0'));
+        hash.addData(it.value().toString().toUtf8());
+        hash.addData(QByteArray(1, '\0'));
+    }
+    return hash.result().toHex();
+}
+
+quint64 SyncEngine::storedSequence(const QString &key) const {
+    return m_database->getSetting(key, "0").toString().toULongLong();
+}
@@ -0,0 +1,74 @@
+#ifndef SYNCENGINE_H
+#define SYNCENGINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVariantMap>
+#include "syncbackend.h"
+#include "syncrecord.h"
+#include "../storage/database.h"
+#include "../models/settings.h"
+
+// Exchanges per-entry change records with other devices through a
+// SyncBackend, as selected by VaultSettings::syncOption. A sync pulls the
+// records the other devices wrote since the last sync, then pushes the
+// entries this device changed since its last push, read from the vault's
+// change journal, so a one-entry edit costs one small record in each
+// direction whatever the size of the vault.
+//
+// Devices must start from copies of the same vault: records are sealed with
+// a key derived from the master key, and entries are matched by uuid.
+// Every record carries the entry's vector clock; EntryMerge settles
+// conflicting changes, the same way on every device.
+//
+// Runs on the thread that owns the database.
+class SyncEngine {
+public:
+    struct Result {
+        int pushed = 0;
+        int pulled = 0;
+        // Local ids, for updating the entry list
+        QList<int> changedEntries;
+        QList<int> removedEntries;
+        bool settingsChanged = false;
+        // Devices whose records could not be read, which usually means
+        // they sync a different vault through the same backend
+        QStringList warnings;
+        qint64 elapsedMs = 0;
+    };
+
+    SyncEngine(Database *database, VaultSettings *settings, const QByteArray &masterKey);
+    ~SyncEngine();
+
+    SyncEngine(const SyncEngine &) = delete;
+    SyncEngine &operator=(const SyncEngine &) = delete;
+
+    // Takes ownership; nullptr disables syncing
+    void setBackend(SyncBackend *backend);
+    SyncBackend *backend() const { return m_backend; }
+
+    bool sync(Result *result, QString *error = nullptr);
+
+private:
+    bool pull(Result &result, QString *error);
+    bool push(Result &result, QString *error);
+    bool applyEntryChange(const SyncRecord &record, const QString &device, Result &result);
+    void applySettingsChange(const SyncRecord &record, Result &result);
+    QVariantMap syncedSettings() const;
+    // The synced settings as of the last sync; local is used to tell
+    // whether anything changed when none was stored
+    QVariantMap settingsBase(const QVariantMap &local) const;
+    void storeSettingsBase(const QVariantMap &settings);
+    static QByteArray settingsDigest(const QVariantMap &settings);
+    quint64 storedSequence(const QString &key) const;
+
+    Database *m_database;
+    VaultSettings *m_settings;
+    QByteArray m_masterKey;
+    Encryption::Session *m_session;
+    SyncBackend *m_backend;
+    QString m_deviceId;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "syncrecord.h"
+#include "../crypto/securememory.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+static const char RecordMagic[] = "PMSYNC1";
+
+static QString timestamp(const QDateTime &time) {
+    return time.toUTC().toString(Qt::ISODateWithMs);
+}
+
+// Same types Database::getSetting knows how to restore
+static QVariant settingValue(const QString &value, const QString &type) {
+    if (type == "bool") {
+        return QVariant(value == "true" || value == "1");
+    } else if (type == "int") {
+        return QVariant(value.toInt());
+    } else if (type == "double") {
+        return QVariant(value.toDouble());
+    }
+    return QVariant(value);
+}
+
+QByteArray SyncRecord::seal(const SyncRecord &record, const Encryption::Session &session,
+                            const QString &device, quint64 sequence) {
+    QJsonObject json;
+    json["modified"] = timestamp(record.modified);
+    
+    if (record.kind == SettingsChange) {
+        json["kind"] = "settings";
+        QJsonObject settings;
+        for (auto it = record.settings.constBegin(); it != record.settings.constEnd(); ++it) {
+            settings[it.key()] = QJsonObject{
+                { "value", it.value().toString() },
+                { "type", QString(it.value().typeName()) }
+            };
+        }
+        json["settings"] = settings;
+    } else {
+        json["kind"] = "entry";
+        json["uuid"] = record.uuid;
+        json["deleted"] = record.deleted;
+        json["clock"] = record.clock.toString();
+        json["writer"] = record.writer;
+        if (!record.deleted) {
+            const PasswordEntry &entry = record.entry;
+            json["title"] = entry.title();
+            json["username"] = entry.username();
+            json["password"] = entry.password().toString();
+            json["url"] = entry.url();
+            json["notes"] = entry.notes().toString();
+            json["created"] = timestamp(entry.created());
+        }
+    }
+    
+    QByteArray payload = QJsonDocument(json).toJson(QJsonDocument::Compact);
+    QByteArray sealed = session.seal(payload, associatedData(device, sequence));
+    SecureMemory::wipe(payload.data(), payload.size());
+    return sealed;
+}
+
+bool SyncRecord::open(const QByteArray &sealed, const Encryption::Session &session,
+                      const QString &device, quint64 sequence, SyncRecord *record) {
+    bool ok = false;
+    QByteArray payload = session.open(sealed, associatedData(device, sequence), &ok);
+    if (!ok) {
+        return false;
+    }
+    
+    QJsonObject json = QJsonDocument::fromJson(payload).object();
+    SecureMemory::wipe(payload.data(), payload.size());
+    
+    record->modified = QDateTime::fromString(json["modified"].toString(), Qt::ISODateWithMs);
+    QString kind = json["kind"].toString();
+    
+    if (kind == "settings") {
+        record->kind = SettingsChange;
+        record->settings.clear();
+        const QJsonObject settings = json["settings"].toObject();
+        for (auto it = settings.constBegin(); it != settings.constEnd(); ++it) {
+            QJsonObject setting = it.value().toObject();
+            record->settings.insert(it.key(), settingValue(setting["value"].toString(),
+                                                           setting["type"].toString()));
+        }
+        return true;
+    }
+    
+    if (kind != "entry") {
+        return false;
+    }
+    
+    record->kind = EntryChange;
+    record->uuid = json["uuid"].toString();
+    record->deleted = json["deleted"].toBool();
+    record->clock = VectorClock::fromString(json["clock"].toString());
+    record->writer = json["writer"].toString();
+    if (!record->deleted) {
+        record->entry = PasswordEntry(0, json["title"].toString(), json["username"].toString(),
+            json["password"].toString(), json["url"].toString(), json["notes"].toString(),
+            QDateTime::fromString(json["created"].toString(), Qt::ISODateWithMs),
+            record->modified);
+    }
+    return !record->uuid.isEmpty() && !record->writer.isEmpty() && record->modified.isValid();
+}
+
+QByteArray SyncRecord::associatedData(const QString &device, quint64 sequence) {
+    QByteArray associatedData(RecordMagic);
+    associatedData.append(device.toLatin1());
+    char sequenceBytes[8];
+    qToBigEndian<quint64>(sequence, sequenceBytes);
+    associatedData.append(sequenceBytes, 8);
+    return associatedData;
+}
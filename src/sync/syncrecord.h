@@ -0,0 +1,49 @@
+#ifndef SYNCRECORD_H
+#define SYNCRECORD_H
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QVariantMap>
+#include "../crypto/encryption.h"
+#include "../storage/vectorclock.h"
+#include "../models/passwordentry.h"
+
+// One change as exchanged between devices: the full state of a single entry,
+// its deletion, or the synced vault settings. The payload is compact JSON
+// sealed with the sync key; the writer and the sequence number are bound as
+// associated data, so a record cannot be replayed in another slot:
+//
+//   record = Encryption::seal(json, syncKey, aad)
+//   aad    = "PMSYNC1" || device (32 ASCII hex) || sequence (uint64 big-endian)
+class SyncRecord {
+public:
+    enum Kind {
+        EntryChange,
+        SettingsChange
+    };
+
+    Kind kind = EntryChange;
+    // When the change was made on the writing device
+    QDateTime modified;
+
+    // EntryChange
+    QString uuid;
+    bool deleted = false;
+    VectorClock clock;      // Of the version carried, see Database::EntryVersion
+    QString writer;         // Device that made that version
+    PasswordEntry entry;    // Unused when deleted; its id is meaningless
+
+    // SettingsChange: every synced setting, not just the changed ones
+    QVariantMap settings;
+
+    static QByteArray seal(const SyncRecord &record, const Encryption::Session &session,
+                           const QString &device, quint64 sequence);
+    static bool open(const QByteArray &sealed, const Encryption::Session &session,
+                     const QString &device, quint64 sequence, SyncRecord *record);
+
+private:
+    static QByteArray associatedData(const QString &device, quint64 sequence);
+};
+
+#endif
@@ -1,6 +1,12 @@
 #include "loginwindow.h"
 #include "mainwindow.h"
-#include "../crypto/encryption.h"
+#include "../crypto/kdfheader.h"
+#include "../crypto/securememory.h"
+#include <QApplication>
+#include <QProgressDialog>
+#include <QFutureWatcher>
+#include <QEventLoop>
+#include <QtConcurrent>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QMessageBox>
@@ -8,7 +14,8 @@
 #include <QFile>
 
 LoginWindow::LoginWindow(const QString &vaultPath)
-    : QWidget(nullptr), m_database(new Database()), m_vaultPath(vaultPath) {
+    : QWidget(nullptr), m_database(new Database()), m_vaultPath(vaultPath),
+      m_unlockService(new UnlockService(this)) {
     setAttribute(Qt::WA_DeleteOnClose);
     setupUi();
     
@@ -29,6 +36,8 @@ LoginWindow::LoginWindow(const QString &vaultPath)
 }
 
 LoginWindow::~LoginWindow() {
+    m_unlockService->cancel();
+    
     if (m_database) {
         delete m_database;
     }
@@ -62,6 +71,14 @@ void LoginWindow::setupUi() {
     m_loginButton = new QPushButton("Unlock Vault", this);
     m_createVaultButton = new QPushButton("Initialize Vault", this);
     
+    m_progressBar = new QProgressBar(this);
+    m_progressBar->setRange(0, 100);
+    m_progressBar->setTextVisible(false);
+    m_progressBar->hide();
+    
+    m_cancelButton = new QPushButton("Cancel", this);
+    m_cancelButton->hide();
+    
     mainLayout->addWidget(titleLabel);
     mainLayout->addWidget(m_statusLabel);
     mainLayout->addSpacing(10);
@@ -70,16 +87,25 @@ void LoginWindow::setupUi() {
     mainLayout->addSpacing(10);
     mainLayout->addWidget(m_loginButton);
     mainLayout->addWidget(m_createVaultButton);
+    mainLayout->addWidget(m_progressBar);
+    mainLayout->addWidget(m_cancelButton);
     mainLayout->addStretch();
     
     connect(m_loginButton, &QPushButton::clicked, this, &LoginWindow::onLoginClicked);
     connect(m_createVaultButton, &QPushButton::clicked, this, &LoginWindow::onCreateVaultClicked);
     connect(m_passwordInput, &QLineEdit::returnPressed, this, &LoginWindow::onLoginClicked);
+    connect(m_cancelButton, &QPushButton::clicked, m_unlockService, &UnlockService::cancel);
+    
+    connect(m_unlockService, &UnlockService::progressChanged, 
+            m_progressBar, &QProgressBar::setValue);
+    connect(m_unlockService, &UnlockService::unlocked, this, &LoginWindow::onUnlocked);
+    connect(m_unlockService, &UnlockService::rejected, this, &LoginWindow::onUnlockRejected);
+    connect(m_unlockService, &UnlockService::cancelled, this, &LoginWindow::onUnlockCancelled);
+    connect(m_unlockService, &UnlockService::failed, this, &LoginWindow::onUnlockFailed);
 }
 
 bool LoginWindow::checkIfVaultExists() {
-    QByteArray salt = m_database->getUserSalt();
-    return !salt.isEmpty();
+    return m_database->getKdfHeader().isValid();
 }
 
 void LoginWindow::onCreateVaultClicked() {
@@ -95,6 +121,8 @@ void LoginWindow::onCreateVaultClicked() {
 }
 
 void LoginWindow::onLoginClicked() {
+    if (m_unlockService->isRunning()) return;
+    
     QString password = m_passwordInput->text();
     
     if (password.isEmpty()) {
@@ -107,10 +135,34 @@ void LoginWindow::onLoginClicked() {
 }
 
 void LoginWindow::createVault(const QString &masterPassword) {
-    QByteArray salt = Encryption::generateSalt();
-    QString passwordHash = Encryption::hashPassword(masterPassword);
+    // A random master key, wrapped under a derivation calibrated for this
+    // machine. Benchmarking and one KDF pass take about a second, so they
+    // run on the thread pool behind a busy dialog; the key never leaves it.
+    QProgressDialog progressDialog("Tuning the key derivation for this computer...", 
+                                   QString(), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    progressDialog.setCancelButton(nullptr);
+    progressDialog.show();
+    
+    QFutureWatcher<KdfHeader> watcher;
+    QEventLoop loop;
+    connect(&watcher, &QFutureWatcher<KdfHeader>::finished, &loop, &QEventLoop::quit);
+    watcher.setFuture(QtConcurrent::run([masterPassword]() {
+        QByteArray masterKey = Encryption::generateKey();
+        KdfHeader header = masterKey.isEmpty() ? KdfHeader()
+                                               : KdfHeader::forMasterKey(masterPassword, masterKey);
+        SecureMemory::wipe(masterKey.data(), masterKey.size());
+        return header;
+    }));
+    loop.exec();
+    progressDialog.reset();
+    
+    // The database connection belongs to this thread
+    KdfHeader header = watcher.future().takeResult();
+    bool created = header.isValid() && m_database->createUser(header);
     
-    if (m_database->createUser(passwordHash, salt)) {
+    if (created) {
         QMessageBox::information(this, "Success", 
             "Vault initialized successfully! You can now unlock it.");
         
@@ -125,29 +177,60 @@ void LoginWindow::createVault(const QString &masterPassword) {
 }
 
 void LoginWindow::unlockVault(const QString &masterPassword) {
-    QString passwordHash = Encryption::hashPassword(masterPassword);
+    // The password is checked against the key the service derives; key
+    // derivation and decryption run in the background
+    setUnlocking(true);
+    m_unlockService->start(m_database, masterPassword);
+}
+
+void LoginWindow::onUnlocked(const QByteArray &masterKey, const QList<PasswordEntry> &entries) {
+    setUnlocking(false);
+    m_passwordInput->clear();
     
-    if (m_database->verifyUser(passwordHash)) {
-        QByteArray salt = m_database->getUserSalt();
-        QByteArray masterKey = Encryption::deriveMasterKey(masterPassword, salt);
-        
-        MainWindow *mainWindow = new MainWindow(m_database, masterKey, m_vaultPath);
-        mainWindow->setAttribute(Qt::WA_DeleteOnClose);
-        mainWindow->show();
-        
-        // Transfer ownership of database to main window
-        m_database = nullptr;
-        
-        // Hide login window but don't close it
-        hide();
-        
-        // When main window closes, close login window (which triggers vault manager to show)
-        connect(mainWindow, &QObject::destroyed, this, &LoginWindow::onMainWindowClosed);
-    } else {
-        QMessageBox::warning(this, "Authentication Failed", 
-            "Incorrect master password. Please try again.");
-        m_passwordInput->clear();
-        m_passwordInput->setFocus();
+    MainWindow *mainWindow = new MainWindow(m_database, masterKey, entries, m_vaultPath);
+    mainWindow->setAttribute(Qt::WA_DeleteOnClose);
+    mainWindow->show();
+    
+    // Transfer ownership of database to main window
+    m_database = nullptr;
+    
+    // Hide login window but don't close it
+    hide();
+    
+    // When main window closes, close login window (which triggers vault manager to show)
+    connect(mainWindow, &QObject::destroyed, this, &LoginWindow::onMainWindowClosed);
+}
+
+void LoginWindow::onUnlockRejected() {
+    setUnlocking(false);
+    QMessageBox::warning(this, "Authentication Failed", 
+        "Incorrect master password. Please try again.");
+    m_passwordInput->clear();
+    m_passwordInput->setFocus();
+}
+
+void LoginWindow::onUnlockCancelled() {
+    setUnlocking(false);
+    m_passwordInput->setFocus();
+}
+
+void LoginWindow::onUnlockFailed(const QString &message) {
+    setUnlocking(false);
+    QMessageBox::critical(this, "Error", message);
+    m_passwordInput->setFocus();
+}
+
+void LoginWindow::setUnlocking(bool unlocking) {
+    m_passwordInput->setEnabled(!unlocking);
+    m_loginButton->setEnabled(!unlocking);
+    m_progressBar->setVisible(unlocking);
+    m_cancelButton->setVisible(unlocking);
+    m_statusLabel->setText(unlocking 
+        ? QString("Unlocking %1...").arg(QFileInfo(m_vaultPath).fileName())
+        : QString("Vault: %1").arg(QFileInfo(m_vaultPath).fileName()));
+    
+    if (unlocking) {
+        m_progressBar->setValue(0);
     }
 }
 
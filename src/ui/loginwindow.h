@@ -5,7 +5,9 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QLabel>
+#include <QProgressBar>
 #include "../storage/database.h"
+#include "../storage/unlockservice.h"
 
 class LoginWindow : public QWidget {
     Q_OBJECT
@@ -18,20 +20,28 @@ private slots:
     void onLoginClicked();
     void onCreateVaultClicked();
     void onMainWindowClosed();
+    void onUnlocked(const QByteArray &masterKey, const QList<PasswordEntry> &entries);
+    void onUnlockRejected();
+    void onUnlockCancelled();
+    void onUnlockFailed(const QString &message);
 
 private:
     QLineEdit *m_passwordInput;
     QPushButton *m_loginButton;
     QPushButton *m_createVaultButton;
     QLabel *m_statusLabel;
+    QProgressBar *m_progressBar;
+    QPushButton *m_cancelButton;
     
     Database *m_database;
     QString m_vaultPath;
+    UnlockService *m_unlockService;
     
     void setupUi();
     bool checkIfVaultExists();
     void createVault(const QString &masterPassword);
     void unlockVault(const QString &masterPassword);
+    void setUnlocking(bool unlocking);
 };
 
 #endif
\ No newline at end of file
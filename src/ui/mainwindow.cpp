@@ -2,6 +2,9 @@
 #include "passworddialog.h"
 #include "settingsdialog.h"
 #include "thememanager.h"
+#include "../export/vaultexporter.h"
+#include "../sync/directorysyncbackend.h"
+#include "../crypto/securememory.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QHeaderView>
@@ -14,30 +17,66 @@
 #include <QCloseEvent>
 #include <QFile>
 #include <QTimer>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QInputDialog>
+#include <QFutureWatcher>
+#include <QEventLoop>
+#include <QtConcurrent>
+#include <openssl/crypto.h>
+
+// How often automatic sync polls the backend, in ms
+static const int AutoSyncInterval = 60 * 1000;
 
 MainWindow::MainWindow(Database *database, const QByteArray &masterKey, 
+                       const QList<PasswordEntry> &entries,
                        const QString &vaultPath, QWidget *parent)
     : QMainWindow(parent), 
       m_database(database), 
-      m_masterKey(masterKey),
+      // A buffer of our own, not shared with the login window's copy
+      m_masterKey(masterKey.constData(), masterKey.size()),
       m_vaultPath(vaultPath),
+      m_importProgress(nullptr),
       m_appSettings(new AppSettings()),
       m_vaultSettings(new VaultSettings(database)),  // Pass database to VaultSettings
+      m_backupScheduler(nullptr),
+      m_backupRequested(false),
+      m_syncEngine(nullptr),
+      m_syncTimer(nullptr),
       m_clipboardTimer(nullptr),
       m_autoLockTimer(nullptr) {
     setAttribute(Qt::WA_DeleteOnClose);
+    SecureMemory::lockPages(m_masterKey.data(), m_masterKey.size());
     setupUi();
-    loadPasswords();
+    
+    // Entries were already decrypted while the vault was unlocking
+    m_model->setEntries(entries);
+    m_searchScheduler->setEntries(m_model->store());
     
     // Setup auto-lock timer
     setupAutoLock();
     
+    m_backupScheduler = new BackupScheduler(m_database, m_vaultSettings, this);
+    connect(m_backupScheduler, &BackupScheduler::backupFinished, 
+            this, &MainWindow::onBackupFinished);
+    connect(m_backupScheduler, &BackupScheduler::backupFailed, 
+            this, &MainWindow::onBackupFailed);
+    
+    m_syncEngine = new SyncEngine(m_database, m_vaultSettings, m_masterKey);
+    m_syncTimer = new QTimer(this);
+    m_syncTimer->setInterval(AutoSyncInterval);
+    connect(m_syncTimer, &QTimer::timeout, this, &MainWindow::onAutoSync);
+    applySyncSettings();
+    
     // Connect to theme changes
     connect(ThemeManager::instance(), &ThemeManager::themeChanged, 
             this, &MainWindow::onThemeChanged);
 }
 
 MainWindow::~MainWindow() {
+    // Waits for a running backup before the vault goes away
+    delete m_backupScheduler;
+    delete m_syncEngine;
     if (m_database) {
         delete m_database;
     }
@@ -56,9 +95,26 @@ MainWindow::~MainWindow() {
 }
 
 void MainWindow::closeEvent(QCloseEvent *event) {
-    // Clear sensitive data from memory
-    m_masterKey.fill(0);
-    m_allEntries.clear();
+    // The window is only deleted later, so stop everything that could still
+    // write to the vault before the key goes: a sync tick, the next chunk of
+    // an import, a scheduled backup. Quietly, as the window is going away.
+    m_syncTimer->stop();
+    disconnect(m_importService, nullptr, this, nullptr);
+    m_importService->cancel();
+    if (m_importProgress) {
+        m_importProgress->deleteLater();
+        m_importProgress = nullptr;
+    }
+    // Waits for a running backup
+    delete m_backupScheduler;
+    m_backupScheduler = nullptr;
+    
+    // Clear sensitive data from memory. Wiped through constData, as fill()
+    // would detach and zero a fresh copy; the sync engine and the import
+    // service keep copies of their own.
+    SecureMemory::wipe(const_cast<char*>(m_masterKey.constData()), m_masterKey.size());
+    m_model->clear();
+    m_searchScheduler->clear();
     
     // Clear clipboard if it contains password data
     if (m_appSettings->clearClipboardAfterCopy()) {
@@ -100,32 +156,50 @@ void MainWindow::setupUi() {
     buttonLayout->addStretch();
     
     // Table
-    m_tableWidget = new QTableWidget(this);
-    m_tableWidget->setColumnCount(4);
-    m_tableWidget->setHorizontalHeaderLabels({"Title", "Username", "URL", "Modified"});
-    m_tableWidget->setSelectionBehavior(QAbstractItemView::SelectRows);
-    m_tableWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    m_tableWidget->setContextMenuPolicy(Qt::CustomContextMenu);
+    m_model = new PasswordTableModel(this);
+    m_proxyModel = new PasswordFilterProxyModel(this);
+    m_searchScheduler = new SearchScheduler(this);
+    m_importService = new ImportService(this);
+    m_proxyModel->setSourceModel(m_model);
+    
+    m_tableView = new QTableView(this);
+    m_tableView->setModel(m_proxyModel);
+    m_tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_tableView->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_tableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_tableView->setContextMenuPolicy(Qt::CustomContextMenu);
+    
+    // Fixed row heights let the view lay out large vaults without measuring rows
+    m_tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     
     // Make table columns resize properly
-    m_tableWidget->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
-    m_tableWidget->horizontalHeader()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
-    m_tableWidget->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Stretch);
-    m_tableWidget->horizontalHeader()->setSectionResizeMode(3, QHeaderView::ResizeToContents);
+    m_tableView->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    m_tableView->horizontalHeader()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+    m_tableView->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Stretch);
+    m_tableView->horizontalHeader()->setSectionResizeMode(3, QHeaderView::ResizeToContents);
     
     mainLayout->addLayout(searchLayout);
     mainLayout->addLayout(buttonLayout);
-    mainLayout->addWidget(m_tableWidget);
+    mainLayout->addWidget(m_tableView);
     
     // Menu bar
     QMenuBar *menuBar = new QMenuBar(this);
     
     QMenu *fileMenu = menuBar->addMenu("File");
+    QAction *importAction = fileMenu->addAction("Import...");
+    QAction *exportAction = fileMenu->addAction("Export...");
+    fileMenu->addSeparator();
+    QAction *backupAction = fileMenu->addAction("Back Up Now");
+    QAction *restoreAction = fileMenu->addAction("Restore Backup...");
+    fileMenu->addSeparator();
+    QAction *syncAction = fileMenu->addAction("Sync Now");
+    fileMenu->addSeparator();
     QAction *exitAction = fileMenu->addAction("Exit");
     
     QMenu *editMenu = menuBar->addMenu("Edit");
     QAction *settingsAction = editMenu->addAction("Settings...");
     settingsAction->setShortcut(QKeySequence("Ctrl+,"));
+    QAction *retuneAction = editMenu->addAction("Retune Unlock Speed...");
     
     QMenu *helpMenu = menuBar->addMenu("Help");
     QAction *aboutAction = helpMenu->addAction("About");
@@ -137,18 +211,31 @@ void MainWindow::setupUi() {
     connect(m_editButton, &QPushButton::clicked, this, &MainWindow::onEditPassword);
     connect(m_deleteButton, &QPushButton::clicked, this, &MainWindow::onDeletePassword);
     connect(m_searchBox, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
-    connect(m_tableWidget, &QTableWidget::cellDoubleClicked, this, &MainWindow::onTableDoubleClicked);
-    connect(m_tableWidget, &QTableWidget::itemSelectionChanged, [this]() {
-        bool hasSelection = !m_tableWidget->selectedItems().isEmpty();
+    connect(m_searchScheduler, &SearchScheduler::resultsReady, 
+            this, &MainWindow::onSearchResultsReady);
+    connect(m_importService, &ImportService::entriesImported, 
+            this, &MainWindow::onEntriesImported);
+    connect(m_importService, &ImportService::finished, this, &MainWindow::onImportFinished);
+    connect(m_importService, &ImportService::cancelled, this, &MainWindow::onImportCancelled);
+    connect(m_importService, &ImportService::failed, this, &MainWindow::onImportFailed);
+    connect(m_tableView, &QTableView::doubleClicked, this, &MainWindow::onTableDoubleClicked);
+    connect(m_tableView->selectionModel(), &QItemSelectionModel::selectionChanged, [this]() {
+        bool hasSelection = m_tableView->selectionModel()->hasSelection();
         m_editButton->setEnabled(hasSelection);
         m_deleteButton->setEnabled(hasSelection);
     });
+    connect(importAction, &QAction::triggered, this, &MainWindow::onImport);
+    connect(exportAction, &QAction::triggered, this, &MainWindow::onExport);
+    connect(backupAction, &QAction::triggered, this, &MainWindow::onBackupNow);
+    connect(restoreAction, &QAction::triggered, this, &MainWindow::onRestoreBackup);
+    connect(syncAction, &QAction::triggered, this, &MainWindow::onSyncNow);
     connect(exitAction, &QAction::triggered, this, &QMainWindow::close);
     connect(settingsAction, &QAction::triggered, this, &MainWindow::onOpenSettings);
+    connect(retuneAction, &QAction::triggered, this, &MainWindow::onRetuneKeyDerivation);
     connect(aboutAction, &QAction::triggered, this, &MainWindow::onShowAbout);
     
     // Context menu for table
-    connect(m_tableWidget, &QTableWidget::customContextMenuRequested, 
+    connect(m_tableView, &QTableView::customContextMenuRequested, 
             this, &MainWindow::onShowContextMenu);
 }
 
@@ -175,26 +262,22 @@ void MainWindow::onAutoLock() {
 }
 
 void MainWindow::loadPasswords() {
-    m_allEntries = m_database->getAllEntries(m_masterKey);
-    updateTable(m_allEntries);
+    QList<PasswordEntry> entries = m_database->getEntrySummaries(m_masterKey);
+    m_model->setEntries(entries);
+    m_searchScheduler->setEntries(m_model->store());
 }
 
-void MainWindow::updateTable(const QList<PasswordEntry> &entries) {
-    m_tableWidget->setRowCount(entries.size());
+int MainWindow::currentEntryId() const {
+    QModelIndex index = m_tableView->currentIndex();
+    if (!index.isValid()) return -1;
     
-    for (int i = 0; i < entries.size(); ++i) {
-        const PasswordEntry &entry = entries[i];
-        
-        m_tableWidget->setItem(i, 0, new QTableWidgetItem(entry.title()));
-        m_tableWidget->setItem(i, 1, new QTableWidgetItem(entry.username()));
-        m_tableWidget->setItem(i, 2, new QTableWidgetItem(entry.url()));
-        m_tableWidget->setItem(i, 3, new QTableWidgetItem(
-            entry.modified().toString("yyyy-MM-dd HH:mm")));
-        
-        m_tableWidget->item(i, 0)->setData(Qt::UserRole, entry.id());
-    }
+    return index.siblingAtColumn(PasswordTableModel::TitleColumn)
+        .data(PasswordTableModel::EntryIdRole).toInt();
 }
 
+// The handlers below patch the model in place, so a single change costs one
+// record seal instead of reloading the whole vault.
+
 void MainWindow::onAddPassword() {
     resetAutoLockTimer();
     
@@ -202,7 +285,8 @@ void MainWindow::onAddPassword() {
     if (dialog.exec() == QDialog::Accepted) {
         PasswordEntry entry = dialog.getPasswordEntry();
         if (m_database->addEntry(entry, m_masterKey)) {
-            loadPasswords();
+            m_model->addEntry(entry.summary());
+            m_searchScheduler->updateEntries(m_model->store(), { entry.id() });
         } else {
             QMessageBox::critical(this, "Error", "Failed to add password.");
         }
@@ -212,19 +296,16 @@ void MainWindow::onAddPassword() {
 void MainWindow::onEditPassword() {
     resetAutoLockTimer();
     
-    int currentRow = m_tableWidget->currentRow();
-    if (currentRow < 0) return;
-    
-    int entryId = m_tableWidget->item(currentRow, 0)->data(Qt::UserRole).toInt();
-    PasswordEntry entry = m_database->getEntry(entryId, m_masterKey);
+    int entryId = currentEntryId();
+    if (entryId < 0) return;
     
-    PasswordDialog dialog(entry, m_vaultSettings, this);
+    PasswordDialog dialog(m_database->getEntry(entryId, m_masterKey), m_vaultSettings, this);
     if (dialog.exec() == QDialog::Accepted) {
         PasswordEntry updatedEntry = dialog.getPasswordEntry();
-        updatedEntry.setId(entryId);
         
         if (m_database->updateEntry(updatedEntry, m_masterKey)) {
-            loadPasswords();
+            m_model->updateEntry(updatedEntry.summary());
+            m_searchScheduler->updateEntries(m_model->store(), { updatedEntry.id() });
         } else {
             QMessageBox::critical(this, "Error", "Failed to update password.");
         }
@@ -234,18 +315,19 @@ void MainWindow::onEditPassword() {
 void MainWindow::onDeletePassword() {
     resetAutoLockTimer();
     
-    int currentRow = m_tableWidget->currentRow();
-    if (currentRow < 0) return;
+    int entryId = currentEntryId();
+    int row = m_model->rowOfEntry(entryId);
+    if (row < 0) return;
     
-    QString title = m_tableWidget->item(currentRow, 0)->text();
+    QString title = m_model->store().title(row).toString();
     QMessageBox::StandardButton reply = QMessageBox::question(this, "Confirm Delete",
         QString("Are you sure you want to delete '%1'?").arg(title),
         QMessageBox::Yes | QMessageBox::No);
     
     if (reply == QMessageBox::Yes) {
-        int entryId = m_tableWidget->item(currentRow, 0)->data(Qt::UserRole).toInt();
         if (m_database->deleteEntry(entryId)) {
-            loadPasswords();
+            m_model->removeEntry(entryId);
+            m_searchScheduler->updateEntries(m_model->store(), { entryId });
         } else {
             QMessageBox::critical(this, "Error", "Failed to delete password.");
         }
@@ -257,27 +339,19 @@ void MainWindow::onSearchTextChanged(const QString &text) {
 }
 
 void MainWindow::filterPasswords(const QString &searchText) {
-    if (searchText.isEmpty()) {
-        updateTable(m_allEntries);
-        return;
-    }
-    
-    QList<PasswordEntry> filtered;
-    for (const PasswordEntry &entry : m_allEntries) {
-        if (entry.title().contains(searchText, Qt::CaseInsensitive) ||
-            entry.username().contains(searchText, Qt::CaseInsensitive) ||
-            entry.url().contains(searchText, Qt::CaseInsensitive)) {
-            filtered.append(entry);
-        }
-    }
-    
-    updateTable(filtered);
+    // Results arrive through onSearchResultsReady once matching finishes
+    m_searchScheduler->search(searchText);
 }
 
-void MainWindow::onTableDoubleClicked(int row, int column) {
+void MainWindow::onSearchResultsReady(const QString &query, 
+                                      const QList<FuzzyMatcher::Match> &matches) {
+    m_proxyModel->setSearchResults(query, matches);
+}
+
+void MainWindow::onTableDoubleClicked(const QModelIndex &index) {
     resetAutoLockTimer();
     
-    if (column == 1) {
+    if (index.column() == PasswordTableModel::UsernameColumn) {
         onCopyUsername();
     } else {
         onEditPassword();
@@ -287,9 +361,9 @@ void MainWindow::onTableDoubleClicked(int row, int column) {
 void MainWindow::onCopyUsername() {
     resetAutoLockTimer();
     
-    int currentRow = m_tableWidget->currentRow();
-    if (currentRow >= 0) {
-        QString username = m_tableWidget->item(currentRow, 1)->text();
+    int row = m_model->rowOfEntry(currentEntryId());
+    if (row >= 0) {
+        QString username = m_model->store().username(row).toString();
         QApplication::clipboard()->setText(username);
         
         if (m_appSettings->clearClipboardAfterCopy()) {
@@ -301,18 +375,358 @@ void MainWindow::onCopyUsername() {
 void MainWindow::onCopyPassword() {
     resetAutoLockTimer();
     
-    int currentRow = m_tableWidget->currentRow();
-    if (currentRow < 0) return;
+    int entryId = currentEntryId();
+    if (entryId < 0) return;
     
-    int entryId = m_tableWidget->item(currentRow, 0)->data(Qt::UserRole).toInt();
     PasswordEntry entry = m_database->getEntry(entryId, m_masterKey);
-    QApplication::clipboard()->setText(entry.password());
+    QApplication::clipboard()->setText(entry.password().toString());
     
     if (m_appSettings->clearClipboardAfterCopy()) {
         startClipboardTimer();
     }
 }
 
+void MainWindow::onImport() {
+    resetAutoLockTimer();
+    if (m_importService->isRunning()) return;
+    
+    const QString csvFilter = "CSV export (*.csv)";
+    const QString bitwardenFilter = "Bitwarden JSON export (*.json)";
+    const QString keePassFilter = "KeePass XML export (*.xml)";
+    QString selectedFilter;
+    QString path = QFileDialog::getOpenFileName(this, "Import Passwords", QString(),
+        csvFilter + ";;" + bitwardenFilter + ";;" + keePassFilter, &selectedFilter);
+    if (path.isEmpty()) return;
+    
+    EntryReader::Format format = EntryReader::formatForFile(path);
+    if (selectedFilter == bitwardenFilter) {
+        format = EntryReader::BitwardenJsonFormat;
+    } else if (selectedFilter == keePassFilter) {
+        format = EntryReader::KeePassXmlFormat;
+    } else if (selectedFilter == csvFilter) {
+        format = EntryReader::CsvFormat;
+    }
+    
+    m_importProgress = new QProgressDialog(
+        QString("Importing %1...").arg(EntryReader::formatName(format)), "Cancel", 0, 100, this);
+    m_importProgress->setWindowModality(Qt::WindowModal);
+    m_importProgress->setMinimumDuration(0);
+    m_importProgress->setAutoClose(false);
+    m_importProgress->setAutoReset(false);
+    connect(m_importProgress, &QProgressDialog::canceled, 
+            m_importService, &ImportService::cancel);
+    connect(m_importService, &ImportService::progressChanged, 
+            m_importProgress, &QProgressDialog::setValue);
+    
+    m_importService->start(m_database, m_masterKey, path, format);
+}
+
+void MainWindow::onEntriesImported(const QList<PasswordEntry> &entries) {
+    // An import keeps the vault busy, so it should not lock mid-way
+    resetAutoLockTimer();
+    m_model->addEntries(entries);
+}
+
+void MainWindow::onImportFinished(int imported, const QList<EntryReader::RowError> &errors) {
+    endImport();
+    
+    QString message = QString("Imported %1 entries.").arg(imported);
+    if (!errors.isEmpty()) {
+        // Enough to find the problem rows without flooding the dialog
+        const int shownErrors = 20;
+        message += QString("\n\n%1 rows were skipped:").arg(errors.size());
+        for (int i = 0; i < errors.size() && i < shownErrors; ++i) {
+            message += QString("\nRow %1: %2").arg(errors[i].row).arg(errors[i].message);
+        }
+        if (errors.size() > shownErrors) {
+            message += QString("\n... and %1 more").arg(errors.size() - shownErrors);
+        }
+        QMessageBox::warning(this, "Import", message);
+    } else {
+        QMessageBox::information(this, "Import", message);
+    }
+}
+
+void MainWindow::onImportCancelled(int imported) {
+    endImport();
+    QMessageBox::information(this, "Import", 
+        QString("Import cancelled. %1 entries were already imported.").arg(imported));
+}
+
+void MainWindow::onImportFailed(const QString &message, int imported) {
+    endImport();
+    QMessageBox::critical(this, "Import", 
+        QString("%1\n\n%2 entries were imported before the error.").arg(message).arg(imported));
+}
+
+void MainWindow::endImport() {
+    if (m_importProgress) {
+        m_importProgress->deleteLater();
+        m_importProgress = nullptr;
+    }
+    
+    m_searchScheduler->setEntries(m_model->store());
+}
+
+void MainWindow::onExport() {
+    resetAutoLockTimer();
+    if (m_importService->isRunning()) return;
+    
+    const QString encryptedFilter = "Encrypted export (*.pmx)";
+    const QString csvFilter = "CSV, unencrypted (*.csv)";
+    const QString jsonFilter = "Bitwarden JSON, unencrypted (*.json)";
+    QString selectedFilter = encryptedFilter;
+    QString path = QFileDialog::getSaveFileName(this, "Export Passwords", QString(),
+        encryptedFilter + ";;" + csvFilter + ";;" + jsonFilter, &selectedFilter);
+    if (path.isEmpty()) return;
+    
+    VaultExporter::Format format = VaultExporter::formatForFile(path);
+    if (selectedFilter == csvFilter) {
+        format = VaultExporter::CsvFormat;
+    } else if (selectedFilter == jsonFilter) {
+        format = VaultExporter::JsonFormat;
+    }
+    
+    QString password;
+    if (format == VaultExporter::EncryptedFormat) {
+        bool ok;
+        password = QInputDialog::getText(this, "Export Passwords", 
+            "Password for the export file:", QLineEdit::Password, QString(), &ok);
+        if (!ok) return;
+        QString confirmation = QInputDialog::getText(this, "Export Passwords",
+            "Confirm the password:", QLineEdit::Password, QString(), &ok);
+        if (!ok) return;
+        if (password.isEmpty() || password != confirmation) {
+            QMessageBox::warning(this, "Export", "The passwords are empty or do not match.");
+            return;
+        }
+    } else {
+        QMessageBox::StandardButton reply = QMessageBox::warning(this, "Export",
+            "The exported file will contain all passwords in plain text. Continue?",
+            QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+        if (reply != QMessageBox::Yes) return;
+    }
+    
+    // The database connection belongs to this thread, so the export runs
+    // here; the modal progress dialog keeps the window responsive
+    QProgressDialog progressDialog("Exporting passwords...", "Cancel", 0, 
+                                   m_model->rowCount(), this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+    
+    VaultExporter exporter(m_database, m_masterKey);
+    bool exported = exporter.exportTo(path, format, password, 
+        [&progressDialog](int completed, int total) {
+            progressDialog.setMaximum(total);
+            progressDialog.setValue(completed);
+            return !progressDialog.wasCanceled();
+        });
+    progressDialog.reset();
+    resetAutoLockTimer();
+    
+    if (exported) {
+        QMessageBox::information(this, "Export", 
+            QString("Exported %1 entries.").arg(exporter.exportedCount()));
+    } else if (!exporter.wasCancelled()) {
+        QMessageBox::critical(this, "Export", 
+            QString("Export failed: %1").arg(exporter.errorString()));
+    }
+}
+
+void MainWindow::onBackupNow() {
+    resetAutoLockTimer();
+    
+    if (!m_backupScheduler->backupNow()) {
+        if (m_backupScheduler->isRunning()) {
+            QMessageBox::information(this, "Backup", "A backup is already running.");
+        }
+        return;
+    }
+    
+    m_backupRequested = true;
+}
+
+void MainWindow::onBackupFinished(const BackupEngine::Snapshot &snapshot) {
+    // Scheduled backups finish silently
+    if (!m_backupRequested) return;
+    m_backupRequested = false;
+    
+    QMessageBox::information(this, "Backup", 
+        QString("Vault backed up to %1 in %2 ms.\n%3 KB of %4 KB were new.")
+            .arg(snapshot.path).arg(snapshot.elapsedMs)
+            .arg(snapshot.storedBytes / 1024).arg(snapshot.bytes / 1024));
+}
+
+void MainWindow::onRestoreBackup() {
+    resetAutoLockTimer();
+    
+    QString manifestPath = QFileDialog::getOpenFileName(this, "Restore Backup", 
+        m_backupScheduler->backupDirectory(), "Vault backups (*.manifest)");
+    if (manifestPath.isEmpty()) return;
+    
+    // Restoring over the open vault would pull it out from under the
+    // connection, so the backup is restored as a separate vault file
+    QString targetPath = QFileDialog::getSaveFileName(this, "Save Restored Vault",
+        QFileInfo(m_vaultPath).absolutePath(), "Vault files (*.db)");
+    if (targetPath.isEmpty()) return;
+    if (QFileInfo(targetPath).absoluteFilePath() == QFileInfo(m_vaultPath).absoluteFilePath()) {
+        QMessageBox::warning(this, "Restore Backup", "Cannot restore over the open vault.");
+        return;
+    }
+    
+    QString error;
+    if (BackupEngine::restore(manifestPath, targetPath, &error)) {
+        QMessageBox::information(this, "Restore Backup", 
+            QString("Backup restored to %1.").arg(targetPath));
+    } else {
+        QMessageBox::critical(this, "Restore Backup", 
+            QString("Restore failed: %1").arg(error));
+    }
+}
+
+void MainWindow::applySyncSettings() {
+    bool enabled = m_vaultSettings->syncEnabled() && !m_vaultSettings->syncFolder().isEmpty();
+    
+    // The change journal runs either way, so edits made while sync is off
+    // go out with the next sync
+    m_syncEngine->setBackend(enabled ? new DirectorySyncBackend(m_vaultSettings->syncFolder())
+                                     : nullptr);
+    
+    if (enabled && m_vaultSettings->autoSyncEnabled()) {
+        m_syncTimer->start();
+    } else {
+        m_syncTimer->stop();
+    }
+}
+
+bool MainWindow::runSync(QString *message) {
+    SyncEngine::Result result;
+    bool ok = m_syncEngine->sync(&result, message);
+    
+    for (int id : result.removedEntries) {
+        m_model->removeEntry(id);
+    }
+    for (int id : result.changedEntries) {
+        // The list only shows the summary, so password and notes stay sealed
+        PasswordEntry summary = m_database->getEntry(id, m_masterKey, EntryRecord::Summary);
+        if (m_model->rowOfEntry(id) >= 0) {
+            m_model->updateEntry(summary);
+        } else {
+            m_model->addEntry(summary);
+        }
+    }
+    if (!result.removedEntries.isEmpty() || !result.changedEntries.isEmpty()) {
+        m_searchScheduler->updateEntries(m_model->store(), 
+                                         result.removedEntries + result.changedEntries);
+    }
+    
+    if (ok && message) {
+        *message = QString("Received %1 and sent %2 changes.")
+                       .arg(result.pulled).arg(result.pushed);
+        if (!result.warnings.isEmpty()) {
+            *message += "\n\n" + result.warnings.join("\n");
+        }
+    }
+    return ok;
+}
+
+void MainWindow::onSyncNow() {
+    resetAutoLockTimer();
+    
+    if (!m_syncEngine->backend()) {
+        QMessageBox::information(this, "Sync", 
+            "Sync is not set up. Enable it and choose a sync folder in the settings.");
+        return;
+    }
+    
+    QString message;
+    if (runSync(&message)) {
+        QMessageBox::information(this, "Sync", message);
+    } else {
+        QMessageBox::warning(this, "Sync", QString("Sync failed: %1").arg(message));
+    }
+}
+
+void MainWindow::onAutoSync() {
+    // Failures are logged by the engine; the next tick tries again
+    runSync(nullptr);
+}
+
+void MainWindow::onBackupFailed(const QString &message) {
+    // A failing schedule would retry on every check, so only the backup
+    // asked for gets a dialog; the engine logs the others
+    if (!m_backupRequested) return;
+    m_backupRequested = false;
+    
+    QMessageBox::warning(this, "Backup", QString("Backup failed: %1").arg(message));
+}
+
+void MainWindow::onRetuneKeyDerivation() {
+    resetAutoLockTimer();
+    
+    bool ok;
+    QString password = QInputDialog::getText(this, "Retune Unlock Speed",
+        "The key derivation is benchmarked again on this computer, so that unlocking\n"
+        "takes about half a second here. Master password:",
+        QLineEdit::Password, QString(), &ok);
+    if (!ok) return;
+    
+    // Only the wrapping of the master key changes: entries, backups and
+    // synced devices are unaffected. Checking the password and calibrating
+    // take a KDF pass each, so they run on the thread pool behind a busy
+    // dialog; the database is read and written here, where it belongs.
+    struct Retune {
+        bool verified = false;
+        KdfHeader header;
+    };
+    
+    QProgressDialog progressDialog("Tuning the key derivation for this computer...", 
+                                   QString(), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    progressDialog.setCancelButton(nullptr);
+    progressDialog.show();
+    
+    QFutureWatcher<Retune> watcher;
+    QEventLoop loop;
+    connect(&watcher, &QFutureWatcher<Retune>::finished, &loop, &QEventLoop::quit);
+    watcher.setFuture(QtConcurrent::run(
+        [password, current = m_database->getKdfHeader(), masterKey = m_masterKey]() {
+            Retune retune;
+            QByteArray key = current.unlock(password);
+            retune.verified = key.size() == masterKey.size() && !key.isEmpty()
+                && CRYPTO_memcmp(key.constData(), masterKey.constData(), key.size()) == 0;
+            SecureMemory::wipe(key.data(), key.size());
+            if (retune.verified) {
+                retune.header = KdfHeader::forMasterKey(password, masterKey);
+            }
+            return retune;
+        }));
+    loop.exec();
+    progressDialog.reset();
+    
+    const Retune retune = watcher.future().takeResult();
+    const bool verified = retune.verified;
+    const KdfHeader &header = retune.header;
+    bool stored = header.isValid() && m_database->setKdfHeader(header);
+    password.fill(QChar(0));
+    resetAutoLockTimer();
+    
+    if (!verified) {
+        QMessageBox::warning(this, "Retune Unlock Speed", "Incorrect master password.");
+    } else if (!stored) {
+        QMessageBox::critical(this, "Retune Unlock Speed", 
+            "Failed to update the key derivation settings. The vault is unchanged.");
+    } else {
+        QMessageBox::information(this, "Retune Unlock Speed",
+            header.algorithm() == KdfHeader::Argon2id
+                ? QString("The vault now uses Argon2id with %1 passes over %2 MiB.")
+                      .arg(header.iterations()).arg(header.memoryCost() / 1024)
+                : QString("The vault now uses PBKDF2 with %1 iterations.")
+                      .arg(header.iterations()));
+    }
+}
+
 void MainWindow::onOpenSettings() {
     resetAutoLockTimer();
     
@@ -336,8 +750,7 @@ void MainWindow::onShowAbout() {
 void MainWindow::onShowContextMenu(const QPoint &pos) {
     resetAutoLockTimer();
     
-    QTableWidgetItem *item = m_tableWidget->itemAt(pos);
-    if (!item) return;
+    if (!m_tableView->indexAt(pos).isValid()) return;
     
     QMenu contextMenu(this);
     QAction *copyUsernameAction = contextMenu.addAction("Copy Username");
@@ -351,7 +764,7 @@ void MainWindow::onShowContextMenu(const QPoint &pos) {
     connect(editAction, &QAction::triggered, this, &MainWindow::onEditPassword);
     connect(deleteAction, &QAction::triggered, this, &MainWindow::onDeletePassword);
     
-    contextMenu.exec(m_tableWidget->viewport()->mapToGlobal(pos));
+    contextMenu.exec(m_tableView->viewport()->mapToGlobal(pos));
 }
 
 void MainWindow::startClipboardTimer() {
@@ -378,6 +791,9 @@ void MainWindow::applySettings() {
         m_autoLockTimer = nullptr;
     }
     setupAutoLock();
+    
+    m_backupScheduler->reschedule();
+    applySyncSettings();
 }
 
 void MainWindow::onThemeChanged() {
@@ -2,19 +2,27 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTableWidget>
+#include <QTableView>
 #include <QLineEdit>
 #include <QPushButton>
 #include <QTimer>
+#include <QProgressDialog>
 #include "../storage/database.h"
 #include "../models/passwordentry.h"
 #include "../models/settings.h"
+#include "passwordtablemodel.h"
+#include "passwordfilterproxymodel.h"
+#include "../search/searchscheduler.h"
+#include "../import/importservice.h"
+#include "../backup/backupscheduler.h"
+#include "../sync/syncengine.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
 public:
     MainWindow(Database *database, const QByteArray &masterKey, 
+               const QList<PasswordEntry> &entries,
                const QString &vaultPath, QWidget *parent = nullptr);
     ~MainWindow();
 
@@ -28,7 +36,8 @@ private slots:
     void onEditPassword();
     void onDeletePassword();
     void onSearchTextChanged(const QString &text);
-    void onTableDoubleClicked(int row, int column);
+    void onSearchResultsReady(const QString &query, const QList<FuzzyMatcher::Match> &matches);
+    void onTableDoubleClicked(const QModelIndex &index);
     void onCopyUsername();
     void onCopyPassword();
     void onOpenSettings();
@@ -36,22 +45,46 @@ private slots:
     void onShowContextMenu(const QPoint &pos);
     void onAutoLock();
     void onThemeChanged();
+    void onImport();
+    void onEntriesImported(const QList<PasswordEntry> &entries);
+    void onImportFinished(int imported, const QList<EntryReader::RowError> &errors);
+    void onImportCancelled(int imported);
+    void onImportFailed(const QString &message, int imported);
+    void onExport();
+    void onBackupNow();
+    void onBackupFinished(const BackupEngine::Snapshot &snapshot);
+    void onBackupFailed(const QString &message);
+    void onRestoreBackup();
+    void onSyncNow();
+    void onAutoSync();
+    void onRetuneKeyDerivation();
 
 private:
     Database *m_database;
     QByteArray m_masterKey;
     QString m_vaultPath;
     
-    QTableWidget *m_tableWidget;
+    QTableView *m_tableView;
+    // Summaries only: password and notes are fetched with getEntry on demand
+    PasswordTableModel *m_model;
+    PasswordFilterProxyModel *m_proxyModel;
+    // Matches the search box against snapshots of m_model's entries
+    SearchScheduler *m_searchScheduler;
     QLineEdit *m_searchBox;
     QPushButton *m_addButton;
     QPushButton *m_editButton;
     QPushButton *m_deleteButton;
     
-    QList<PasswordEntry> m_allEntries;
+    ImportService *m_importService;
+    QProgressDialog *m_importProgress;
     
     AppSettings *m_appSettings;
     VaultSettings *m_vaultSettings;
+    BackupScheduler *m_backupScheduler;
+    // Set while a backup started from the menu runs
+    bool m_backupRequested;
+    SyncEngine *m_syncEngine;
+    QTimer *m_syncTimer;
     
     QTimer *m_clipboardTimer;
     QTimer *m_autoLockTimer;
@@ -59,11 +92,14 @@ private:
     void setupUi();
     void loadPasswords();
     void filterPasswords(const QString &searchText);
-    void updateTable(const QList<PasswordEntry> &entries);
+    int currentEntryId() const;
     void setupAutoLock();
     void resetAutoLockTimer();
     void startClipboardTimer();
     void applySettings();
+    void endImport();
+    void applySyncSettings();
+    bool runSync(QString *message);
 };
 
 #endif
\ No newline at end of file
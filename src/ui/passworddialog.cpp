@@ -15,15 +15,15 @@ PasswordDialog::PasswordDialog(VaultSettings *vaultSettings, QWidget *parent)
 }
 
 PasswordDialog::PasswordDialog(const PasswordEntry &entry, VaultSettings *vaultSettings, QWidget *parent)
-    : QDialog(parent), m_isEditMode(true), m_entry(entry), m_vaultSettings(vaultSettings) {
+    : QDialog(parent), m_isEditMode(true), m_entry(entry.summary()), m_vaultSettings(vaultSettings) {
     setupUi();
     setWindowTitle("Edit Password");
     
     m_titleInput->setText(entry.title());
     m_usernameInput->setText(entry.username());
-    m_passwordInput->setText(entry.password());
+    m_passwordInput->setText(entry.password().toString());
     m_urlInput->setText(entry.url());
-    m_notesInput->setPlainText(entry.notes());
+    m_notesInput->setPlainText(entry.notes().toString());
 }
 
 void PasswordDialog::setupUi() {
@@ -70,7 +70,8 @@ void PasswordDialog::setupUi() {
 }
 
 PasswordEntry PasswordDialog::getPasswordEntry() const {
-    PasswordEntry entry;
+    // Keeps the id and timestamps of the entry being edited
+    PasswordEntry entry = m_isEditMode ? m_entry : PasswordEntry();
     entry.setTitle(m_titleInput->text());
     entry.setUsername(m_usernameInput->text());
     entry.setPassword(m_passwordInput->text());
@@ -0,0 +1,63 @@
+#include "passwordfilterproxymodel.h"
+#include "passwordtablemodel.h"
+#include <limits>
+
+PasswordFilterProxyModel::PasswordFilterProxyModel(QObject *parent)
+    : QSortFilterProxyModel(parent) {}
+
+void PasswordFilterProxyModel::setSearchResults(const QString &text, 
+                                                const QList<FuzzyMatcher::Match> &matches) {
+    QHash<int, int> ranks;
+    if (!text.isEmpty()) {
+        ranks.reserve(matches.size());
+        for (int rank = 0; rank < matches.size(); ++rank) {
+            ranks.insert(matches[rank].entryId, rank);
+        }
+    }
+    if (m_searchText == text && m_rankOfEntry == ranks) return;
+    
+    m_searchText = text;
+    m_rankOfEntry = ranks;
+    
+    // Sorting on column 0 goes through lessThan, i.e. by rank. Column -1
+    // restores the source order.
+    if (m_searchText.isEmpty()) {
+        sort(-1);
+        invalidateRowsFilter();
+    } else if (sortColumn() != 0) {
+        sort(0);
+        invalidateRowsFilter();
+    } else {
+        // sort() is a no-op for an unchanged column, but the ranks moved
+        invalidate();
+    }
+}
+
+bool PasswordFilterProxyModel::filterAcceptsRow(int sourceRow, 
+                                                const QModelIndex &sourceParent) const {
+    Q_UNUSED(sourceParent);
+    
+    if (m_searchText.isEmpty()) {
+        return true;
+    }
+    
+    if (!qobject_cast<PasswordTableModel*>(sourceModel())) {
+        return true;
+    }
+    
+    return rankOfRow(sourceRow) >= 0;
+}
+
+bool PasswordFilterProxyModel::lessThan(const QModelIndex &left, 
+                                        const QModelIndex &right) const {
+    return rankOfRow(left.row()) < rankOfRow(right.row());
+}
+
+int PasswordFilterProxyModel::rankOfRow(int sourceRow) const {
+    PasswordTableModel *model = qobject_cast<PasswordTableModel*>(sourceModel());
+    if (!model) {
+        return -1;
+    }
+    
+    return m_rankOfEntry.value(model->store().id(sourceRow), -1);
+}
@@ -0,0 +1,35 @@
+#ifndef PASSWORDFILTERPROXYMODEL_H
+#define PASSWORDFILTERPROXYMODEL_H
+
+#include <QSortFilterProxyModel>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include "../search/fuzzymatcher.h"
+
+// Filters a PasswordTableModel down to the entries matched by a search and
+// orders them by relevance. The matching itself happens in the owner's
+// FuzzyMatcher; this model only keeps each matched entry's rank. Without a
+// search, rows keep the source order.
+class PasswordFilterProxyModel : public QSortFilterProxyModel {
+    Q_OBJECT
+
+public:
+    explicit PasswordFilterProxyModel(QObject *parent = nullptr);
+
+    QString searchText() const { return m_searchText; }
+    // An empty text shows every row and ignores matches
+    void setSearchResults(const QString &text, const QList<FuzzyMatcher::Match> &matches);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+    bool lessThan(const QModelIndex &left, const QModelIndex &right) const override;
+
+private:
+    int rankOfRow(int sourceRow) const;
+
+    QString m_searchText;
+    QHash<int, int> m_rankOfEntry;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "passwordtablemodel.h"
+#include <QDateTime>
+
+PasswordTableModel::PasswordTableModel(QObject *parent)
+    : QAbstractTableModel(parent) {}
+
+int PasswordTableModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : m_store.size();
+}
+
+int PasswordTableModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant PasswordTableModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= m_store.size()) {
+        return QVariant();
+    }
+    
+    const int row = index.row();
+    
+    if (role == EntryIdRole) {
+        return m_store.id(row);
+    }
+    
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    
+    switch (index.column()) {
+        case TitleColumn:
+            return m_store.title(row).toString();
+        case UsernameColumn:
+            return m_store.username(row).toString();
+        case UrlColumn:
+            return m_store.url(row);
+        case ModifiedColumn:
+            return QDateTime::fromMSecsSinceEpoch(m_store.modified(row))
+                .toString("yyyy-MM-dd HH:mm");
+    }
+    
+    return QVariant();
+}
+
+QVariant PasswordTableModel::headerData(int section, Qt::Orientation orientation,
+                                        int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    
+    switch (section) {
+        case TitleColumn:
+            return QString("Title");
+        case UsernameColumn:
+            return QString("Username");
+        case UrlColumn:
+            return QString("URL");
+        case ModifiedColumn:
+            return QString("Modified");
+    }
+    
+    return QVariant();
+}
+
+void PasswordTableModel::setEntries(const QList<PasswordEntry> &entries) {
+    beginResetModel();
+    m_store.clear();
+    m_store.reserve(entries.size());
+    for (const PasswordEntry &entry : entries) {
+        m_store.append(entry);
+    }
+    endResetModel();
+}
+
+void PasswordTableModel::addEntry(const PasswordEntry &entry) {
+    int row = m_store.size();
+    beginInsertRows(QModelIndex(), row, row);
+    m_store.append(entry);
+    endInsertRows();
+}
+
+void PasswordTableModel::addEntries(const QList<PasswordEntry> &entries) {
+    if (entries.isEmpty()) return;
+    
+    int first = m_store.size();
+    beginInsertRows(QModelIndex(), first, first + entries.size() - 1);
+    m_store.reserve(first + entries.size());
+    for (const PasswordEntry &entry : entries) {
+        m_store.append(entry);
+    }
+    endInsertRows();
+}
+
+void PasswordTableModel::updateEntry(const PasswordEntry &entry) {
+    int row = rowOfEntry(entry.id());
+    if (row < 0) return;
+    
+    m_store.replace(row, entry);
+    emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+}
+
+void PasswordTableModel::removeEntry(int entryId) {
+    int row = rowOfEntry(entryId);
+    if (row < 0) return;
+    
+    beginRemoveRows(QModelIndex(), row, row);
+    m_store.removeAt(row);
+    endRemoveRows();
+}
+
+void PasswordTableModel::clear() {
+    beginResetModel();
+    m_store.clear();
+    endResetModel();
+}
@@ -0,0 +1,51 @@
+#ifndef PASSWORDTABLEMODEL_H
+#define PASSWORDTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QList>
+#include "../models/entrystore.h"
+
+// Table model over the entry summaries of an unlocked vault, kept in an
+// EntryStore. Views only ask for the rows they display, and single-entry
+// changes emit row-level signals instead of resetting the model.
+class PasswordTableModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column {
+        TitleColumn = 0,
+        UsernameColumn,
+        UrlColumn,
+        ModifiedColumn,
+        ColumnCount
+    };
+
+    enum Role {
+        EntryIdRole = Qt::UserRole
+    };
+
+    explicit PasswordTableModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+    // Only the summary fields are kept; the lists can be dropped afterwards
+    void setEntries(const QList<PasswordEntry> &entries);
+    void addEntry(const PasswordEntry &entry);
+    void addEntries(const QList<PasswordEntry> &entries);
+    void updateEntry(const PasswordEntry &entry);
+    void removeEntry(int entryId);
+    void clear();
+
+    // Rows of the store are rows of the model
+    const EntryStore &store() const { return m_store; }
+    int rowOfEntry(int entryId) const { return m_store.rowOfEntry(entryId); }
+
+private:
+    EntryStore m_store;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "settingsdialog.h"
 #include "thememanager.h"
+#include "../sync/directorysyncbackend.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFormLayout>
@@ -236,21 +237,24 @@ void SettingsDialog::createSyncPage() {
     QLabel *titleLabel = new QLabel("Sync Settings");
     titleLabel->setObjectName("pageTitle");
     
-    QLabel *infoLabel = new QLabel("These settings are vault-specific. Sync feature coming soon!");
+    QLabel *infoLabel = new QLabel("These settings are vault-specific. Devices sync copies "
+                                   "of the same vault through a shared folder.");
     infoLabel->setObjectName("infoLabel");
     
-    QGroupBox *accountGroup = new QGroupBox("Sync Account");
+    QGroupBox *accountGroup = new QGroupBox("Sync Folder");
     QFormLayout *accountLayout = new QFormLayout(accountGroup);
     
     m_syncEnabledCheck = new QCheckBox("Enable sync");
     
-    m_syncEmailEdit = new QLineEdit();
-    m_syncEmailEdit->setPlaceholderText("your@email.com");
+    QHBoxLayout *folderLayout = new QHBoxLayout();
+    m_syncFolderEdit = new QLineEdit();
+    m_syncFolderEdit->setPlaceholderText("NAS, Syncthing or Dropbox folder");
+    m_selectSyncFolderButton = new QPushButton("Browse...");
+    folderLayout->addWidget(m_syncFolderEdit);
+    folderLayout->addWidget(m_selectSyncFolderButton);
     
     QHBoxLayout *buttonLayout = new QHBoxLayout();
-    m_connectAccountButton = new QPushButton("Connect Account");
     m_testSyncButton = new QPushButton("Test Connection");
-    buttonLayout->addWidget(m_connectAccountButton);
     buttonLayout->addWidget(m_testSyncButton);
     buttonLayout->addStretch();
     
@@ -258,7 +262,7 @@ void SettingsDialog::createSyncPage() {
     m_syncStatusLabel->setObjectName("syncStatusLabel");
     
     accountLayout->addRow("", m_syncEnabledCheck);
-    accountLayout->addRow("Email:", m_syncEmailEdit);
+    accountLayout->addRow("Folder:", folderLayout);
     accountLayout->addRow("", buttonLayout);
     accountLayout->addRow("", m_syncStatusLabel);
     
@@ -279,13 +283,13 @@ void SettingsDialog::createSyncPage() {
     layout->addWidget(optionsGroup);
     layout->addStretch();
     
-    connect(m_connectAccountButton, &QPushButton::clicked, 
-            this, &SettingsDialog::onConnectSyncAccount);
+    connect(m_selectSyncFolderButton, &QPushButton::clicked, 
+            this, &SettingsDialog::onSelectSyncFolder);
     connect(m_testSyncButton, &QPushButton::clicked, 
             this, &SettingsDialog::onTestSync);
     connect(m_syncEnabledCheck, &QCheckBox::toggled, [this](bool checked) {
-        m_syncEmailEdit->setEnabled(checked);
-        m_connectAccountButton->setEnabled(checked);
+        m_syncFolderEdit->setEnabled(checked);
+        m_selectSyncFolderButton->setEnabled(checked);
         m_testSyncButton->setEnabled(checked);
         m_syncOptionCombo->setEnabled(checked);
         m_autoSyncCheck->setEnabled(checked);
@@ -396,13 +400,13 @@ void SettingsDialog::loadSettings() {
         m_maxBackupCountSpin->setEnabled(backupEnabled);
         
         m_syncEnabledCheck->setChecked(m_vaultSettings->syncEnabled());
-        m_syncEmailEdit->setText(m_vaultSettings->syncAccountEmail());
+        m_syncFolderEdit->setText(m_vaultSettings->syncFolder());
         m_syncOptionCombo->setCurrentIndex(static_cast<int>(m_vaultSettings->syncOption()));
         m_autoSyncCheck->setChecked(m_vaultSettings->autoSyncEnabled());
         
         bool syncEnabled = m_syncEnabledCheck->isChecked();
-        m_syncEmailEdit->setEnabled(syncEnabled);
-        m_connectAccountButton->setEnabled(syncEnabled);
+        m_syncFolderEdit->setEnabled(syncEnabled);
+        m_selectSyncFolderButton->setEnabled(syncEnabled);
         m_testSyncButton->setEnabled(syncEnabled);
         m_syncOptionCombo->setEnabled(syncEnabled);
         m_autoSyncCheck->setEnabled(syncEnabled);
@@ -443,7 +447,7 @@ void SettingsDialog::saveSettings() {
         m_vaultSettings->setMaxBackupCount(m_maxBackupCountSpin->value());
         
         m_vaultSettings->setSyncEnabled(m_syncEnabledCheck->isChecked());
-        m_vaultSettings->setSyncAccountEmail(m_syncEmailEdit->text());
+        m_vaultSettings->setSyncFolder(m_syncFolderEdit->text());
         m_vaultSettings->setSyncOption(
             static_cast<VaultSettings::SyncOption>(m_syncOptionCombo->currentIndex()));
         m_vaultSettings->setAutoSyncEnabled(m_autoSyncCheck->isChecked());
@@ -510,13 +514,23 @@ void SettingsDialog::onSelectBackupLocation() {
 }
 
 void SettingsDialog::onTestSync() {
-    QMessageBox::information(this, "Sync Test",
-        "Sync feature is not yet implemented. Coming soon!");
+    DirectorySyncBackend backend(m_syncFolderEdit->text());
+    QString error;
+    if (backend.test(&error)) {
+        m_syncStatusLabel->setText("Status: Folder is reachable");
+    } else {
+        m_syncStatusLabel->setText("Status: " + error);
+    }
 }
 
-void SettingsDialog::onConnectSyncAccount() {
-    QMessageBox::information(this, "Connect Account",
-        "Account connection feature is not yet implemented. Coming soon!");
+void SettingsDialog::onSelectSyncFolder() {
+    QString dir = QFileDialog::getExistingDirectory(this, 
+        "Select Sync Folder",
+        m_syncFolderEdit->text());
+    
+    if (!dir.isEmpty()) {
+        m_syncFolderEdit->setText(dir);
+    }
 }
 
 void SettingsDialog::enableVaultSettings(bool enable) {
@@ -579,7 +593,7 @@ void SettingsDialog::connectSettingSignals() {
         // Sync Settings
         connect(m_syncEnabledCheck, &QCheckBox::toggled, 
                 this, &SettingsDialog::onSettingChanged);
-        connect(m_syncEmailEdit, &QLineEdit::textChanged, 
+        connect(m_syncFolderEdit, &QLineEdit::textChanged, 
                 this, &SettingsDialog::onSettingChanged);
         connect(m_syncOptionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), 
                 this, &SettingsDialog::onSettingChanged);
@@ -31,7 +31,7 @@ private slots:
     void onResetToDefaults();
     void onSelectBackupLocation();
     void onTestSync();
-    void onConnectSyncAccount();
+    void onSelectSyncFolder();
     void onSettingChanged();
 
 private:
@@ -66,10 +66,10 @@ private:
     
     // Sync Settings Widgets
     QCheckBox *m_syncEnabledCheck;
-    QLineEdit *m_syncEmailEdit;
+    QLineEdit *m_syncFolderEdit;
+    QPushButton *m_selectSyncFolderButton;
     QComboBox *m_syncOptionCombo;
     QCheckBox *m_autoSyncCheck;
-    QPushButton *m_connectAccountButton;
     QPushButton *m_testSyncButton;
     QLabel *m_syncStatusLabel;
     